@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "mytar.h"
+#include "stats.h"
+
+/* Mallocs a chunk with room for size bytes */
+Chunk *newChunk(Arena *arena, size_t size) {
+	Chunk *chunk = malloc(sizeof(Chunk) + size);
+	if (!chunk) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	arena->mallocs += 1;
+	atomic_fetch_add_explicit(&stats.allocs, 1, memory_order_relaxed);
+	return chunk;
+}
+
+void arenaInit(Arena *arena, size_t size) {
+	arena->mallocs = 0;
+	arena->releases = 0;
+	arena->head = newChunk(arena, size);
+	arena->current = arena->head;
+	return;
+}
+
+/* Hands out size bytes of zeroed memory, like calloc. Moves on to the
+ * next chunk when the current one is full, only mallocing a new chunk
+ * if no chunk after the current one is big enough. */
+void *arenaAlloc(Arena *arena, size_t size) {
+	Chunk *chunk = arena->current;
+	Chunk *next;
+	void *mem;
+
+	/* Keep every allocation aligned */
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	while (chunk->used + size > chunk->size) {
+		next = chunk->next;
+		if (!next || next->size < size) {
+			next = newChunk(arena, size > ARENA_CHUNK ?
+					size : ARENA_CHUNK);
+			next->next = chunk->next;
+			chunk->next = next;
+		}
+		next->used = 0;
+		chunk = next;
+	}
+	arena->current = chunk;
+	mem = (char *)(chunk + 1) + chunk->used;
+	chunk->used += size;
+	memset(mem, 0, size);
+	return mem;
+}
+
+ArenaMark arenaMark(Arena *arena) {
+	ArenaMark mark;
+	mark.chunk = arena->current;
+	mark.used = arena->current->used;
+	return mark;
+}
+
+/* Frees everything allocated since mark was taken */
+void arenaRelease(Arena *arena, ArenaMark mark) {
+	arena->current = mark.chunk;
+	arena->current->used = mark.used;
+	arena->releases += 1;
+	return;
+}
+
+void arenaFree(Arena *arena) {
+	Chunk *chunk = arena->head;
+	Chunk *next;
+
+	while (chunk) {
+		next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = NULL;
+	arena->current = NULL;
+	return;
+}
+
+/* Prints how many times the arena went to malloc for --alloc-stats */
+void arenaReport(Arena *arena, char *prog) {
+	fprintf(stderr, "%s: %lu arena mallocs over %lu member releases\n",
+			prog, (unsigned long)arena->mallocs,
+			(unsigned long)arena->releases);
+	return;
+}
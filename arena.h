@@ -0,0 +1,42 @@
+#ifndef ARENAH
+#define ARENAH
+
+#include <stddef.h>
+
+/* One block of memory handed out by an arena */
+typedef struct chunk {
+	struct chunk *next;
+	size_t size;
+	size_t used;
+	/* The memory itself follows the chunk */
+} Chunk;
+
+/* A bump allocator for scratch memory that only lives as long as one
+ * archive member. Callers take a mark before working on a member and
+ * release back to it afterwards, which makes nested marks (like
+ * writeDirectory recursing) work like a stack. Chunks are never freed
+ * until arenaFree, so once the arena has grown to fit the deepest
+ * member nothing is malloc'd again. */
+typedef struct arena {
+	Chunk *head;
+	Chunk *current;
+	/* Times the arena had to call malloc */
+	size_t mallocs;
+	/* Times the arena was released back to a mark */
+	size_t releases;
+} Arena;
+
+/* Where an arena was when arenaMark was called */
+typedef struct arenamark {
+	Chunk *chunk;
+	size_t used;
+} ArenaMark;
+
+void arenaInit(Arena *, size_t);
+void *arenaAlloc(Arena *, size_t);
+ArenaMark arenaMark(Arena *);
+void arenaRelease(Arena *, ArenaMark);
+void arenaFree(Arena *);
+void arenaReport(Arena *, char *);
+
+#endif
@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "libmytar.h"
+#include "header.h"
+#include "utilities.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Starts a batch off empty; mtDecodeHeaders allocates its columns */
+void mtBatchInit(MtHeaderBatch *batch) {
+	memset(batch, 0, sizeof(MtHeaderBatch));
+	return;
+}
+
+/* Frees a batch's columns, leaving it empty to be used again */
+void mtBatchFree(MtHeaderBatch *batch) {
+	free(batch->valid);
+	free(batch->type);
+	free(batch->mode);
+	free(batch->size);
+	free(batch->mtime);
+	mtBatchInit(batch);
+	return;
+}
+
+/* Makes room for count rows. Returns MT_OK or MT_ERR_NOMEM. */
+static int growBatch(MtHeaderBatch *batch, size_t count) {
+	size_t cap = batch->cap ? batch->cap : BATCH_START;
+	unsigned char *valid;
+	char *type;
+	mode_t *mode;
+	uint64_t *size;
+	time_t *mtime;
+
+	if (count <= batch->cap) {
+		return MT_OK;
+	}
+	while (cap < count) {
+		cap *= 2;
+	}
+	/* Each one is kept as soon as it's grown, so a failure part way
+	 * leaves nothing to leak */
+	if (!(valid = realloc(batch->valid, cap))) {
+		return MT_ERR_NOMEM;
+	}
+	batch->valid = valid;
+	if (!(type = realloc(batch->type, cap))) {
+		return MT_ERR_NOMEM;
+	}
+	batch->type = type;
+	if (!(mode = realloc(batch->mode, cap * sizeof(mode_t)))) {
+		return MT_ERR_NOMEM;
+	}
+	batch->mode = mode;
+	if (!(size = realloc(batch->size, cap * sizeof(uint64_t)))) {
+		return MT_ERR_NOMEM;
+	}
+	batch->size = size;
+	if (!(mtime = realloc(batch->mtime, cap * sizeof(time_t)))) {
+		return MT_ERR_NOMEM;
+	}
+	batch->mtime = mtime;
+	batch->cap = cap;
+	return MT_OK;
+}
+
+#ifdef __SSE2__
+/* Adds up the bytes of a block, 16 at a time with psadbw, which leaves
+ * a partial sum in each half of the register */
+static unsigned int sumBlock(const unsigned char *block) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+	int i;
+
+	for (i = 0; i < BLOCK_SIZE; i += 16) {
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(
+						(const __m128i *)(block + i)),
+					zero));
+	}
+	return (unsigned int)(_mm_cvtsi128_si32(sum) +
+			_mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+
+/* Turns each 32 bit lane of digits, four octal digit values with the
+ * most significant first, into the 12 bit number they make: neighbouring
+ * digits are merged into 6 bit values, and those pairwise with pmaddwd */
+static __m128i octalQuads(__m128i digits) {
+	__m128i pairs = _mm_add_epi16(
+			_mm_slli_epi16(_mm_and_si128(digits,
+					_mm_set1_epi16(0x00ff)), 3),
+			_mm_srli_epi16(digits, 8));
+
+	return _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010040));
+}
+
+/* Turns each 64 bit lane of digits, eight octal digit values with the
+ * most significant first, into the number they make, by joining the
+ * lane's two 12 bit values from octalQuads, so two groups of eight
+ * digits take a handful of instructions together */
+static __m128i octalLanes(__m128i digits) {
+	__m128i quads = octalQuads(digits);
+
+	return _mm_add_epi64(_mm_slli_epi64(_mm_and_si128(quads,
+					_mm_set_epi32(0, -1, 0, -1)), 12),
+			_mm_srli_epi64(quads, 32));
+}
+
+/* Whether every byte is an octal digit value, 0 through 7, once '0'
+ * has been taken off */
+static int allOctal(__m128i digits) {
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(digits,
+					_mm_set1_epi8(7)),
+				_mm_setzero_si128())) == 0xffff;
+}
+
+/* Whether a field's last byte ends it the way every writer does */
+static int fieldEnd(char c) {
+	return c == '\0' || c == ' ';
+}
+
+/* Decodes a 12 byte field written as 11 octal digits and an ending,
+ * like size and mtime: the first three digits go in the low lane and
+ * the other eight in the high lane. Returns -1 for anything else,
+ * like leading spaces or a base-256 number, which parseOctal handles
+ * instead. */
+static int64_t octal12(const char *field) {
+	__m128i raw = _mm_loadl_epi64((const __m128i *)field);
+	/* The top three bytes of the low lane, with zeros under them */
+	__m128i low = _mm_slli_epi64(raw, 40);
+	__m128i high = _mm_loadl_epi64((const __m128i *)(field + 3));
+	__m128i digits = _mm_sub_epi8(_mm_unpacklo_epi64(low, high),
+			_mm_set_epi8('0', '0', '0', '0', '0', '0', '0', '0',
+				'0', '0', '0', 0, 0, 0, 0, 0));
+	__m128i vals;
+
+	if (!fieldEnd(field[SIZE_SIZE - 1]) || !allOctal(digits)) {
+		return -1;
+	}
+	vals = octalLanes(digits);
+	return ((int64_t)_mm_cvtsi128_si32(vals) << 24) |
+		_mm_cvtsi128_si32(_mm_srli_si128(vals, 8));
+}
+
+/* Decodes the 8 byte mode fields, 7 octal digits and an ending, of two
+ * headers at once, one per lane. Returns 0, or -1 if either isn't
+ * written that way. */
+static int octalModes(const char *a, const char *b, mode_t *mode_a,
+		mode_t *mode_b) {
+	__m128i raw = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)a),
+			_mm_loadl_epi64((const __m128i *)b));
+	/* Drop the ending and make room for a leading zero digit */
+	__m128i digits = _mm_sub_epi8(_mm_slli_epi64(raw, 8),
+			_mm_set_epi8('0', '0', '0', '0', '0', '0', '0', 0,
+				'0', '0', '0', '0', '0', '0', '0', 0));
+	__m128i vals;
+
+	if (!fieldEnd(a[MODE_SIZE - 1]) || !fieldEnd(b[MODE_SIZE - 1]) ||
+			!allOctal(digits)) {
+		return -1;
+	}
+	vals = octalLanes(digits);
+	*mode_a = (mode_t)_mm_cvtsi128_si32(vals);
+	*mode_b = (mode_t)_mm_cvtsi128_si32(_mm_srli_si128(vals, 8));
+	return 0;
+}
+
+/* Decodes the size and mtime fields of two headers at once, into
+ * values in the order a's size, b's size, a's mtime, b's mtime. The
+ * last eight digits of the four fields fill two registers, a lane each,
+ * and their first three digits, with a zero in front, fill the four 32
+ * bit lanes of a third, so the four fields take three registers where
+ * octal12 would take four. Returns 0, or -1 if any of them isn't
+ * written as 11 octal digits and an ending. */
+static int octalNumbers(const Header *a, const Header *b,
+		int64_t *values) {
+	const char *fields[4] = {a->size, b->size, a->mtime, b->mtime};
+	uint32_t firsts[4];
+	uint32_t high[4];
+	uint64_t low[4];
+	__m128i digits[3];
+	int k;
+
+	for (k = 0; k < 4; k++) {
+		if (!fieldEnd(fields[k][SIZE_SIZE - 1])) {
+			return -1;
+		}
+		memcpy(&firsts[k], fields[k], sizeof(uint32_t));
+	}
+	/* Drop each lane's fourth digit and make room for a leading zero */
+	digits[0] = _mm_sub_epi8(_mm_slli_epi32(_mm_loadu_si128(
+					(const __m128i *)firsts), 8),
+			_mm_set1_epi32(0x30303000));
+	digits[1] = _mm_sub_epi8(_mm_unpacklo_epi64(
+				_mm_loadl_epi64((const __m128i *)(a->size + 3)),
+				_mm_loadl_epi64((const __m128i *)(b->size + 3))),
+			_mm_set1_epi8('0'));
+	digits[2] = _mm_sub_epi8(_mm_unpacklo_epi64(
+				_mm_loadl_epi64((const __m128i *)(a->mtime + 3)),
+				_mm_loadl_epi64((const __m128i *)(b->mtime + 3))),
+			_mm_set1_epi8('0'));
+	if (!allOctal(digits[0]) || !allOctal(digits[1]) ||
+			!allOctal(digits[2])) {
+		return -1;
+	}
+	_mm_storeu_si128((__m128i *)high, octalQuads(digits[0]));
+	_mm_storeu_si128((__m128i *)low, octalLanes(digits[1]));
+	_mm_storeu_si128((__m128i *)(low + 2), octalLanes(digits[2]));
+	for (k = 0; k < 4; k++) {
+		values[k] = ((int64_t)high[k] << 24) | (int64_t)low[k];
+	}
+	return 0;
+}
+
+/* Decodes one header's numeric fields a field at a time, falling back
+ * to parseOctal for ones octal12 can't do */
+static void decodeOne(MtHeaderBatch *batch, size_t row,
+		const Header *header) {
+	int64_t size = octal12(header->size);
+	int64_t mtime = octal12(header->mtime);
+
+	batch->size[row] = size != -1 ? (uint64_t)size :
+		parseOctal(header->size, SIZE_SIZE);
+	batch->mtime[row] = mtime != -1 ? (time_t)mtime :
+		(time_t)parseOctal(header->mtime, MTIME_SIZE);
+	batch->mode[row] = parseOctal(header->mode, MODE_SIZE);
+	return;
+}
+
+/* Decodes the numeric fields of two headers together, falling back to
+ * decoding them one at a time when either has a field written some
+ * other way */
+static void decodePair(MtHeaderBatch *batch, size_t row_a,
+		const Header *a, size_t row_b, const Header *b) {
+	int64_t values[4];
+
+	if (octalNumbers(a, b, values) == -1 ||
+			octalModes(a->mode, b->mode, &batch->mode[row_a],
+				&batch->mode[row_b]) == -1) {
+		decodeOne(batch, row_a, a);
+		decodeOne(batch, row_b, b);
+		return;
+	}
+	batch->size[row_a] = (uint64_t)values[0];
+	batch->size[row_b] = (uint64_t)values[1];
+	batch->mtime[row_a] = (time_t)values[2];
+	batch->mtime[row_b] = (time_t)values[3];
+	return;
+}
+#else
+static unsigned int sumBlock(const unsigned char *block) {
+	unsigned int sum = 0;
+	int i;
+
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		sum += block[i];
+	}
+	return sum;
+}
+#endif
+
+/* Decodes count header blocks at blocks into the batch's columns,
+ * replacing what was there. Every block's checksum is worked out first,
+ * and the magic checked, which is all a scan for headers needs for the
+ * blocks that aren't any. Then the numeric fields of the ones that
+ * are headers are decoded a whole field at a time with SSE2 where it's
+ * available, two headers at a time, falling back to parsing digit by
+ * digit for fields written some other way. Returns MT_OK, or
+ * MT_ERR_NOMEM if the columns couldn't grow. */
+int mtDecodeHeaders(MtHeaderBatch *batch, const void *blocks,
+		size_t count) {
+	const unsigned char *base = blocks;
+	const Header *header;
+#ifdef __SSE2__
+	const Header *pending = NULL;
+	size_t pending_row = 0;
+#endif
+	unsigned int sum;
+	size_t i;
+	int j;
+	int status;
+	uint64_t start = statsStart();
+
+	if ((status = growBatch(batch, count)) != MT_OK) {
+		return status;
+	}
+	batch->count = count;
+	for (i = 0; i < count; i++) {
+		header = (const Header *)(base + i * BLOCK_SIZE);
+		if (memcmp(header->magic, MAGIC_NUM, MAGIC_SIZE - 1) != 0) {
+			batch->valid[i] = 0;
+			continue;
+		}
+		/* The checksum field counts as spaces */
+		sum = sumBlock((const unsigned char *)header) +
+			CHKSUM_SIZE * ' ';
+		for (j = CHKSUM_OFFSET; j < CHKSUM_OFFSET + CHKSUM_SIZE; j++) {
+			sum -= base[i * BLOCK_SIZE + j];
+		}
+		batch->valid[i] = sum == parseOctal(header->chksum,
+				CHKSUM_SIZE);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!batch->valid[i]) {
+			continue;
+		}
+		header = (const Header *)(base + i * BLOCK_SIZE);
+		batch->type[i] = *header->typeflag;
+#ifdef __SSE2__
+		/* Headers are paired up as they come */
+		if (!pending) {
+			pending = header;
+			pending_row = i;
+			continue;
+		}
+		decodePair(batch, pending_row, pending, i, header);
+		pending = NULL;
+#else
+		batch->size[i] = parseOctal(header->size, SIZE_SIZE);
+		batch->mtime[i] = (time_t)parseOctal(header->mtime,
+				MTIME_SIZE);
+		batch->mode[i] = parseOctal(header->mode, MODE_SIZE);
+#endif
+	}
+#ifdef __SSE2__
+	if (pending) {
+		decodeOne(batch, pending_row, pending);
+	}
+#endif
+	statsAdd(STAT_CHKSUM, start, 0);
+	return MT_OK;
+}
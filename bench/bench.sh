@@ -0,0 +1,129 @@
+#!/bin/sh
+# Times creating (c), listing (t), and extracting (x) each generated
+# tree with mytar and with GNU tar as a baseline, and prints the results
+# as JSON.
+#
+# Environment:
+#   MYTAR        mytar binary (default ./mytar)
+#   TAR          baseline tar (default tar)
+#   BENCH_DIR    scratch directory, trees are kept here between runs
+#                (default bench/work)
+#   BENCH_SCALE  divides every file count, e.g. 100 for a quick run
+#                (default 1)
+#   BENCH_RUNS   runs of each operation, the fastest is reported
+#                (default 3)
+#   BENCH_OUT    file the JSON is written to (default stdout)
+#   BENCH_TREES  which trees to run (default all of them)
+
+set -e
+
+MYTAR=$(cd "$(dirname "${MYTAR:-./mytar}")" && pwd)/$(basename "${MYTAR:-./mytar}")
+TAR=${TAR:-tar}
+BENCH_DIR=${BENCH_DIR:-bench/work}
+BENCH_SCALE=${BENCH_SCALE:-1}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_TREES=${BENCH_TREES:-"tiny flat huge deep sparse symlinks"}
+GENTREE=$(cd bench && pwd)/gentree
+
+mkdir -p "$BENCH_DIR/trees"
+BENCH_DIR=$(cd "$BENCH_DIR" && pwd)
+
+# Default count and size of each tree at scale 1
+params() {
+	case $1 in
+	tiny) echo 1000000 100 ;;
+	flat) echo 5000000 0 ;;
+	huge) echo 100 67108864 ;;
+	deep) echo 2000 0 ;;
+	sparse) echo 20 1073741824 ;;
+	symlinks) echo 200000 0 ;;
+	esac
+}
+
+now() {
+	date +%s%N
+}
+
+# Runs a command BENCH_RUNS times in the current directory and prints
+# the fastest time in seconds. Anything it writes to stdout is dropped.
+best() {
+	fastest=
+	i=0
+	while [ $i -lt "$BENCH_RUNS" ]; do
+		start=$(now)
+		"$@" > /dev/null
+		end=$(now)
+		elapsed=$((end - start))
+		if [ -z "$fastest" ] || [ $elapsed -lt "$fastest" ]; then
+			fastest=$elapsed
+		fi
+		i=$((i + 1))
+	done
+	echo "$fastest" | awk '{ printf "%.6f", $1 / 1e9 }'
+}
+
+# Each tool is run as "tool cf archive tree", so GNU tar gets a ustar
+# archive like mytar writes
+tool_args() {
+	if [ "$1" = "$TAR" ]; then
+		echo "--format=ustar"
+	fi
+}
+
+results=
+emit() {
+	record="{\"tree\":\"$1\",\"tool\":\"$2\",\"op\":\"$3\",\"seconds\":$4,\"entries\":$5,\"bytes\":$6}"
+	if [ -z "$results" ]; then
+		results="  $record"
+	else
+		results="$results,
+  $record"
+	fi
+}
+
+for tree in $BENCH_TREES; do
+	set -- $(params "$tree")
+	count=$(($1 / BENCH_SCALE))
+	[ $count -gt 0 ] || count=1
+	size=$2
+	src="$BENCH_DIR/trees/$tree-$count-$size"
+	if [ ! -d "$src" ]; then
+		echo "generating $tree ($count)" >&2
+		(cd "$BENCH_DIR/trees" && "$GENTREE" "$tree" \
+			"$tree-$count-$size" "$count" "$size")
+	fi
+	entries=$(find "$src" | wc -l)
+	bytes=$(du -s --apparent-size -B1 "$src" | cut -f1)
+
+	for tool in "$MYTAR" "$TAR"; do
+		name=$(basename "$tool")
+		archive="$BENCH_DIR/$name-$tree.tar"
+		out="$BENCH_DIR/out"
+		extra=$(tool_args "$tool")
+		echo "$name $tree" >&2
+
+		cd "$BENCH_DIR/trees"
+		t=$(best "$tool" cf "$archive" $extra "$tree-$count-$size")
+		emit "$tree" "$name" c "$t" "$entries" "$bytes"
+
+		t=$(best "$tool" tf "$archive")
+		emit "$tree" "$name" t "$t" "$entries" "$bytes"
+
+		rm -rf "$out"
+		mkdir -p "$out"
+		cd "$out"
+		t=$(best "$tool" xf "$archive")
+		emit "$tree" "$name" x "$t" "$entries" "$bytes"
+		cd "$BENCH_DIR"
+		rm -rf "$out" "$archive"
+	done
+done
+
+json="[
+$results
+]"
+if [ -n "$BENCH_OUT" ]; then
+	echo "$json" > "$BENCH_OUT"
+else
+	echo "$json"
+fi
@@ -0,0 +1,233 @@
+/* Generates the synthetic trees used by bench.sh. Every tree is built
+ * from a fixed seed, so the same arguments always give the same names,
+ * sizes, and contents.
+ *
+ * usage: gentree kind dir [count [size]]
+ *   tiny     - count files of up to size bytes spread over 1000 dirs
+ *   flat     - count files of up to size bytes all in one directory
+ *   huge     - count files of size bytes
+ *   deep     - count chains of directories nested as deep as mytar's
+ *              256 character path limit allows, each ending in a file
+ *   sparse   - count files of size bytes that are mostly holes
+ *   symlinks - count symlinks pointing at a handful of real files */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define SEED 0x9e3779b97f4a7c15ULL
+#define CHUNK (1 << 20)
+#define PATH_MAX_LEN 4096
+#define TINY_DIRS 1000
+#define DEEP_LEVELS 60
+#define SPARSE_EXTENTS 8
+#define SYMLINK_TARGETS 16
+#define FILE_MODE 0644
+#define DIR_MODE 0755
+/* A fixed mtime so archives of the tree are identical between runs */
+#define FIXED_MTIME 1000000000
+
+unsigned long long state = SEED;
+
+/* xorshift64* */
+unsigned long long nextRand(void) {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545f4914f6cdd1dULL;
+}
+
+void fill(char *buf, size_t len) {
+	size_t i;
+	unsigned long long r;
+
+	for (i = 0; i + sizeof(r) <= len; i += sizeof(r)) {
+		r = nextRand();
+		memcpy(buf + i, &r, sizeof(r));
+	}
+	for (; i < len; i++) {
+		buf[i] = (char)nextRand();
+	}
+	return;
+}
+
+void makeDir(char *path) {
+	if (mkdir(path, DIR_MODE) == -1) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	return;
+}
+
+/* Writes len bytes of generated data at offset, or just sets the file's
+ * length to len if data is 0 */
+void writeAt(char *path, int fd, off_t offset, size_t len, char *buf) {
+	size_t n;
+
+	while (len > 0) {
+		n = len < CHUNK ? len : CHUNK;
+		fill(buf, n);
+		if (pwrite(fd, buf, n, offset) != (ssize_t)n) {
+			perror(path);
+			exit(EXIT_FAILURE);
+		}
+		offset += n;
+		len -= n;
+	}
+	return;
+}
+
+int openFile(char *path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, FILE_MODE);
+	if (fd == -1) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/* Gives every entry in the tree the same mtime, deepest first */
+void fixTimes(char *dir) {
+	char cmd[PATH_MAX_LEN];
+
+	snprintf(cmd, sizeof(cmd), "find '%s' -depth -exec touch -h -d @%d"
+			" {} +", dir, FIXED_MTIME);
+	if (system(cmd) != 0) {
+		fprintf(stderr, "couldn't set times in %s\n", dir);
+		exit(EXIT_FAILURE);
+	}
+	return;
+}
+
+int main(int argc, char *argv[]) {
+	char *kind;
+	char *dir;
+	long count;
+	long long size;
+	long i;
+	int j;
+	int fd;
+	size_t len;
+	char path[PATH_MAX_LEN];
+	char target[PATH_MAX_LEN];
+	char *buf;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s tiny|flat|huge|deep|sparse|"
+				"symlinks "
+				"dir [count [size]]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	kind = argv[1];
+	dir = argv[2];
+	count = argc > 3 ? atol(argv[3]) : 1000;
+	size = argc > 4 ? atoll(argv[4]) : 0;
+	buf = malloc(CHUNK);
+	if (!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	makeDir(dir);
+
+	if (strcmp(kind, "tiny") == 0) {
+		if (size <= 0) {
+			size = 100;
+		}
+		for (i = 0; i < TINY_DIRS && i < count; i++) {
+			snprintf(path, sizeof(path), "%s/d%03ld", dir, i);
+			makeDir(path);
+		}
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/d%03ld/f%07ld", dir,
+					i % TINY_DIRS, i);
+			fd = openFile(path);
+			writeAt(path, fd, 0, nextRand() % (size + 1), buf);
+			close(fd);
+		}
+	}
+	else if (strcmp(kind, "flat") == 0) {
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/f%07ld", dir, i);
+			fd = openFile(path);
+			if (size > 0) {
+				writeAt(path, fd, 0, nextRand() % (size + 1), 
+						buf);
+			}
+			close(fd);
+		}
+	}
+	else if (strcmp(kind, "huge") == 0) {
+		if (size <= 0) {
+			size = 64LL << 20;
+		}
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/huge%03ld", dir, i);
+			fd = openFile(path);
+			writeAt(path, fd, 0, size, buf);
+			close(fd);
+		}
+	}
+	else if (strcmp(kind, "deep") == 0) {
+		for (i = 0; i < count; i++) {
+			len = snprintf(path, sizeof(path), "%s/c%04ld", dir, i);
+			makeDir(path);
+			for (j = 0; j < DEEP_LEVELS; j++) {
+				len += snprintf(path + len, sizeof(path) - len,
+						"/%c", 'a' + j % 26);
+				makeDir(path);
+			}
+			snprintf(path + len, sizeof(path) - len, "/leaf");
+			fd = openFile(path);
+			writeAt(path, fd, 0, nextRand() % 4096, buf);
+			close(fd);
+		}
+	}
+	else if (strcmp(kind, "sparse") == 0) {
+		if (size <= 0) {
+			size = 1LL << 30;
+		}
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/sparse%03ld", dir, i);
+			fd = openFile(path);
+			if (ftruncate(fd, size) == -1) {
+				perror(path);
+				exit(EXIT_FAILURE);
+			}
+			/* A few small extents of data among the holes */
+			for (j = 0; j < SPARSE_EXTENTS; j++) {
+				writeAt(path, fd, (off_t)(nextRand() % size) &
+						~(off_t)4095, 4096, buf);
+			}
+			close(fd);
+		}
+	}
+	else if (strcmp(kind, "symlinks") == 0) {
+		for (j = 0; j < SYMLINK_TARGETS; j++) {
+			snprintf(path, sizeof(path), "%s/target%02d", dir, j);
+			fd = openFile(path);
+			writeAt(path, fd, 0, 1024, buf);
+			close(fd);
+		}
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/link%07ld", dir, i);
+			snprintf(target, sizeof(target), "target%02d",
+					(int)(nextRand() % SYMLINK_TARGETS));
+			if (symlink(target, path) == -1) {
+				perror(path);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	else {
+		fprintf(stderr, "%s: unknown kind '%s'\n", argv[0], kind);
+		exit(EXIT_FAILURE);
+	}
+
+	free(buf);
+	fixTimes(dir);
+	return 0;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "blockcache.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Makes a cache holding up to size bytes of blocks. Memory for each
+ * block is only allocated once it's first needed. */
+void blockCacheInit(BlockCache *cache, uint64_t size) {
+	size_t buckets = 1;
+	size_t i;
+
+	memset(cache, 0, sizeof(BlockCache));
+	cache->max_blocks = size / SERVE_BLOCK;
+	cache->head = -1;
+	cache->tail = -1;
+	pthread_mutex_init(&cache->lock, NULL);
+	if (cache->max_blocks == 0) {
+		return;
+	}
+	while (buckets < 2 * cache->max_blocks) {
+		buckets *= 2;
+	}
+	cache->blocks = calloc(cache->max_blocks, sizeof(CachedBlock));
+	cache->buckets = malloc(buckets * sizeof(long));
+	if (!cache->blocks || !cache->buckets) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < buckets; i++) {
+		cache->buckets[i] = -1;
+	}
+	cache->mask = buckets - 1;
+	return;
+}
+
+/* Which bucket the block numbered index of archive goes in */
+static size_t bucketOf(BlockCache *cache, int archive, uint64_t index) {
+	uint64_t key = index ^ ((uint64_t)archive << SERVE_ARCHIVE_SHIFT);
+
+	return (size_t)((key * FIBONACCI_MULT) >> 32) & cache->mask;
+}
+
+/* Takes block i out of the LRU list */
+static void unlinkBlock(BlockCache *cache, long i) {
+	CachedBlock *block = &cache->blocks[i];
+
+	if (block->prev != -1) {
+		cache->blocks[block->prev].next = block->next;
+	}
+	else {
+		cache->head = block->next;
+	}
+	if (block->next != -1) {
+		cache->blocks[block->next].prev = block->prev;
+	}
+	else {
+		cache->tail = block->prev;
+	}
+	return;
+}
+
+/* Puts block i at the front of the LRU list */
+static void pushBlock(BlockCache *cache, long i) {
+	CachedBlock *block = &cache->blocks[i];
+
+	block->prev = -1;
+	block->next = cache->head;
+	if (cache->head != -1) {
+		cache->blocks[cache->head].prev = i;
+	}
+	cache->head = i;
+	if (cache->tail == -1) {
+		cache->tail = i;
+	}
+	return;
+}
+
+/* Finds a block, moving it to the front if it's there. Returns its
+ * index, or -1. Called with the lock held. */
+static long findBlock(BlockCache *cache, int archive, uint64_t index) {
+	long i = cache->buckets[bucketOf(cache, archive, index)];
+
+	while (i != -1 && (cache->blocks[i].archive != archive || 
+				cache->blocks[i].index != index)) {
+		i = cache->blocks[i].chain;
+	}
+	if (i != -1 && i != cache->head) {
+		unlinkBlock(cache, i);
+		pushBlock(cache, i);
+	}
+	return i;
+}
+
+/* Adds len bytes of data as the block numbered index of archive, in a
+ * block that hasn't been used yet or else in place of the least
+ * recently used one. Returns its index. Called with the lock held. */
+static long addBlock(BlockCache *cache, int archive, uint64_t index,
+		const char *data, size_t len) {
+	long i;
+	long *link;
+	CachedBlock *block;
+
+	if (cache->num_blocks < cache->max_blocks) {
+		i = cache->num_blocks;
+		block = &cache->blocks[i];
+		block->data = malloc(SERVE_BLOCK);
+		if (!block->data) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		cache->num_blocks += 1;
+	}
+	else {
+		i = cache->tail;
+		block = &cache->blocks[i];
+		unlinkBlock(cache, i);
+		link = &cache->buckets[bucketOf(cache, block->archive, 
+				block->index)];
+		while (*link != i) {
+			link = &cache->blocks[*link].chain;
+		}
+		*link = block->chain;
+	}
+	block->archive = archive;
+	block->index = index;
+	block->len = len;
+	memcpy(block->data, data, len);
+	link = &cache->buckets[bucketOf(cache, archive, index)];
+	block->chain = *link;
+	*link = i;
+	pushBlock(cache, i);
+	return i;
+}
+
+/* Reads the block numbered index of the archive open as fd into buf,
+ * going on after short reads and interrupted ones so only the
+ * archive's last block comes back short. Returns its length, or -1 if
+ * a read failed. */
+static ssize_t readBlock(int fd, char *buf, uint64_t index) {
+	size_t done = 0;
+	ssize_t got;
+	uint64_t start;
+
+	while (done < SERVE_BLOCK) {
+		start = statsStart();
+		got = pread(fd, buf + done, SERVE_BLOCK - done,
+				(off_t)index * SERVE_BLOCK + done);
+		statsAdd(STAT_READ, start, got > 0 ? got : 0);
+		if (got == -1 && errno == EINTR) {
+			continue;
+		}
+		if (got == -1) {
+			return -1;
+		}
+		if (got == 0) {
+			break;
+		}
+		done += got;
+	}
+	return done;
+}
+
+/* Reads len bytes at offset in archive, open as fd, into buf through
+ * the cache. Blocks that aren't cached are read whole into scratch,
+ * which has room for SERVE_BLOCK bytes, without holding the lock, and
+ * then added. Returns how many bytes were read, fewer than len only at
+ * the end of the archive, or -1 if a read failed. */
+ssize_t blockCacheRead(BlockCache *cache, int archive, int fd, char *buf,
+		size_t len, off_t offset, char *scratch) {
+	size_t done = 0;
+	uint64_t index;
+	size_t skip;
+	size_t n;
+	ssize_t got;
+	long i;
+	uint64_t start;
+
+	while (done < len) {
+		index = (offset + done) / SERVE_BLOCK;
+		skip = (offset + done) % SERVE_BLOCK;
+		if (cache->max_blocks == 0) {
+			start = statsStart();
+			got = pread(fd, buf + done, len - done, offset + done);
+			statsAdd(STAT_READ, start, got > 0 ? got : 0);
+			if (got == -1 && errno == EINTR) {
+				continue;
+			}
+			if (got <= 0) {
+				return got == 0 ? (ssize_t)done : -1;
+			}
+			done += got;
+			continue;
+		}
+
+		pthread_mutex_lock(&cache->lock);
+		i = findBlock(cache, archive, index);
+		if (i != -1) {
+			cache->hits += 1;
+		}
+		else {
+			pthread_mutex_unlock(&cache->lock);
+			got = readBlock(fd, scratch, index);
+			if (got == -1) {
+				return -1;
+			}
+			pthread_mutex_lock(&cache->lock);
+			cache->misses += 1;
+			/* Another client may have read it in meanwhile */
+			i = findBlock(cache, archive, index);
+			if (i == -1) {
+				i = addBlock(cache, archive, index, scratch, got);
+			}
+		}
+		n = 0;
+		if (skip < cache->blocks[i].len) {
+			n = cache->blocks[i].len - skip;
+			n = n < len - done ? n : len - done;
+			memcpy(buf + done, cache->blocks[i].data + skip, n);
+		}
+		pthread_mutex_unlock(&cache->lock);
+		/* The archive ended */
+		if (n == 0) {
+			break;
+		}
+		done += n;
+	}
+	return done;
+}
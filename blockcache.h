@@ -0,0 +1,50 @@
+#ifndef BLOCKCACHEH
+#define BLOCKCACHEH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/* A SERVE_BLOCK sized piece of an archive held in memory */
+typedef struct cachedblock {
+	/* The archive it's from, and which of its blocks it is */
+	int archive;
+	uint64_t index;
+	char *data;
+	/* Shorter than SERVE_BLOCK for the last block of an archive */
+	size_t len;
+	/* Its neighbours in the LRU list and the next block in its hash
+	 * bucket, as indices into the cache's blocks, or -1 */
+	long prev;
+	long next;
+	long chain;
+} CachedBlock;
+
+/* The blocks of served archives read most recently, shared by every
+ * client thread, so small members that are asked for again and again
+ * come out of memory instead of costing a pread each. Once it's full
+ * the least recently used block makes room for the next. */
+typedef struct blockcache {
+	CachedBlock *blocks;
+	size_t num_blocks;
+	/* How many blocks fit in the size it was given, 0 to cache
+	 * nothing */
+	size_t max_blocks;
+	/* Hash buckets holding the first block of each chain, or -1. The
+	 * number of them is a power of two. */
+	long *buckets;
+	size_t mask;
+	/* Most and least recently used blocks, or -1 */
+	long head;
+	long tail;
+	uint64_t hits;
+	uint64_t misses;
+	pthread_mutex_t lock;
+} BlockCache;
+
+void blockCacheInit(BlockCache *, uint64_t);
+ssize_t blockCacheRead(BlockCache *, int, int, char *, size_t, off_t, 
+		char *);
+
+#endif
@@ -0,0 +1,119 @@
+/* sync_file_range is Linux specific */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "cache.h"
+#include "mytar.h"
+
+Cache cache;
+
+void cacheInit(int no_pollution, int readahead) {
+	memset(&cache, 0, sizeof(Cache));
+	cache.no_pollution = no_pollution;
+	cache.readahead = readahead;
+	return;
+}
+
+/* Tells the kernel a source file that was just opened will be read
+ * front to back, so it reads further ahead than it would otherwise */
+void cacheSource(int fd) {
+	if (cache.no_pollution || cache.readahead) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	return;
+}
+
+/* Asks for a source file that's coming up to be read into the page
+ * cache in the background */
+void cacheWillNeed(char *path) {
+	int fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+
+	if (fd == -1) {
+		return;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+	return;
+}
+
+/* Where a file being read is, or 0 if nothing will be dropped from the
+ * page cache so it doesn't matter */
+off_t cacheTell(int fd) {
+	if (!cache.no_pollution) {
+		return 0;
+	}
+	return lseek(fd, 0, SEEK_CUR);
+}
+
+/* Called as a file is read, pos being how far it's been read. Drops
+ * what's been read from the page cache once there's CACHE_WINDOW of it,
+ * so the calls are few and each one is big. */
+void cacheDrop(CacheRange *range, int fd, off_t pos) {
+	if (!cache.no_pollution || pos - range->dropped < CACHE_WINDOW) {
+		return;
+	}
+	posix_fadvise(fd, range->dropped, pos - range->dropped,
+			POSIX_FADV_DONTNEED);
+	range->dropped = pos;
+	return;
+}
+
+/* Drops whatever is left of a file that's done being read */
+void cacheDone(CacheRange *range, int fd) {
+	if (!cache.no_pollution) {
+		return;
+	}
+	posix_fadvise(fd, range->dropped, 0, POSIX_FADV_DONTNEED);
+	range->dropped = 0;
+	return;
+}
+
+/* Called after n more bytes are written to a file. Dirty pages can't
+ * be dropped, so every CACHE_WINDOW the new window is handed to
+ * writeback, and the window before it, which has had a whole window's
+ * worth of time to be written, is waited on and dropped. That keeps
+ * about two windows of the file in the page cache while the writes
+ * keep streaming. */
+void cacheWrote(CacheRange *range, int fd, size_t n) {
+	if (!cache.no_pollution) {
+		return;
+	}
+	range->written += n;
+	if (range->written - range->flushed < CACHE_WINDOW) {
+		return;
+	}
+	sync_file_range(fd, range->flushed, range->written - range->flushed,
+			SYNC_FILE_RANGE_WRITE);
+	if (range->flushed > range->dropped) {
+		sync_file_range(fd, range->dropped,
+				range->flushed - range->dropped,
+				SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(fd, range->dropped,
+				range->flushed - range->dropped,
+				POSIX_FADV_DONTNEED);
+		range->dropped = range->flushed;
+	}
+	range->flushed = range->written;
+	return;
+}
+
+/* Writes out and drops the rest of a file that's done being written.
+ * Without wait, writeback is only started and whatever is already
+ * clean is dropped, which is what extracted files get since waiting on
+ * every one would make extraction as slow as an fsync per file. */
+void cacheFinish(CacheRange *range, int fd, int wait) {
+	if (!cache.no_pollution) {
+		return;
+	}
+	sync_file_range(fd, range->dropped, 0, wait ?
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+			SYNC_FILE_RANGE_WAIT_AFTER : SYNC_FILE_RANGE_WRITE);
+	posix_fadvise(fd, range->dropped, 0, POSIX_FADV_DONTNEED);
+	return;
+}
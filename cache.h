@@ -0,0 +1,42 @@
+#ifndef CACHEH
+#define CACHEH
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* A file being read or written front to back whose pages are dropped
+ * from the page cache behind the reader or writer */
+typedef struct cacherange {
+	/* Bytes written so far, and how many of those have been handed to
+	 * writeback */
+	off_t written;
+	off_t flushed;
+	/* Bytes before this have been dropped */
+	off_t dropped;
+} CacheRange;
+
+/* Page cache hints for --readahead and --no-cache-pollution. Like
+ * stats there's a single instance, since source files and the archive
+ * are read and written from several modules. Each archive or volume
+ * keeps its own CacheRange in its VolumeSet. With neither option set
+ * every call costs one branch. */
+typedef struct cache {
+	/* Drop pages mytar is done with so it doesn't push everything
+	 * else out of the page cache */
+	int no_pollution;
+	/* Source files to ask to be read ahead of the one being archived */
+	int readahead;
+} Cache;
+
+extern Cache cache;
+
+void cacheInit(int, int);
+void cacheSource(int);
+void cacheWillNeed(char *);
+off_t cacheTell(int);
+void cacheDrop(CacheRange *, int, off_t);
+void cacheDone(CacheRange *, int);
+void cacheWrote(CacheRange *, int, size_t);
+void cacheFinish(CacheRange *, int, int);
+
+#endif
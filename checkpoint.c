@@ -0,0 +1,158 @@
+/* syncfs is Linux specific */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "checkpoint.h"
+#include "extract.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Sets up the checkpoint for the archive, or stripe, named archive.
+ * Its state file is the archive's name with CHECKPOINT_SUFFIX after
+ * it. interval is the seconds between saves. */
+void checkpointInit(Checkpoint *ckpt, const char *archive, char mode,
+		int enabled, double interval) {
+	size_t len = strlen(archive) + sizeof(CHECKPOINT_SUFFIX) + 
+		sizeof(CHECKPOINT_TEMP);
+
+	memset(ckpt, 0, sizeof(Checkpoint));
+	ckpt->enabled = enabled;
+	ckpt->mode = mode;
+	ckpt->interval = (uint64_t)(interval * NANOS_PER_SEC);
+	ckpt->last = statsNow();
+	ckpt->volume = 1;
+	ckpt->name = malloc(len);
+	ckpt->temp = malloc(len);
+	if (!ckpt->name || !ckpt->temp) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(ckpt->name, len, "%s%s", archive, CHECKPOINT_SUFFIX);
+	snprintf(ckpt->temp, len, "%s%s%s", archive, CHECKPOINT_SUFFIX,
+			CHECKPOINT_TEMP);
+	return;
+}
+
+/* Reads the state file for --resume, filling in where the run it's
+ * from got to and, when extracting, adding the directories it was
+ * still to restore to dirs. Returns 1 if there was one, or 0 if there
+ * wasn't, in which case there's nothing to resume and the run starts
+ * from the beginning. A state file that can't be used is fatal. */
+int checkpointLoad(Checkpoint *ckpt, char *prog, DirList *dirs) {
+	FILE *file = fopen(ckpt->name, "r");
+	char mode;
+	int volume;
+	long long offset;
+	size_t len = 0;
+	size_t num_dirs = 0;
+	size_t i;
+	DirMeta meta;
+	int ok;
+
+	if (!file) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+		perror(ckpt->name);
+		exit(EXIT_FAILURE);
+	}
+	ok = fscanf(file, CHECKPOINT_MAGIC " mode %c volume %d offset %lld ",
+			&mode, &volume, &offset) == 3 && mode == ckpt->mode &&
+		volume >= 1 && offset >= 0 && offset % BLOCK_SIZE == 0;
+	if (ok && mode == 'c') {
+		ok = fscanf(file, "path %zu", &len) == 1 && 
+			fgetc(file) == '\n' && len <= PATH_LIMIT + 1 &&
+			fread(ckpt->path, 1, len, file) == len;
+		ckpt->path[ok ? len : 0] = '\0';
+	}
+	if (ok && mode == 'x') {
+		ok = fscanf(file, "dirs %zu", &num_dirs) == 1 && 
+			fgetc(file) == '\n';
+		for (i = 0; ok && i < num_dirs; i++) {
+			ok = fread(meta.name, 1, sizeof(meta.name), file) == 
+				sizeof(meta.name) && fread(&meta.header, 1, 
+					BLOCK_SIZE, file) == BLOCK_SIZE;
+			meta.name[PATH_LIMIT] = '\0';
+			if (ok) {
+				deferDirectory(dirs, &meta.header, meta.name);
+			}
+		}
+	}
+	fclose(file);
+	if (!ok) {
+		fprintf(stderr, "%s: %s isn't a checkpoint this can resume "
+				"from\n", prog, ckpt->name);
+		exit(EXIT_FAILURE);
+	}
+	ckpt->volume = volume;
+	ckpt->offset = offset;
+	return 1;
+}
+
+/* Whether it's time to save another checkpoint */
+int checkpointDue(Checkpoint *ckpt) {
+	return ckpt->enabled && statsNow() - ckpt->last >= ckpt->interval;
+}
+
+/* Saves ckpt, whose volume, offset, and path have been filled in,
+ * along with the directories in dirs, if any, that are still to have
+ * their metadata restored. Everything written up to now is synced
+ * first with syncfs on fd's filesystem, which is the archive's when
+ * creating and the one being extracted to when extracting, so a
+ * checkpoint never counts a member that could still be lost. The state
+ * file is written in full under another name and renamed over the old
+ * one, so a crash leaves one or the other. */
+void checkpointSave(Checkpoint *ckpt, int fd, DirList *dirs) {
+	FILE *file;
+	size_t i;
+	int ok;
+
+	ckpt->last = statsNow();
+	if (syncfs(fd) == -1) {
+		perror("syncfs");
+		return;
+	}
+	file = fopen(ckpt->temp, "w");
+	if (!file) {
+		perror(ckpt->temp);
+		return;
+	}
+	fprintf(file, CHECKPOINT_MAGIC "\nmode %c\nvolume %d\noffset %lld\n",
+			ckpt->mode, ckpt->volume, (long long)ckpt->offset);
+	if (ckpt->mode == 'c') {
+		fprintf(file, "path %zu\n", strlen(ckpt->path));
+		fputs(ckpt->path, file);
+	}
+	if (dirs) {
+		fprintf(file, "dirs %zu\n", dirs->count);
+		for (i = 0; i < dirs->count; i++) {
+			fwrite(dirs->entries[i].name, 1, 
+					sizeof(dirs->entries[i].name), file);
+			fwrite(&dirs->entries[i].header, 1, BLOCK_SIZE, file);
+		}
+	}
+	ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+	if (fclose(file) != 0 || !ok || rename(ckpt->temp, ckpt->name) == -1) {
+		perror(ckpt->name);
+		unlink(ckpt->temp);
+	}
+	return;
+}
+
+/* Called once the run is done, which leaves nothing to resume */
+void checkpointFinish(Checkpoint *ckpt) {
+	if (ckpt->enabled && unlink(ckpt->name) == -1 && errno != ENOENT) {
+		perror(ckpt->name);
+	}
+	free(ckpt->name);
+	free(ckpt->temp);
+	ckpt->name = NULL;
+	ckpt->temp = NULL;
+	return;
+}
@@ -0,0 +1,45 @@
+#ifndef CHECKPOINTH
+#define CHECKPOINTH
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "mytar.h"
+
+/* The directories extraction has yet to restore, from extract.h */
+struct dirlist;
+
+/* How far c or x has got, saved every so often with --checkpoint so
+ * an interrupted run can be picked up with --resume instead of starting
+ * over. It's kept in a small state file next to the archive, or next
+ * to each stripe of it, which is replaced whole each time and removed
+ * once the run finishes. Only members that are done and synced to disk
+ * are counted, so a run picks up at the member after them. */
+typedef struct checkpoint {
+	/* Nothing is saved unless --checkpoint or --resume was given */
+	int enabled;
+	/* The state file, and the one it's written as before it takes its
+	 * place */
+	char *name;
+	char *temp;
+	/* 'c' or 'x', which a checkpoint can only be resumed with */
+	char mode;
+	/* Nanoseconds between saves, and when the last one was */
+	uint64_t interval;
+	uint64_t last;
+	/* Where the next member starts: the volume, counting from 1, and
+	 * the offset in it */
+	int volume;
+	off_t offset;
+	/* When creating, the last member archived, which the walk skips
+	 * everything up to */
+	char path[PATH_LIMIT + 2];
+} Checkpoint;
+
+void checkpointInit(Checkpoint *, const char *, char, int, double);
+int checkpointLoad(Checkpoint *, char *, struct dirlist *);
+int checkpointDue(Checkpoint *);
+void checkpointSave(Checkpoint *, int, struct dirlist *);
+void checkpointFinish(Checkpoint *);
+
+#endif
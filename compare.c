@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "compare.h"
+#include "header.h"
+#include "filter.h"
+#include "libmytar.h"
+#include "walk.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* What's printed for each DIFF_* bit, like GNU tar's --compare */
+static const char *diff_names[] = {
+	"File type differs",
+	"Mode differs",
+	"Uid differs",
+	"Gid differs",
+	"Mod time differs",
+	"Size differs",
+	"Symlink differs",
+	"Contents differ"
+};
+
+/* Reads the file at path and compares it with size bytes of data from
+ * the archive, a chunk at a time into buf. Returns 1 if they're the
+ * same. Sets job->error if the file couldn't be read. */
+int compareContents(const char *path, const unsigned char *data,
+		uint64_t size, char *buf, CompareJob *job) {
+	int fd;
+	ssize_t got;
+	uint64_t done = 0;
+	int same = 1;
+
+	fd = statsOpen(path, O_RDONLY, 0);
+	if (fd == -1) {
+		job->error = errno;
+		job->call = "open";
+		return 1;
+	}
+	while (done < size) {
+		got = statsRead(fd, buf, size - done < COMPARE_CHUNK ?
+				size - done : COMPARE_CHUNK);
+		if (got == -1) {
+			job->error = errno;
+			job->call = "read";
+			break;
+		}
+		/* The file got shorter since it was stat'd */
+		if (got == 0 || memcmp(buf, data + done, got) != 0) {
+			same = 0;
+			break;
+		}
+		done += got;
+	}
+	close(fd);
+	return same;
+}
+
+/* Compares one member with the path of the same name. The metadata is
+ * checked first and the contents are only read if the size, mtime,
+ * and mode all match, since any of those differing already means the
+ * file changed. */
+void compareMember(Walk *walk, CompareJob *job, char *buf) {
+	const char *name = walkName(walk, job->name);
+	const char *target;
+	char link[LINKNAME_SIZE + 1];
+	struct stat info;
+	ssize_t len;
+	int type_ok;
+
+	if (statsLstat(name, &info) == -1) {
+		job->error = errno;
+		job->call = "stat";
+		return;
+	}
+	if (job->type == REG_FLAG) {
+		type_ok = S_ISREG(info.st_mode);
+	}
+	else if (job->type == DIR_FLAG) {
+		type_ok = S_ISDIR(info.st_mode);
+	}
+	else if (job->type == SYM_FLAG) {
+		type_ok = S_ISLNK(info.st_mode);
+	}
+	else {
+		type_ok = 1;
+	}
+	if (!type_ok) {
+		job->diffs |= DIFF_TYPE;
+		return;
+	}
+
+	/* Symlinks always have mode 777 and their own times */
+	if (job->type == SYM_FLAG) {
+		len = statsReadlink(name, link, LINKNAME_SIZE);
+		if (len == -1) {
+			job->error = errno;
+			job->call = "readlink";
+			return;
+		}
+		target = walkName(walk, job->link);
+		if ((size_t)len != strlen(target) ||
+				memcmp(link, target, len) != 0) {
+			job->diffs |= DIFF_LINK;
+		}
+		return;
+	}
+	if ((info.st_mode & PERMS_MASK) != job->mode) {
+		job->diffs |= DIFF_MODE;
+	}
+	if (info.st_uid != job->uid) {
+		job->diffs |= DIFF_UID;
+	}
+	if (info.st_gid != job->gid) {
+		job->diffs |= DIFF_GID;
+	}
+	/* Directories get new mtimes whenever their entries change, so
+	 * like GNU tar only the mode and owner of one are compared */
+	if (job->type != REG_FLAG) {
+		return;
+	}
+	if (info.st_mtime != job->mtime) {
+		job->diffs |= DIFF_MTIME;
+	}
+	if ((uint64_t)info.st_size != job->size) {
+		job->diffs |= DIFF_SIZE;
+	}
+	if (job->diffs & (DIFF_MODE | DIFF_MTIME | DIFF_SIZE)) {
+		return;
+	}
+	if (job->data + (off_t)job->size > walk->map_size ||
+			!compareContents(name, walk->map + job->data,
+				job->size, buf, job)) {
+		job->diffs |= DIFF_CONTENTS;
+	}
+	return;
+}
+
+/* Thread that compares members until there are none left. The calls
+ * here aren't counted by --stats, whose counters belong to the main
+ * thread. */
+void *compareThread(void *arg) {
+	Walk *walk = arg;
+	CompareJob *job;
+	char *buf = malloc(COMPARE_CHUNK);
+
+	if (!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	while ((job = walkNextJob(walk)) != NULL) {
+		compareMember(walk, job, buf);
+	}
+	free(buf);
+	return NULL;
+}
+
+/* Adds a job for each member the walk comes to that the path
+ * arguments, in the filter arg, select. Ends the walk once every one
+ * of them has been found. */
+int compareEntry(Walk *walk, MtEntry *entry, void *arg) {
+	Filter *filter = arg;
+	CompareJob *job;
+
+	if (entry->name[0] == '\0') {
+		fprintf(stderr, "path too long\n");
+	}
+	else if (filterMatch(filter, entry->name, entry->type == DIR_FLAG,
+				1)) {
+		job = walkAddJob(walk);
+		job->name = walkAddName(walk, entry->name);
+		if (entry->type == SYM_FLAG) {
+			job->link = walkAddName(walk, entry->linkname);
+		}
+		job->type = entry->type;
+		job->mode = entry->mode;
+		job->uid = entry->uid;
+		job->gid = entry->gid;
+		job->mtime = entry->mtime;
+		job->data = entry->offset + BLOCK_SIZE;
+		job->size = entry->size;
+	}
+	return filterDone(filter);
+}
+
+/* Compares the members of an archive, or just the ones named by the
+ * path arguments, with the files they were made from. Like
+ * verifyArchive, the archive's headers are walked first, then a pool
+ * of threads does the comparing, so every file is read in parallel and
+ * each member's contents are read from the archive only once. The
+ * differences are printed in archive order. Returns the number of
+ * members that differ or couldn't be compared, counting damaged
+ * headers. */
+size_t compareArchive(int numPaths, char *paths[], Options *opts) {
+	int bit;
+	size_t differ;
+	size_t i;
+	const char *name;
+	Walk walk;
+	CompareJob *job;
+	Filter filter;
+
+	walkOpen(&walk, paths[0], paths[TAR_INDEX], sizeof(CompareJob));
+	compileFilter(&filter, numPaths, paths, opts);
+	differ = walkArchive(&walk, opts, compareEntry, &filter);
+	walkRun(&walk, opts, compareThread);
+
+	for (i = 0; i < walk.num_jobs; i++) {
+		job = walkJob(&walk, i);
+		name = walkName(&walk, job->name);
+		if (opts->verbose) {
+			printf("%s\n", name);
+		}
+		if (job->error) {
+			fprintf(stderr, "%s: Warning: Cannot %s: %s\n", name,
+					job->call, strerror(job->error));
+		}
+		for (bit = 0; bit < DIFF_KINDS; bit++) {
+			if (job->diffs & (1 << bit)) {
+				printf("%s: %s\n", name, diff_names[bit]);
+			}
+		}
+		if (job->error || job->diffs) {
+			differ += 1;
+		}
+	}
+	fflush(stdout);
+
+	freeFilter(&filter);
+	walkClose(&walk);
+	return differ;
+}
@@ -0,0 +1,53 @@
+#ifndef COMPAREH
+#define COMPAREH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "options.h"
+#include "filter.h"
+#include "libmytar.h"
+#include "walk.h"
+
+/* Ways a member can differ from what's on disk, in the order they're
+ * reported */
+#define DIFF_TYPE 0x01
+#define DIFF_MODE 0x02
+#define DIFF_UID 0x04
+#define DIFF_GID 0x08
+#define DIFF_MTIME 0x10
+#define DIFF_SIZE 0x20
+#define DIFF_LINK 0x40
+#define DIFF_CONTENTS 0x80
+#define DIFF_KINDS 8
+
+/* A member to compare against the path of the same name, with what
+ * its header says about it */
+typedef struct comparejob {
+	/* Where its name, and a symlink's target, are kept in the walk */
+	size_t name;
+	size_t link;
+	char type;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	time_t mtime;
+	off_t data;
+	uint64_t size;
+	/* DIFF_* bits that were found */
+	int diffs;
+	/* Set if the path couldn't be looked at */
+	int error;
+	/* What error was about, like "stat" or "open" */
+	const char *call;
+} CompareJob;
+
+int compareContents(const char *, const unsigned char *, uint64_t,
+		char *, CompareJob *);
+void compareMember(Walk *, CompareJob *, char *);
+void *compareThread(void *);
+int compareEntry(Walk *, MtEntry *, void *);
+size_t compareArchive(int, char *[], Options *);
+
+#endif
@@ -2,417 +2,771 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pwd.h>
-#include <grp.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "header.h"
 #include "utilities.h"
 #include "mytar.h"
+#include "options.h"
+#include "arena.h"
+#include "create.h"
+#include "stats.h"
+#include "progress.h"
+#include "hash.h"
+#include "order.h"
+#include "dirstream.h"
+#include "cache.h"
+#include "libmytar.h"
+#include "filter.h"
+#include "volume.h"
+#include "throttle.h"
 
-void writeFile(char *, int, int, int);
-void writeHeader(char *, int, int, int);
-
-/* Creates and sets the prefix in a header. Also sets the name. */
-void setPrefix(char *src, Header *header) {
-	/* If we're in this function, then the name is at least 101 
-	 * characters long. */
-	/* Get the length of the source file name */
-	size_t src_len = strlen(src);
-	/* This takes us 101 characters from the end */
-	int i = src_len - 101;
-	/* The remaining number of characters for the name field */
-	int remaining;
-
-	/* Keep incrementing i until it is the index of a 
-	 * '/' character */
-	while (src[i] != '/') {
-		i++;
-	}
-	/* i now represents the number of characters that need to be
-	 * copied over into the prefix field */
-
-	if (i > PREFIX_SIZE) {
-		fprintf(stderr, "path too long\n");
-		exit(EXIT_FAILURE);
-	}
-
-	/* The remaining number of characters is the length of the 
-	 * src - i subtracting one more because the '/' won't be
-	 * copied */
-	remaining = src_len - i - 1;
-	/* After this while loop, i will represent the index at where
-	 * the '/' character is */
-	memmove(header->prefix, src, i);
-	/* src +i + 1 means to start copying over at the character 
-	 * right after the '/' */
-	memmove(header->name, src + i + 1, remaining);
-	return;
-}
-
-/* Writes a directory along with any files/directories/links that may
- * be inside of it */
-void writeDirectory(char *src, int fdout, int strict, int verbose) {
+/* Writes a directory, named name relative to dirfd, along with any
+ * files/directories/links that may be inside of it. Its entries are
+ * read with getdents64 a batch at a time, and each batch is archived
+ * before the next is read. With a --read-order other than readdir's,
+ * the entries are collected first and archived in the order their
+ * data is laid out on disk, or with --keep-order archived in readdir
+ * order but read into the page cache in disk order a window at a
+ * time. */
+void writeDirectory(char *src, int dirfd, const char *name, 
+		Output *out, Options *opts, Arena *arena) {
 	size_t dir_len = 0;
-	DIR *dir;
-	struct dirent *entry;
+	DirStream stream;
+	RawDirent *entry;
+	long got;
 	char *path;
-	struct stat *entry_info = malloc(sizeof(struct stat) * 1);
-	if (!entry_info) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
-	}
-	/* A character array of 256 characters + 1 null terminating byte. 
-	 * This represents the path of files in the directory. */
-	path = calloc(PATH_LIMIT + 1, sizeof(char));
-	if (!path) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
+	/* Scratch memory for each entry is released back to here */
+	ArenaMark mark;
+	/* Entries waiting to be archived in disk order */
+	EntryList list;
+	size_t i;
+	size_t window_end = 0;
+	/* The next entry that hasn't been read ahead */
+	size_t ahead = 0;
+	int collect = opts->read_order != READ_READDIR || cache.readahead;
+	/* Every stripe walks the directory, but only one archives it and 
+	 * says what went wrong reading it */
+	int owned;
+	/* A character array of 256 characters + 1 null terminating byte, 
+	 * and room for the '/' after a directory. This represents the 
+	 * path of files in the directory. */
+	path = arenaAlloc(arena, PATH_LIMIT + 2);
 
 	/* First copy over the directory name */
 	strcpy(path, src);
+	dir_len = strlen(path);
 	/* If the directory doesn't already end with a '/',
 	 * then append it */
-	if (strstr(path, "/") == NULL) {
-		strcat(path, "/");
+	if (path[dir_len - 1] != '/') {
+		path[dir_len] = '/';
+		dir_len += 1;
+	}
+	/* When resuming, a directory that doesn't lead to where the
+	 * checkpoint left off was archived whole before */
+	if (out->skipping && 
+			strncmp(out->checkpoint.path, path, dir_len) != 0) {
+		return;
 	}
 
-	dir_len = strlen(path);
 	/* Write the directory header to the archive */
-	writeHeader(path, fdout, strict, verbose);
+	mark = arenaMark(arena);
+	owned = ownsPath(out, path);
+	if (owned && !archivedBefore(out, path)) {
+		writeHeader(path, dirfd, name, out, opts->verbose, arena);
+		arenaRelease(arena, mark);
+	}
 
 	/* Open the directory stream */
-	if ((dir = opendir(path)) == NULL) {
-		perror("opendir");
+	if (openDirStream(&stream, dirfd, name) == -1) {
+		if (owned) {
+			perror("opendir");
+		}
 		return;
 	}
-	/* Loop through every entry in the directory */
-	while ((entry = readdir(dir)) != NULL) {
-		/* error checking for readdir goes here */
-		/* Skip over current directory (.) and parent directory
-		 * (..) */
-		if ((strcmp(entry->d_name, ".") == 0) || 
-				(strcmp(entry->d_name, "..") == 0)) {
-			continue;
+	memset(&list, 0, sizeof(EntryList));
+	while ((got = readBatch(&stream)) > 0) {
+		/* Loop through every entry in the batch */
+		while ((entry = nextDirent(&stream)) != NULL) {
+			/* Check if the path would be too long */
+			if (dir_len + strlen(entry->d_name) > PATH_LIMIT) {
+				if (owned) {
+					fprintf(stderr, "Path is too long\n");
+				}
+				continue;
+			}
+			if (collect) {
+				addEntry(&list, entry->d_name, entry->d_ino, 
+						entry->d_type);
+				continue;
+			}
+			writeEntry(path, dir_len, stream.fd, entry->d_name, 
+					entry->d_type, out, opts, arena);
+			arenaRelease(arena, mark);
 		}
-		/* Check if the path would be too long */
-		if (strlen(path) + strlen(entry->d_name) > PATH_LIMIT) {
-			fprintf(stderr, "Path is too long\n");
-			continue;
+	}
+	if (got == -1 && owned) {
+		perror(path);
+	}
+
+	if (collect) {
+		keyEntries(&list, path, dir_len, opts->read_order, 
+				opts->keep_order);
+		if (opts->read_order != READ_READDIR && !opts->keep_order) {
+			sortEntries(&list);
 		}
-		/* Append the file */
-		strcat(path, entry->d_name);
-		if (lstat(path, entry_info) == -1) {
+		for (i = 0; i < list.num_entries; i++) {
+			if (opts->keep_order && i == window_end) {
+				window_end = prefetchEntries(&list, path, 
+						dir_len, i);
+			}
+			/* Keep the next few files being read in the 
+			 * background */
+			else if (!opts->keep_order && cache.readahead &&
+					ahead <= i + cache.readahead) {
+				ahead = adviseEntries(&list, path, dir_len, 
+						ahead > i ? ahead : i + 1,
+						i + 1 + cache.readahead);
+			}
+			writeEntry(path, dir_len, stream.fd,
+					list.names + list.entries[i].name, 
+					list.entries[i].type, out, opts, 
+					arena);
+			arenaRelease(arena, mark);
+		}
+		freeEntries(&list);
+	}
+	closeDirStream(&stream);
+	return;
+}
+
+/* Whether the member named src goes in out's stripe. Names are hashed
+ * so the stripes come out about the same size without any of them
+ * having to know what the others are doing. */
+int ownsPath(Output *out, const char *src) {
+	uint32_t hash = FNV_OFFSET;
+
+	if (out->stripes <= 1) {
+		return 1;
+	}
+	while (*src) {
+		hash = hashStep(hash, *src);
+		src++;
+	}
+	return hash % out->stripes == out->stripe;
+}
+
+/* Whether src was archived before the run being resumed was
+ * interrupted. Members are walked in the same order they were then,
+ * so that's every one up to and including the one the checkpoint
+ * names. */
+int archivedBefore(Output *out, const char *src) {
+	if (!out->skipping) {
+		return 0;
+	}
+	if (strcmp(src, out->checkpoint.path) == 0) {
+		out->skipping = 0;
+	}
+	return 1;
+}
+
+/* Called once src has been archived in full, which makes it somewhere
+ * a checkpoint can be saved */
+void memberDone(Output *out, const char *src) {
+	if (!checkpointDue(&out->checkpoint)) {
+		return;
+	}
+	out->checkpoint.volume = out->writer.volume_size > 0 ? 
+		out->writer.volume : 1;
+	out->checkpoint.offset = out->writer.offset;
+	strcpy(out->checkpoint.path, src);
+	checkpointSave(&out->checkpoint, out->writer.fd, NULL);
+	return;
+}
+
+/* Appends name to path, the directory it's in which is dir_len 
+ * characters long and open as dirfd, and writes whatever it is to the
+ * archive. type is what getdents said it is, so only entries it
+ * couldn't type need a stat to find out. The path is put back the way
+ * it was afterwards. */
+void writeEntry(char *path, size_t dir_len, int dirfd, const char *name,
+		unsigned char type, Output *out, Options *opts, 
+		Arena *arena) {
+	struct stat *entry_info;
+
+	/* Append the file */
+	strcpy(path + dir_len, name);
+	if (type == DT_UNKNOWN) {
+		entry_info = arenaAlloc(arena, sizeof(struct stat));
+		if (statsFstatat(dirfd, name, entry_info, 
+					AT_SYMLINK_NOFOLLOW) == -1) {
 			perror(path);
-			continue;
+			path[dir_len] = '\0';
+			return;
 		}
+		type = IFTODT(entry_info->st_mode);
+	}
+	/* Other stripes' entries are left to them, and so are ones that
+	 * were archived before resuming */
+	if (type != DT_DIR && (!ownsPath(out, path) || 
+				archivedBefore(out, path))) {
+		path[dir_len] = '\0';
+		return;
+	}
+	/* Check if the entry is a file */
+	if (type == DT_REG) {
+		/* If it is, write its header and data */
+		writeRegular(path, dirfd, name, out, opts, arena);
+	}
+	/* Check if the entry is a directory */
+	else if (type == DT_DIR) {
+		strcat(path, "/");
+		/* Need to recurse */
+		writeDirectory(path, dirfd, name, out, opts, arena);
+	}
+	/* Check if the entry is a sym link */
+	else if (type == DT_LNK) {
+		writeHeader(path, dirfd, name, out, opts->verbose, arena);
+	}
+	/* Cut the appended part back off for the next entry */
+	path[dir_len] = '\0';
+	return;
+}
 
-		/* Check if the entry is a file */
-		if (S_ISREG(entry_info->st_mode)) {
-			/* If it is, treat it as such and call writeFile */
-			/* Write the file's header */
-			writeHeader(path, fdout, strict, verbose);
-			/* Write the file's data */
-			writeFile(path, fdout, strict, verbose);
-			/* Clear only the appended part for the next entry */
-			memset(path + dir_len, 0, PATH_LIMIT + 1 - dir_len);
-			continue;
+/* Writes a regular file's header and data. With checksum set, a PAX
+ * header goes first holding the hash of the contents, which is worked
+ * out as writeFile reads them and filled in afterwards. It's only
+ * written once the header is known to fit, so it can't end up in front
+ * of some other member. */
+void writeRegular(char *src, int dirfd, const char *name, 
+		Output *out, Options *opts, Arena *arena) {
+	HashState hash;
+	off_t record = -1;
+	MtEntry *entry = statEntry(src, dirfd, name, opts->verbose, arena);
+	int status;
+
+	if (!entry) {
+		return;
+	}
+	/* It was replaced by something else since it was looked at */
+	if (entry->type != REG_FLAG) {
+		if (entry->type == SYM_FLAG && 
+				beginEntry(src, out, entry) == 0) {
+			mtWriterEnd(&out->writer);
+			memberDone(out, src);
 		}
-		/* Check if the entry is a directory */
-		else if (S_ISDIR(entry_info->st_mode)) {
-			strcat(path, "/");
-			/* Need to recurse */
-			writeDirectory(path, fdout, strict, verbose);
-			/* Clear only the appended part for the next entry */
-			memset(path + dir_len, 0, PATH_LIMIT + 1 - dir_len);
-			continue;
+		return;
+	}
+	if (opts->checksum) {
+		status = mtBuildHeader(&out->writer, entry);
+		if (status != MT_OK) {
+			fprintf(stderr, "%s: %s.  Skipping.\n", src, 
+					mtStrerror(status));
+			return;
 		}
-		/* Check if the entry is a sym link */
-		else if (S_ISLNK(entry_info->st_mode)) {
-			writeHeader(path, fdout, strict, verbose);
-			/* Clear only the appended part for the next entry */
-			memset(path + dir_len, 0, PATH_LIMIT + 1 - dir_len);
-			continue;
+		record = writeChecksumHeader(src, out, arena);
+		hashInit(&hash);
+	}
+	if (beginEntry(src, out, entry) == -1) {
+		/* The PAX header already written would go with whatever
+		 * member came next */
+		if (record != -1) {
+			exit(EXIT_FAILURE);
 		}
+		return;
+	}
+	writeFile(src, dirfd, name, out, record == -1 ? NULL : &hash, 
+			arena);
+	if (record != -1) {
+		fillChecksum(out->volumes.record_fd, record, 
+				hashDigest(&hash));
+		/* The volume was kept open for this after it filled up */
+		if (out->volumes.record_fd != out->writer.fd) {
+			close(out->volumes.record_fd);
+		}
+		out->volumes.record_fd = -1;
+	}
+	memberDone(out, src);
+	return;
+}
+
+/* Writes a PAX header for src and a record block for its checksum,
+ * with the digits left as zeros. Returns where the record is so
+ * fillChecksum can fill it in, exiting if it couldn't be written. The
+ * volume it's in is left in out->volumes.record_fd. */
+off_t writeChecksumHeader(char *src, Output *out, Arena *arena) {
+	MtEntry *pax = arenaAlloc(arena, sizeof(MtEntry));
+	char *data = arenaAlloc(arena, BLOCK_SIZE);
+	char *base = strrchr(src, '/');
+	off_t record;
 
+	base = base ? base + 1 : src;
+	strcpy(pax->name, PAX_DIR);
+	strncat(pax->name, base, NAME_SIZE - sizeof(PAX_DIR));
+	pax->mode = PAX_MODE;
+	pax->type = PAX_FLAG;
+	pax->size = CHECKSUM_RECORD_LEN;
+
+	sprintf(data, "%d %s=%0*d\n", CHECKSUM_RECORD_LEN, CHECKSUM_KEY,
+			CHECKSUM_DIGITS, 0);
+	if (mtWriterBegin(&out->writer, pax) != MT_OK ||
+			mtWriterWrite(&out->writer, data, CHECKSUM_RECORD_LEN) != 
+			MT_OK || mtWriterEnd(&out->writer) != MT_OK) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+	/* The record is the block just written, which in a split archive
+	 * may be in a volume that fills up before the contents are done */
+	record = out->writer.offset - BLOCK_SIZE;
+	out->volumes.record_fd = out->writer.fd;
+	progressAdd(2 * BLOCK_SIZE, 0);
+	outputWrote(out);
+	return record;
+}
+
+/* Fills in the checksum record written by writeChecksumHeader. That
+ * needs an archive that can be written out of order, which
+ * createArchive makes sure of. */
+void fillChecksum(int fdout, off_t record, uint64_t hash) {
+	char line[CHECKSUM_RECORD_LEN + 1];
+
+	sprintf(line, "%d %s=%0*llx\n", CHECKSUM_RECORD_LEN, CHECKSUM_KEY,
+			CHECKSUM_DIGITS, (unsigned long long)hash);
+	if (pwrite(fdout, line, CHECKSUM_RECORD_LEN, record) != 
+			CHECKSUM_RECORD_LEN) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+	return;
+}
+
+/* Adds the len bytes of zeros mtWriterEnd pads a short member with to
+ * hash, so its checksum matches what's in the archive */
+void hashPadding(HashState *hash, uint64_t len) {
+	char zeros[BLOCK_SIZE];
+
+	memset(zeros, 0, sizeof(zeros));
+	while (len > 0) {
+		hashUpdate(hash, zeros, len < BLOCK_SIZE ? len : BLOCK_SIZE);
+		len -= len < BLOCK_SIZE ? len : BLOCK_SIZE;
 	}
-	closedir(dir);
-	free(entry_info);
-	free(path);
 	return;
 }
 
-/* Writes the data of a regular file to an archive */
-void writeFile(char *src, int fdout, int strict, int verbose) {
+/* Writes the data of a regular file whose header was just written,
+ * adding it to hash as it goes unless hash is NULL. If the file
+ * doesn't have as much data as its header says, say because it
+ * changed while it was read, the writer makes up the difference so
+ * the archive stays readable. */
+void writeFile(char *src, int dirfd, const char *name, Output *out,
+		HashState *hash, Arena *arena) {
 	int fdin;
 	int status = 0;
-	/* Initialize a completely empty buffer to be read into */
-	char *data = calloc(BLOCK_SIZE, sizeof(char));
-	if (!data) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
-	fdin = open(src, O_RDONLY);
+	/* What fits of the data read, since the file may have grown */
+	size_t len;
+	/* A buffer to be read into */
+	char *data;
+	/* The size of data, a chunk at a time of big files and just
+	 * enough for small ones */
+	size_t chunk = out->writer.left < FILE_CHUNK ? 
+		(out->writer.left + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE :
+		FILE_CHUNK;
+	/* How far the file's been read, for dropping it from the page 
+	 * cache as it goes */
+	off_t pos = 0;
+	CacheRange range = {0, 0, 0};
+	int grew = 0;
+
+	/* A file that was empty still has to be read, in case it grew */
+	chunk = chunk > 0 ? chunk : BLOCK_SIZE;
+	data = arenaAlloc(arena, chunk);
+	fdin = statsOpenat(dirfd, name, O_RDONLY, 0);
 	if (fdin == -1) {
 		perror("open");
+		if (hash) {
+			hashPadding(hash, out->writer.left);
+		}
+		mtWriterEnd(&out->writer);
 		return;
 	}
+	cacheSource(fdin);
 	
-	/* Keep reading the source file, 512 bytes at a time, until
+	/* Keep reading the source file, a chunk at a time, until
 	 * end of file is returned (0) */
-	while ((status = read(fdin, data, BLOCK_SIZE)) != 0) {
+	while ((status = statsRead(fdin, data, chunk)) != 0) {
 		if (status == -1) {
 			perror(src);
 			exit(EXIT_FAILURE);
 		}
-		if (write(fdout, data, BLOCK_SIZE) == -1) {
-			fprintf(stderr, "can't write to archive\n");
-			return;
+		throttleRead(&out->read_debt, status);
+		len = (uint64_t)status < out->writer.left ? status : 
+			out->writer.left;
+		if (mtWriterWrite(&out->writer, data, len) != MT_OK) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		if (hash) {
+			hashUpdate(hash, data, len);
 		}
-		/* This ensures that the entire block is emptied before
-		 * the next read. Otherwise, if a read of less than 512 
-		 * bytes occurs, write might write junk data. */
-		memset(data, 0, BLOCK_SIZE);
+		progressAdd((len + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE,
+				0);
+		outputWrote(out);
+		if (len < status) {
+			grew = 1;
+			break;
+		}
+		pos += status;
+		cacheDrop(&range, fdin, pos);
+	}
+	if (hash) {
+		hashPadding(hash, out->writer.left);
+	}
+	if (grew) {
+		fprintf(stderr, "%s: file changed as we read it\n", src);
+		mtWriterEnd(&out->writer);
 	}
-	free(data);
+	else if (mtWriterEnd(&out->writer) == MT_ERR_SIZE) {
+		fprintf(stderr, "%s: file changed as we read it\n", src);
+	}
+	cacheDone(&range, fdin);
 	close(fdin);
 	return;
 }
 
-/* Given a file/symlink/directory, this function will write a
- * header to the archive, printing out the names as they are 
- * added if verbose is set. */
-void writeHeader(char *src, int fdout, int strict, int verbose) {
-	Header *header;
+/* Looks up everything a member's header needs about src, which is
+ * name relative to dirfd, printing out its name as it's added if
+ * verbose is set. Returns NULL if it can't be archived. */
+MtEntry *statEntry(char *src, int dirfd, const char *name, int verbose,
+		Arena *arena) {
+	MtEntry *entry;
 	struct stat *src_info;
-	struct passwd *pswrd;
-	struct group *grp;
 	
 	/* Print file name if verbose is set */
 	if (verbose) {
 		printf("%s\n", src);
 	}
 
-	src_info = malloc(sizeof(struct stat) * 1);
-	if (!src_info) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
-	}
+	src_info = arenaAlloc(arena, sizeof(struct stat));
 	/* Stat the source file */
-	if (lstat(src, src_info) == -1) {
+	if (statsFstatat(dirfd, name, src_info, AT_SYMLINK_NOFOLLOW) == -1) {
 		perror("lstat");
-		return;
+		return NULL;
 	}
-	
-	header = calloc(1, sizeof(Header));
-	if (!header) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
+	entry = arenaAlloc(arena, sizeof(MtEntry));
+	if (mtEntryFromStatat(entry, src, dirfd, name, src_info) != MT_OK) {
+		perror(src);
+		return NULL;
 	}
+	return entry;
+}
 
-	/* Write the name of the source file to the header if it's below
-	 * 100 characters */
-	if (strlen(src) <= NAME_SIZE) {
-		strcpy(header->name, src);
-	}
-	/* Otherwise the name is too long so need to create a prefix */
-	else {
-		setPrefix(src, header);	
+/* Writes entry's header to the archive, saying why src is being
+ * skipped if it can't be. Returns 0, or -1 if it was skipped. */
+int beginEntry(char *src, Output *out, MtEntry *entry) {
+	int status = mtWriterBegin(&out->writer, entry);
+
+	if (status == MT_ERR_IO) {
+		perror("write");
+		return -1;
 	}
-	
-	/* Set the mode. AND the mode with 07777 octal because only 
-	 * want to extract the permissions part of the mode */
-	sprintf(header->mode, "%07o", src_info->st_mode & PERMS_MASK);
-	
-	/* Set the uid */
-	/* First check if the uid exceeds the max uid size allowed by 
-	 * 7 octal digits */
-	if (src_info->st_uid < MAX_UID_SIZE) {
-		sprintf(header->uid, "%07o", src_info->st_uid);
+	if (status != MT_OK) {
+		fprintf(stderr, "%s: %s.  Skipping.\n", src, 
+				mtStrerror(status));
+		return -1;
 	}
-	/* uid too big */
-	else {
-		/* Check if in strict mode */
-		if (strict) {
-			fprintf(stderr, 
-					"%s: uid too big.  Skipping.\n",
-					src);
-			return;
-		}
-		insert_special_int(header->uid, UID_SIZE, src_info->st_uid);
+	outputWrote(out);
+	statsEntry(entry->type == REG_FLAG ? entry->size : 0);
+	progressAdd(BLOCK_SIZE, 1);
+	return 0;
+}
+
+/* Given a directory or symlink, this function will write its header
+ * to the archive, which is all there is of it. */
+void writeHeader(char *src, int dirfd, const char *name, 
+		Output *out, int verbose, Arena *arena) {
+	MtEntry *entry = statEntry(src, dirfd, name, verbose, arena);
+
+	if (entry && beginEntry(src, out, entry) == 0) {
+		mtWriterEnd(&out->writer);
+		memberDone(out, src);
 	}
-	/* Set the gid */
-	if (src_info->st_gid < MAX_GID_SIZE) {
-		sprintf(header->gid, "%07o", src_info->st_gid);
+	return;
+}
+
+/* Adds up the entries under src and the archive bytes they'll take, a
+ * header block each plus the blocks of any data and, with checksum
+ * set, a PAX header, walking it the same way writeDirectory does so
+ * --progress knows the totals. */
+void scanTree(char *src, int checksum, uint64_t *bytes, 
+		uint64_t *entries) {
+	struct stat info;
+	DIR *dir;
+	struct dirent *entry;
+	char path[PATH_LIMIT + 2];
+	size_t len;
+
+	if (statsLstat(src, &info) == -1) {
+		return;
 	}
-	/* gid too big */
-	else {
-		/* Check if in strict mode */
-		if (strict) {
-			fprintf(stderr, 
-					"%s: gid too big.  Skipping.\n",
-					src);
-			return;
-		}
-		insert_special_int(header->gid, GID_SIZE, src_info->st_gid);
-	}	
-
-	/* Set the size */
-	/* Check the file type */
-	/* File type is regular */
-	if (S_ISREG(src_info->st_mode)) {
-		/* Size too big */
-		if (src_info->st_size > MAX_SIZE_SIZE) {
-			if (strict) {
-				fprintf(stderr, 
-						"%s: size too big.   "
-						"Skipping.\n",
-						src);
-				return;
-			}
-			insert_special_int(header->size, SIZE_SIZE, 
-					src_info->st_size);
+	*entries += 1;
+	*bytes += BLOCK_SIZE;
+	if (S_ISREG(info.st_mode)) {
+		*bytes += (info.st_size + BLOCK_SIZE - 1) / BLOCK_SIZE * 
+			BLOCK_SIZE;
+		if (checksum) {
+			*bytes += 2 * BLOCK_SIZE;
 		}
-		else {
-			sprintf(header->size, "%011o", (int)src_info->st_size);
-		}
-		*(header->typeflag) = REG_FLAG; 
-	}
-	/* File type is directory */
-	else if (S_ISDIR(src_info->st_mode)) {
-		sprintf(header->size, "%011o", 0);
-		*(header->typeflag) = DIR_FLAG;
+		return;
 	}
-	/* File type is symbolic link */
-	else if (S_ISLNK(src_info->st_mode)) {
-		sprintf(header->size, "%011o", 0);
-		*(header->typeflag) = SYM_FLAG;
+	if (!S_ISDIR(info.st_mode) || (dir = opendir(src)) == NULL) {
+		return;
 	}
-
-	/* Set the mtime */
-	if (src_info->st_mtime < MAX_MTIME_SIZE) {
-		sprintf(header->mtime, "%011o", (int)src_info->st_mtime);
+	strcpy(path, src);
+	len = strlen(path);
+	if (path[len - 1] != '/') {
+		path[len] = '/';
+		len += 1;
 	}
-	/* mtime too big */
-	else {
-		if (strict) {
-			fprintf(stderr, 
-					"%s: size too big.  Skipping.\n",
-					src);
-			return;
+	while ((entry = readdir(dir)) != NULL) {
+		if ((strcmp(entry->d_name, ".") == 0) || 
+				(strcmp(entry->d_name, "..") == 0)) {
+			continue;
 		}
-		insert_special_int(header->mtime, MTIME_SIZE, 
-				src_info->st_mtime);
-	}
-	/* Set the link name (if file is a symlink) */
-	if (S_ISLNK(src_info->st_mode)) {
-		if (readlink(src, header->linkname, LINKNAME_SIZE) == -1) {
-			perror(src);
-			return;
+		if (len + strlen(entry->d_name) > PATH_LIMIT) {
+			continue;
 		}
+		strcpy(path + len, entry->d_name);
+		scanTree(path, checksum, bytes, entries);
 	}
+	closedir(dir);
+	return;
+}
 
-	/* Set the magic number */
-	strcpy(header->magic, MAGIC_NUM);
-	
-	/* Set the version number */
-	strcpy(header->version, VERSION_NUM);
-
-	/* Initialize password struct to get the user name */
-	pswrd = getpwuid(src_info->st_uid);
-	strcpy(header->uname, pswrd->pw_name);
-
-	/* Initialize group struct to get the group name */
-	grp = getgrgid(src_info->st_gid);
-	strcpy(header->gname, grp->gr_name);
-
-	/* Major and minor device numbers aren't relevant for
-	 * this assignment. The header fields for these are 
-	 * already zero since we calloc'd. */
-
-	/* Set the checksum */
-	setChksum(header);
-
-	/* Write the header */
-	if (write(fdout, header, BLOCK_SIZE) == -1) {
-		perror("write");
-		return;
+/* Tells the page cache bookkeeping and the write limits how far into
+ * the current volume the archive has been written */
+void outputWrote(Output *out) {
+	cacheWrote(&out->volumes.cache, out->writer.fd, 
+			out->writer.offset - out->volumes.cache.written);
+	if (out->writer.volume != out->paid_volume) {
+		out->paid_volume = out->writer.volume;
+		out->paid_offset = 0;
+	}
+	if (out->writer.offset > out->paid_offset) {
+		throttleWrite(&out->write_debt, 
+				out->writer.offset - out->paid_offset);
+		out->paid_offset = out->writer.offset;
 	}
-	
-	free(src_info);
-	free(header);
 	return;
 }
 
-/* Creates an archive with files specified by the user. If one of the 
- * paths given is a directory, all the directories contents will also
- * be added. */
-void createArchive(int numPaths, char *paths[], int strict, int verbose) {
+/* Writes the paths given by the user to out, which is the whole
+ * archive or one stripe of it, and ends it. Runs on its own thread
+ * for each stripe. */
+void *writeStripe(void *arg) {
+	Output *out = arg;
+	Options *opts = out->opts;
 	int i;
-	char *data;	
 	struct stat *src_info;
-	int fdout;
-	fdout = open(paths[TAR_INDEX], 
-			O_WRONLY | O_CREAT | O_TRUNC, 
-			S_IRUSR | S_IWUSR);
-	if (fdout == -1) {
-		perror(paths[TAR_INDEX]);
-	}
-	src_info = malloc(sizeof(struct stat) * 1);
-	if (!src_info) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
-	}
+	ArenaMark mark;
 
-	for (i = ARG_START; i < numPaths; i++) {
+	src_info = arenaAlloc(&out->arena, sizeof(struct stat));
+	mark = arenaMark(&out->arena);
+	for (i = ARG_START; i < out->num_paths; i++) {
 		/* Check if path is too long */
-		if (strlen(paths[i]) > PATH_LIMIT) {
-			fprintf(stderr, "%s: path too long\n", paths[i]);
+		if (strlen(out->paths[i]) > PATH_LIMIT) {
+			if (out->stripe == 0) {
+				fprintf(stderr, "%s: path too long\n", 
+						out->paths[i]);
+			}
 			continue;
 		}
 
 		/* Use lstat so we can see if dealing with a directory 
 		 * OR the file doesn't exist */
-		if (lstat(paths[i], src_info) == -1) {
-			perror(paths[i]);
+		if (statsLstat(out->paths[i], src_info) == -1) {
+			if (out->stripe == 0) {
+				perror(out->paths[i]);
+			}
 			continue;
 		}	
 
-		/* File to be archived is a regular file */
-		if (S_ISREG(src_info->st_mode)) {
-			writeHeader(paths[i], fdout, strict, verbose);
-			writeFile(paths[i], fdout, strict, verbose);
+		/* File to be archived is a directory, which every
+		 * stripe walks */
+		if (S_ISDIR(src_info->st_mode)) {
+			writeDirectory(out->paths[i], AT_FDCWD, out->paths[i],
+					out, opts, &out->arena);
 		}
-		/* File to be archived is a directory */
-		else if (S_ISDIR(src_info->st_mode)) {
-			writeDirectory(paths[i], fdout, strict, verbose);
+		else if (!ownsPath(out, out->paths[i]) || 
+				archivedBefore(out, out->paths[i])) {
+			continue;
+		}
+		/* File to be archived is a regular file */
+		else if (S_ISREG(src_info->st_mode)) {
+			writeRegular(out->paths[i], AT_FDCWD, out->paths[i],
+					out, opts, &out->arena);
 		}
 		/* File to be archived is a symlink */
 		else if (S_ISLNK(src_info->st_mode)) {
-			writeHeader(paths[i], fdout, strict, verbose);
+			writeHeader(out->paths[i], AT_FDCWD, out->paths[i],
+					out, opts->verbose, &out->arena);
 		}
+		arenaRelease(&out->arena, mark);
 	}
 	
-	data = calloc(BLOCK_SIZE, sizeof(char));
-
-	/* Write the End of Archive marker which is two blocks of 
-	 * zero bytes. */
-	if (write(fdout, data, BLOCK_SIZE) == -1) {
+	if (out->skipping) {
+		fprintf(stderr, "%s: %s, where the checkpoint left off, "
+				"wasn't found, so nothing was added\n", 
+				out->paths[0], out->checkpoint.path);
+	}
+	/* Write the End of Archive marker */
+	if (mtWriterClose(&out->writer) != MT_OK) {
 		perror("write");
 		exit(EXIT_FAILURE);
 	}
-	if (write(fdout, data, BLOCK_SIZE) == -1) {
-		perror("write");
+	outputWrote(out);
+	cacheFinish(&out->volumes.cache, out->writer.fd, 1);
+	close(out->writer.fd);
+	return NULL;
+}
+
+/* Creates an archive with files specified by the user. If one of the 
+ * paths given is a directory, all the directories contents will also
+ * be added. With --volume-size the archive is split into volumes as
+ * it's written, and with --stripes each stripe is a whole archive of
+ * its own written by its own thread. With --resume an archive, or each
+ * stripe, that has a checkpoint is cut back to it and carried on. */
+void createArchive(int numPaths, char *paths[], Options *opts) {
+	int i;
+	int status;
+	int num_outputs = opts->stripes > 1 ? opts->stripes : 1;
+	int fdout;
+	char *name;
+	/* Picking up from a checkpoint */
+	int resumed;
+	Output *outs;
+	pthread_t *threads;
+	/* Totals for --progress */
+	uint64_t total_bytes = 0;
+	uint64_t total_entries = 0;
+
+	outs = calloc(num_outputs, sizeof(Output));
+	threads = calloc(num_outputs, sizeof(pthread_t));
+	if (!outs || !threads) {
+		perror("calloc");
 		exit(EXIT_FAILURE);
 	}
+	for (i = 0; i < num_outputs; i++) {
+		name = volumeName(paths[TAR_INDEX], i + 1);
+		checkpointInit(&outs[i].checkpoint, name, 'c', 
+				opts->checkpoint, opts->checkpoint_interval);
+		free(name);
+		resumed = opts->resume && 
+			checkpointLoad(&outs[i].checkpoint, paths[0], NULL);
+		/* A resumed archive is cut back to the checkpoint in 
+		 * whichever volume it got to */
+		name = volumeName(paths[TAR_INDEX], num_outputs > 1 ? i + 1 :
+				outs[i].checkpoint.volume);
+		fdout = statsOpen(name, resumed ? O_WRONLY : 
+				O_WRONLY | O_CREAT | O_TRUNC, 
+				S_IRUSR | S_IWUSR);
+		if (fdout == -1) {
+			perror(name);
+			exit(EXIT_FAILURE);
+		}
+		/* The checksums are filled in behind the contents */
+		if (opts->checksum && lseek(fdout, 0, SEEK_CUR) == -1) {
+			fprintf(stderr, "%s: %s: --checksum needs an archive "
+					"that can be seeked in, not a pipe\n",
+					paths[0], name);
+			exit(EXIT_FAILURE);
+		}
+		free(name);
+		mtWriterInit(&outs[i].writer, fdout, 
+				opts->strict ? MT_STRICT : 0);
+		volumeInit(&outs[i].volumes, paths[TAR_INDEX]);
+		if (opts->volume_size > 0 && 
+				(status = mtWriterSplit(&outs[i].writer, 
+					opts->volume_size, writeVolume,
+					&outs[i].volumes)) != MT_OK) {
+			fprintf(stderr, "%s: %s\n", paths[0], 
+					mtStrerror(status));
+			exit(EXIT_FAILURE);
+		}
+		if (resumed) {
+			status = mtWriterResume(&outs[i].writer, 
+					outs[i].checkpoint.volume, 
+					outs[i].checkpoint.offset);
+			if (status != MT_OK) {
+				fprintf(stderr, "%s: can't resume: %s\n", 
+						paths[0], mtStrerror(status));
+				exit(EXIT_FAILURE);
+			}
+			outs[i].skipping = 1;
+			outs[i].volumes.cache.written = 
+				outs[i].checkpoint.offset;
+			outs[i].volumes.cache.flushed = 
+				outs[i].checkpoint.offset;
+			outs[i].volumes.cache.dropped = 
+				outs[i].checkpoint.offset;
+		}
+		outs[i].paid_volume = outs[i].writer.volume;
+		outs[i].paid_offset = outs[i].writer.offset;
+		outs[i].stripe = i;
+		outs[i].stripes = num_outputs;
+		outs[i].num_paths = numPaths;
+		outs[i].paths = paths;
+		outs[i].opts = opts;
+		arenaInit(&outs[i].arena, ARENA_CHUNK);
+	}
+
+	if (opts->progress) {
+		for (i = ARG_START; i < numPaths; i++) {
+			if (strlen(paths[i]) <= PATH_LIMIT) {
+				scanTree(paths[i], opts->checksum, 
+						&total_bytes, 
+						&total_entries);
+			}
+		}
+		progressStart(paths[0], opts->progress_interval, 
+				total_bytes, total_entries);
+		for (i = 0; i < num_outputs; i++) {
+			if (outs[i].skipping) {
+				progressAdd(volumeOffset(paths[TAR_INDEX],
+						outs[i].checkpoint.volume,
+						outs[i].checkpoint.offset), 0);
+			}
+		}
+	}
 
-	free(data);
-	free(src_info);
-	close(fdout);
+	if (num_outputs == 1) {
+		writeStripe(&outs[0]);
+	}
+	else {
+		for (i = 0; i < num_outputs; i++) {
+			if (pthread_create(&threads[i], NULL, writeStripe,
+						&outs[i]) != 0) {
+				fprintf(stderr, "can't start stripe thread\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		for (i = 0; i < num_outputs; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	progressStop();
+	for (i = 0; i < num_outputs; i++) {
+		checkpointFinish(&outs[i].checkpoint);
+		if (opts->alloc_stats) {
+			arenaReport(&outs[i].arena, paths[0]);
+		}
+		arenaFree(&outs[i].arena);
+	}
+	free(outs);
+	free(threads);
 	return;
 }
-
@@ -1,12 +1,67 @@
 #ifndef CREATEH
 #define CREATEH
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #include "header.h"
+#include "options.h"
+#include "arena.h"
+#include "hash.h"
+#include "libmytar.h"
+#include "volume.h"
+#include "checkpoint.h"
+#include "throttle.h"
+
+/* Where members are written: the whole archive, or one stripe of a
+ * striped one */
+typedef struct output {
+	MtWriter writer;
+	/* The volumes the archive or stripe is split into, which is just
+	 * the one unless it's split with --volume-size */
+	VolumeSet volumes;
+	/* Which stripe this is, of how many */
+	int stripe;
+	int stripes;
+	/* What to write, for the stripe's thread */
+	int num_paths;
+	char **paths;
+	Options *opts;
+	/* Scratch memory for every member */
+	Arena arena;
+	/* How far it's got, for --resume */
+	Checkpoint checkpoint;
+	/* Resuming and still walking the members archived before, up to
+	 * the one in checkpoint.path */
+	int skipping;
+	/* I/O not yet paid for under --read-limit and friends, and how
+	 * far into which volume the archive's writes have been counted */
+	Debt read_debt;
+	Debt write_debt;
+	int paid_volume;
+	off_t paid_offset;
+} Output;
 
-void setPrefix(char *, Header *);
-void writeDirectory(char *, int, int, int);
-void writeFile(char *, int, int, int);
-void writeHeader(char *, int, int, int);
-void createArchive(int, char *[], int, int);
+void writeDirectory(char *, int, const char *, Output *, Options *, 
+		Arena *);
+void writeEntry(char *, size_t, int, const char *, unsigned char, 
+		Output *, Options *, Arena *);
+void writeRegular(char *, int, const char *, Output *, Options *, 
+		Arena *);
+off_t writeChecksumHeader(char *, Output *, Arena *);
+void fillChecksum(int, off_t, uint64_t);
+void hashPadding(HashState *, uint64_t);
+void writeFile(char *, int, const char *, Output *, HashState *, 
+		Arena *);
+MtEntry *statEntry(char *, int, const char *, int, Arena *);
+int beginEntry(char *, Output *, MtEntry *);
+void writeHeader(char *, int, const char *, Output *, int, Arena *);
+int ownsPath(Output *, const char *);
+int archivedBefore(Output *, const char *);
+void memberDone(Output *, const char *);
+void scanTree(char *, int, uint64_t *, uint64_t *);
+void outputWrote(Output *);
+void *writeStripe(void *);
+void createArchive(int, char *[], Options *);
 
 #endif
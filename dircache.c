@@ -0,0 +1,279 @@
+/* O_PATH is Linux specific */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "dircache.h"
+#include "filter.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Mode of directories created only because something is inside them,
+ * which the umask is applied to like mkdir -p */
+#define PARENT_MODE (S_IRWXU | S_IRWXG | S_IRWXO)
+
+void dirCacheInit(DirCache *cache) {
+	memset(cache, 0, sizeof(DirCache));
+	cache->root = -1;
+	cache->head = -1;
+	cache->tail = -1;
+	return;
+}
+
+/* Closes every descriptor the cache has open */
+void dirCacheFree(DirCache *cache) {
+	long i;
+
+	for (i = cache->head; i != -1; i = cache->dirs[i].next) {
+		close(cache->dirs[i].fd);
+	}
+	if (cache->root != -1) {
+		close(cache->root);
+	}
+	free(cache->dirs);
+	free(cache->slots);
+	free(cache->names);
+	dirCacheInit(cache);
+	return;
+}
+
+/* Looks up the first len characters of path */
+CachedDir *findDir(DirCache *cache, const char *path, size_t len,
+		uint32_t hash) {
+	size_t i;
+	CachedDir *dir;
+
+	if (!cache->slots) {
+		return NULL;
+	}
+	for (i = hash & cache->mask; cache->slots[i]; 
+			i = (i + 1) & cache->mask) {
+		dir = &cache->dirs[cache->slots[i] - 1];
+		if (dir->hash == hash && dir->len == len &&
+				memcmp(cache->names + dir->name, path, len) == 0) {
+			return dir;
+		}
+	}
+	return NULL;
+}
+
+/* Adds the first len characters of path, which isn't there yet, with
+ * no descriptor. The hash set doubles whenever it would be more than
+ * half full. Pointers to other dirs don't survive this. */
+CachedDir *insertDir(DirCache *cache, const char *path, size_t len,
+		uint32_t hash) {
+	CachedDir *dir;
+	size_t cap = cache->slots ? cache->mask + 1 : 0;
+	size_t i;
+	size_t j;
+
+	if (cache->num_dirs == cache->cap_dirs) {
+		cache->cap_dirs = cache->cap_dirs ? cache->cap_dirs * 2 :
+			DIRCACHE_START;
+		cache->dirs = realloc(cache->dirs, 
+				sizeof(CachedDir) * cache->cap_dirs);
+		if (!cache->dirs) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	while (cache->names_len + len > cache->names_cap) {
+		cache->names_cap = cache->names_cap ? cache->names_cap * 2 :
+			DIRCACHE_START * NAME_START;
+		cache->names = realloc(cache->names, cache->names_cap);
+		if (!cache->names) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (2 * (cache->num_dirs + 1) > cap) {
+		cap = cap ? cap * 2 : 2 * DIRCACHE_START;
+		free(cache->slots);
+		cache->slots = calloc(cap, sizeof(size_t));
+		if (!cache->slots) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		cache->mask = cap - 1;
+		for (j = 0; j < cache->num_dirs; j++) {
+			for (i = cache->dirs[j].hash & cache->mask; 
+					cache->slots[i]; 
+					i = (i + 1) & cache->mask) {
+				;
+			}
+			cache->slots[i] = j + 1;
+		}
+	}
+
+	dir = &cache->dirs[cache->num_dirs];
+	dir->name = cache->names_len;
+	dir->len = len;
+	dir->hash = hash;
+	dir->fd = -1;
+	memcpy(cache->names + cache->names_len, path, len);
+	cache->names_len += len;
+	for (i = hash & cache->mask; cache->slots[i]; 
+			i = (i + 1) & cache->mask) {
+		;
+	}
+	cache->num_dirs += 1;
+	cache->slots[i] = cache->num_dirs;
+	return dir;
+}
+
+/* Takes dir out of the list of dirs with open descriptors */
+void unlinkDir(DirCache *cache, CachedDir *dir) {
+	if (dir->prev != -1) {
+		cache->dirs[dir->prev].next = dir->next;
+	}
+	else {
+		cache->head = dir->next;
+	}
+	if (dir->next != -1) {
+		cache->dirs[dir->next].prev = dir->prev;
+	}
+	else {
+		cache->tail = dir->prev;
+	}
+	return;
+}
+
+/* Puts dir at the front of the list of dirs with open descriptors */
+void pushDir(DirCache *cache, CachedDir *dir) {
+	long i = dir - cache->dirs;
+
+	dir->prev = -1;
+	dir->next = cache->head;
+	if (cache->head != -1) {
+		cache->dirs[cache->head].prev = i;
+	}
+	cache->head = i;
+	if (cache->tail == -1) {
+		cache->tail = i;
+	}
+	return;
+}
+
+/* Hangs on to a descriptor for dir, closing the one used longest ago
+ * if there are already DIRCACHE_FDS */
+void keepFd(DirCache *cache, CachedDir *dir, int fd) {
+	CachedDir *old;
+
+	if (cache->num_fds == DIRCACHE_FDS) {
+		old = &cache->dirs[cache->tail];
+		unlinkDir(cache, old);
+		close(old->fd);
+		old->fd = -1;
+	}
+	else {
+		cache->num_fds += 1;
+	}
+	dir->fd = fd;
+	pushDir(cache, dir);
+	return;
+}
+
+/* Returns a descriptor on the directory named by the first len
+ * characters of path, which is normalized. If it hasn't been seen
+ * before it's created with mode, along with any of its parents that
+ * are missing, unless it's already there. Returns -1 with errno set if
+ * it can't be created or isn't a directory. The descriptor belongs to
+ * the cache and is only good until the next call. */
+int dirCacheOpen(DirCache *cache, const char *path, size_t len, 
+		mode_t mode) {
+	uint32_t hash = FNV_OFFSET;
+	CachedDir *dir;
+	char base[PATH_LIMIT + 1];
+	size_t split = len;
+	size_t i;
+	int found;
+	int parent;
+	int fd;
+
+	if (len == 0) {
+		return AT_FDCWD;
+	}
+	if (len == 1 && path[0] == '/') {
+		if (cache->root == -1) {
+			cache->root = statsOpen("/", O_PATH | O_DIRECTORY, 0);
+		}
+		return cache->root;
+	}
+	for (i = 0; i < len; i++) {
+		hash = hashStep(hash, path[i]);
+	}
+	dir = findDir(cache, path, len, hash);
+	if (dir && dir->fd != -1) {
+		if (dir - cache->dirs != cache->head) {
+			unlinkDir(cache, dir);
+			pushDir(cache, dir);
+		}
+		return dir->fd;
+	}
+	found = (dir != NULL);
+
+	/* The parent is everything before the last '/', which is "/"
+	 * itself for top level absolute paths */
+	while (split > 0 && path[split - 1] != '/') {
+		split--;
+	}
+	memcpy(base, path + split, len - split);
+	base[len - split] = '\0';
+	parent = dirCacheOpen(cache, path, split > 1 ? split - 1 : split,
+			PARENT_MODE);
+	if (parent == -1) {
+		return -1;
+	}
+	/* Directories already seen only need opening again */
+	if (!found && statsMkdirat(parent, base, mode) == -1 && 
+			errno != EEXIST) {
+		return -1;
+	}
+	fd = statsOpenat(parent, base, O_PATH | O_DIRECTORY, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	/* Opening the parent may have moved the dirs */
+	dir = found ? findDir(cache, path, len, hash) : 
+		insertDir(cache, path, len, hash);
+	keepFd(cache, dir, fd);
+	return fd;
+}
+
+/* Returns a descriptor on the directory a member named name goes in,
+ * creating it and its parents if need be, and points base at the part
+ * of name to create in it. Returns -1 with errno set if the directory
+ * can't be made. */
+int dirCacheParent(DirCache *cache, const char *name, const char **base) {
+	char dir[PATH_LIMIT + 1];
+	char norm[PATH_LIMIT + 1];
+	const char *slash = strrchr(name, '/');
+	size_t len;
+
+	if (!slash) {
+		*base = name;
+		return AT_FDCWD;
+	}
+	*base = slash + 1;
+	/* The '/' is kept so a parent of "/" stays absolute */
+	memcpy(dir, name, slash - name + 1);
+	dir[slash - name + 1] = '\0';
+	len = normalizePath(norm, dir);
+	return dirCacheOpen(cache, norm, len, PARENT_MODE);
+}
+
+/* Creates the directory a directory member names, with mode, unless
+ * it's been created or found already. Returns -1 with errno set if it
+ * can't be. */
+int dirCacheMake(DirCache *cache, const char *name, mode_t mode) {
+	char norm[PATH_LIMIT + 1];
+	size_t len = normalizePath(norm, name);
+
+	return dirCacheOpen(cache, norm, len, mode);
+}
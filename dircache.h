@@ -0,0 +1,62 @@
+#ifndef DIRCACHEH
+#define DIRCACHEH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "mytar.h"
+
+/* A directory that extraction created or found already there */
+typedef struct cacheddir {
+	/* Where its normalized path starts in the cache's names */
+	size_t name;
+	size_t len;
+	uint32_t hash;
+	/* An O_PATH descriptor on it, or -1 if it's been closed to make
+	 * room for another */
+	int fd;
+	/* Its neighbours in the list of dirs with open descriptors, as
+	 * indices into the cache's dirs, or -1 */
+	long prev;
+	long next;
+} CachedDir;
+
+/* Every directory extraction has created or verified, so each one is
+ * made or looked up once however many members are in it, and parents
+ * missing from the archive are created on demand like mkdir -p. The
+ * most recently used directories keep descriptors open, so members
+ * are created with the *at calls relative to their directory instead
+ * of resolving the whole path again. */
+typedef struct dircache {
+	CachedDir *dirs;
+	size_t num_dirs;
+	size_t cap_dirs;
+	/* Open addressing hash set of indices into dirs plus one, with 0
+	 * for an empty slot. Capacity is a power of two. */
+	size_t *slots;
+	size_t mask;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	/* The dirs with open descriptors, most recently used first, so
+	 * the one used longest ago is closed to make room */
+	long head;
+	long tail;
+	size_t num_fds;
+	/* Descriptor on "/" for absolute paths, or -1 */
+	int root;
+} DirCache;
+
+void dirCacheInit(DirCache *);
+void dirCacheFree(DirCache *);
+CachedDir *findDir(DirCache *, const char *, size_t, uint32_t);
+CachedDir *insertDir(DirCache *, const char *, size_t, uint32_t);
+void unlinkDir(DirCache *, CachedDir *);
+void pushDir(DirCache *, CachedDir *);
+void keepFd(DirCache *, CachedDir *, int);
+int dirCacheOpen(DirCache *, const char *, size_t, mode_t);
+int dirCacheParent(DirCache *, const char *, const char **);
+int dirCacheMake(DirCache *, const char *, mode_t);
+
+#endif
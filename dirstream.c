@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+#include "dirstream.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Opens the directory name relative to dirfd for reading in batches.
+ * Returns -1 with errno set if it can't be opened. */
+int openDirStream(DirStream *stream, int dirfd, const char *name) {
+	memset(stream, 0, sizeof(DirStream));
+	stream->fd = statsOpenat(dirfd, name, O_RDONLY | O_DIRECTORY, 0);
+	if (stream->fd == -1) {
+		return -1;
+	}
+	stream->buf = malloc(DIRENT_BUF);
+	if (!stream->buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+/* Reads the next batch of records into the buffer. Returns how many
+ * bytes of them there are, 0 at the end of the directory, or -1. */
+long readBatch(DirStream *stream) {
+	uint64_t start = statsStart();
+	long res = syscall(SYS_getdents64, stream->fd, stream->buf, 
+			DIRENT_BUF);
+
+	statsAdd(STAT_READDIR, start, res > 0 ? res : 0);
+	stream->len = res > 0 ? res : 0;
+	stream->pos = 0;
+	return res;
+}
+
+/* Returns the next record of the batch other than "." and "..", or
+ * NULL once the batch has been walked */
+RawDirent *nextDirent(DirStream *stream) {
+	RawDirent *entry;
+	const char *name;
+
+	while (stream->pos < stream->len) {
+		entry = (RawDirent *)(stream->buf + stream->pos);
+		stream->pos += entry->d_reclen;
+		name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || 
+					(name[1] == '.' && name[2] == '\0'))) {
+			continue;
+		}
+		return entry;
+	}
+	return NULL;
+}
+
+void closeDirStream(DirStream *stream) {
+	close(stream->fd);
+	free(stream->buf);
+	memset(stream, 0, sizeof(DirStream));
+	return;
+}
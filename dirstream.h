@@ -0,0 +1,33 @@
+#ifndef DIRSTREAMH
+#define DIRSTREAMH
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A record getdents64 fills the buffer with */
+typedef struct rawdirent {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+} RawDirent;
+
+/* A directory read with getdents64 straight into one big buffer, so a
+ * directory of millions of entries takes a few hundred calls. Each
+ * buffer's worth is a batch, walked with nextDirent before the next
+ * one is read. */
+typedef struct dirstream {
+	int fd;
+	char *buf;
+	/* Bytes of records in buf and how far they've been walked */
+	size_t len;
+	size_t pos;
+} DirStream;
+
+int openDirStream(DirStream *, int, const char *);
+long readBatch(DirStream *);
+RawDirent *nextDirent(DirStream *);
+void closeDirStream(DirStream *);
+
+#endif
@@ -5,398 +5,524 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <utime.h>
+#include <time.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "header.h"
 #include "utilities.h"
 #include "mytar.h"
+#include "extract.h"
+#include "filter.h"
+#include "arena.h"
+#include "stats.h"
+#include "scan.h"
+#include "progress.h"
+#include "cache.h"
+#include "sink.h"
+#include "libmytar.h"
+#include "volume.h"
+#include "checkpoint.h"
+#include "hash.h"
 
-/* Restores the mtime of a file while leaving the access time 
- * unmodified.
- * This function is only used for regular files */
-void restoreTimes(Header *header, char *name, int file) {
-	/* The file's mtime */
-	time_t mtime;
-	struct utimbuf *file_times;
-	/* This will just be used to get the access time */
-	struct stat *file_info;
-	
-	/* Get the file's original mtime */
-	mtime = (time_t)strtol(header->mtime, NULL, OCTAL_BASE);
-	/* Get the times of the file that we just created */
-	file_info = malloc(sizeof(struct stat) * 1);
-	if (!file_info) {
-		perror("malloc");
-		close(file);
-		exit(EXIT_FAILURE);
-	}
+/* Restores the owner, permissions, and mtime of an open file or
+ * directory from its header, leaving the access time unmodified.
+ * Everything goes through the descriptor so the path is never
+ * resolved again. Ownership is only restored when running as root
+ * and is done first since chown can clear the set-id bits. */
+void restoreMetadata(Header *header, int fd) {
+	struct timespec times[2];
+	mode_t modes;
+	uid_t uid;
+	gid_t gid;
+	uint64_t start = statsStart();
 
-	if (lstat(name, file_info) == -1) {
-		perror("lstat");
-		return;
+	if (geteuid() == 0) {
+		uid = (uid_t)getHeaderId(header->uid, UID_SIZE);
+		gid = (gid_t)getHeaderId(header->gid, GID_SIZE);
+		if (fchown(fd, uid, gid) == -1) {
+			perror("fchown");
+		}
 	}
 
-	file_times = malloc(sizeof(struct utimbuf) * 1);
-	if (!file_times) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
+	modes = (mode_t)strtol(header->mode, NULL, OCTAL_BASE);
+	if (fchmod(fd, modes & PERMS_MASK) == -1) {
+		perror("fchmod");
 	}
+
 	/* Access time stays the same */
-	file_times->actime = file_info->st_atime;
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT;
 	/* Restore modification time */
-	file_times->modtime = mtime;
-
-	/* Change the file time */
-	if (utime(name, file_times) == -1) {
-		perror("utime");
-		exit(EXIT_FAILURE);
+	times[1].tv_sec = (time_t)strtol(header->mtime, NULL, OCTAL_BASE);
+	times[1].tv_nsec = 0;
+	if (futimens(fd, times) == -1) {
+		perror("futimens");
 	}
-	free(file_info);
-	free(file_times);
+	statsAdd(STAT_META, start, 0);
 	return;
 }
 
-/* Checks if a given directory exists. */
-int checkDirectory(char *name) {
-	struct stat dir_info;
-	int res;
-	/* Don't need to error check because if stat returns
-	 * -1, then the directory doesn't exist */
-	res = stat(name, &dir_info);
+/* Remembers a directory's header so its metadata can be restored once
+ * everything inside of it has been extracted. Restoring it right away
+ * would be pointless since creating its children updates the mtime
+ * and a read-only mode would stop them from being created at all. */
+void deferDirectory(DirList *dirs, Header *header, char *name) {
+	DirMeta *entry;
+	char *c;
 
-	/* Directory exists */
-	if (res == 0 && S_ISDIR(dir_info.st_mode)) {
-		return 1;
+	if (dirs->count == dirs->capacity) {
+		dirs->capacity = dirs->capacity ? dirs->capacity * 2 :
+			DIRLIST_START;
+		dirs->entries = realloc(dirs->entries,
+				sizeof(DirMeta) * dirs->capacity);
+		if (!dirs->entries) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	entry = &dirs->entries[dirs->count];
+	strcpy(entry->name, name);
+	memcpy(&entry->header, header, sizeof(Header));
+	/* The depth is the number of components, so a trailing '/'
+	 * doesn't count */
+	entry->depth = 0;
+	for (c = name; *c != '\0'; c++) {
+		if (*c == '/' && *(c + 1) != '\0') {
+			entry->depth += 1;
+		}
 	}
-	return 0;
+	dirs->count += 1;
+	return;
 }
 
-/* Makes a directory with the original name and perms. */
-void extractDirectory(Header *header, char *name) {
-	int dir_exists;
-	/* The directory's permissions */
-	mode_t modes;
-	
-	/* Check if the directory already exists */
-	dir_exists = checkDirectory(name);
+/* qsort comparator putting the deepest directories first */
+int compareDepth(const void *a, const void *b) {
+	return ((DirMeta *)b)->depth - ((DirMeta *)a)->depth;
+}
 
-	/* If the directory doesn't exist, make it. */
-	if (!dir_exists) {
-		/* Get the directory's file protection modes */
-		modes = (mode_t)strtol(header->mode, NULL, OCTAL_BASE);
-		if (mkdir(name, modes) == -1) {
-			perror("mkdir");
-			exit(EXIT_FAILURE);
+/* Restores the metadata of every deferred directory in a single pass,
+ * deepest first, so restoring a parent's mtime or mode always happens
+ * after all of its children are done. */
+void restoreDirectories(DirList *dirs) {
+	size_t i;
+	int fd;
+
+	qsort(dirs->entries, dirs->count, sizeof(DirMeta), compareDepth);
+	for (i = 0; i < dirs->count; i++) {
+		fd = statsOpen(dirs->entries[i].name, O_RDONLY | O_DIRECTORY, 0);
+		if (fd == -1) {
+			perror(dirs->entries[i].name);
+			continue;
 		}
+		restoreMetadata(&dirs->entries[i].header, fd);
+		close(fd);
+	}
+	free(dirs->entries);
+	dirs->entries = NULL;
+	dirs->count = 0;
+	dirs->capacity = 0;
+	return;
+}
+
+/* Makes a directory with the original name, along with any parents
+ * that aren't in the archive or haven't been extracted yet, unless
+ * it's been made already. It is created owner writable so its
+ * contents can be extracted and its real perms are restored later by
+ * restoreDirectories. */
+void extractDirectory(Header *header, char *name, DirList *dirs, 
+		DirCache *created) {
+	/* Get the directory's file protection modes */
+	mode_t modes = (mode_t)strtol(header->mode, NULL, OCTAL_BASE);
+
+	if (dirCacheMake(created, name, modes | S_IRWXU) == -1) {
+		perror(name);
+		return;
 	}
+	deferDirectory(dirs, header, name);
 	return;
 }
 
 /* Creates a symlink unless it already exists. */
-void extractSymlink(Header *header, char *name) {
+void extractSymlink(Header *header, char *name, DirCache *created) {
+	const char *base;
+	int dirfd = dirCacheParent(created, name, &base);
+
 	/* Most commonly will occur if file already exists */
-	if (symlink(header->linkname, name) == -1) {
+	if (dirfd == -1 || 
+			statsSymlinkat(header->linkname, dirfd, base) == -1) {
 		perror(name);
 		return;
 	}
 	return;
 }
 
-/* Creates a file with the original name and writes all of its contents. 
- * The parameter size is passed by value so the size in extractArchive can 
- * still be used when deciding if we need to lseek. */
-void extractFile(int fdarchive, Header *header, char *name, long int size) {
-	int fdout;
-	/* The file's permissions */
-	mode_t modes;
+/* Works out the hash of the contents of the file open as fd, like
+ * --checksum stores for a member, reading them len bytes at a time
+ * into buf. Returns 0, or -1 if it can't be read. */
+int hashExisting(int fd, char *buf, size_t len, uint64_t *digest) {
+	HashState hash;
+	ssize_t got;
 
-	/* Initialize a completely empty buffer to be read into */
-	char *data = calloc(BLOCK_SIZE, sizeof(char));
-	if (!data) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
+	hashInit(&hash);
+	while ((got = statsRead(fd, buf, len)) > 0) {
+		hashUpdate(&hash, buf, got);
 	}
-	/* Get the file protection modes that correspond to this file */
-	modes = (mode_t)strtol(header->mode, NULL, OCTAL_BASE);
-	/* Create a file with the same name and perms. as was archived. */
-	fdout = open(name, O_WRONLY | O_CREAT | O_TRUNC, modes);
-	if (fdout == -1) {
-		perror(name);
-		free(data);
-		return;
+	*digest = hashDigest(&hash);
+	return got == 0 ? 0 : -1;
+}
+
+/* Whether the file already on disk where the regular file entry would
+ * be extracted should be left as it is. With --keep-newer-files that's
+ * when it's newer than the member. With --skip-unchanged it's when
+ * it's the same as the member: the same size and mtime, or with
+ * --skip-unchanged=checksum the same size and hash as the member's
+ * stored checksum, falling back to the mtime for members without one.
+ * A file whose contents match but whose mtime or permissions don't
+ * just has its metadata restored. Hashing reads into a buffer from
+ * arena, which is given back before returning. */
+int keepExisting(MtEntry *entry, DirCache *created, Options *opts, 
+		Arena *arena) {
+	struct stat info;
+	const char *base;
+	int dirfd;
+	int fd = -1;
+	int same;
+	uint64_t digest;
+	/* Just big enough for small files, like writeFile's chunks */
+	size_t len = entry->size < COMPARE_CHUNK ? 
+		(entry->size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE :
+		COMPARE_CHUNK;
+	ArenaMark mark;
+
+	if (!opts->skip_unchanged && !opts->keep_newer) {
+		return 0;
 	}
-	
-	/* Open error check goes here */
-	while (1) {
-		/* We have finished writing/creating the file once size
-		 * is less than or equal to zero, indicating all bytes
-		 * have been written */
-		if (size <= 0) {
-			break;
+	dirfd = dirCacheParent(created, entry->name, &base);
+	if (dirfd == -1 || statsFstatat(dirfd, base, &info, 
+				AT_SYMLINK_NOFOLLOW) == -1 || 
+			!S_ISREG(info.st_mode)) {
+		return 0;
+	}
+	if (opts->keep_newer && info.st_mtime > entry->mtime) {
+		return 1;
+	}
+	if (!opts->skip_unchanged || (uint64_t)info.st_size != entry->size) {
+		return 0;
+	}
+	if (opts->skip_unchanged == SKIP_CHECKSUM && entry->has_checksum) {
+		fd = statsOpenat(dirfd, base, O_RDONLY, 0);
+		len = len > 0 ? len : BLOCK_SIZE;
+		mark = arenaMark(arena);
+		same = fd != -1 && hashExisting(fd, arenaAlloc(arena, len), 
+				len, &digest) == 0 && digest == entry->checksum;
+		arenaRelease(arena, mark);
+	}
+	else {
+		same = info.st_mtime == entry->mtime;
+	}
+	if (same && (info.st_mtime != entry->mtime || 
+				(info.st_mode & PERMS_MASK) != 
+				(entry->mode & PERMS_MASK))) {
+		if (fd == -1) {
+			fd = statsOpenat(dirfd, base, O_RDONLY, 0);
 		}
-		
-		/* Read a block */
-		if (read(fdarchive, data, BLOCK_SIZE) ==  -1) {
-			fprintf(stderr, "error reading archive\n");
-			exit(EXIT_FAILURE);
+		if (fd != -1) {
+			restoreMetadata(&entry->header, fd);
 		}
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	return same;
+}
 
-		/* If size is greater than 512, we can write an entire block */
-		if (size > BLOCK_SIZE) {
-			if (write(fdout, data, BLOCK_SIZE) == -1) {
-				perror(name);
-				exit(EXIT_FAILURE);
-			}
-			size -= BLOCK_SIZE;
-		}
-		/* Otherwise, it is less than 512 so we only want to write 
-		 * however many bytes are left, size. */
-		else {
-			if(write(fdout, data, size) == -1) {
-				perror(name);
-				exit(EXIT_FAILURE);
-			}
-			size -= size;
-		}
+/* The MtSink write extractFile has mtReaderExtract call, passing each
+ * piece of a member's contents on to its sink */
+int extractWrite(void *arg, const void *data, size_t len) {
+	ExtractCall *call = arg;
 
-		/* This ensures that the entire block is emptied before
-		 * the next read. Otherwise, if a read of less than 512 
-		 * bytes occurs, write might write junk data. */
-		memset(data, 0, BLOCK_SIZE);
+	progressAdd(len, 0);
+	cacheDrop(call->range, call->reader->fd, call->reader->offset);
+	return call->sink->write(call->sink, data, len);
+}
+
+/* Hands a regular file's contents to the sink, which by default creates
+ * a file with the original name and writes them into it. If the sink
+ * won't take them they're left for the next mtReaderNext to skip.
+ * range is the page cache bookkeeping for the archive. */
+void extractFile(MtReader *reader, MtEntry *entry, Sink *sink, 
+		CacheRange *range) {
+	uint64_t size = reader->left;
+	int status;
+	ExtractCall call = {sink, reader, range};
+	MtSink to = {extractWrite, &call};
+
+	if (sink->open(sink, &entry->header, entry->name) == -1) {
+		return;
+	}
+
+	/* Sinks that can take the contents straight from the archive's
+	 * descriptor leave only the padding for the reader to skip. In a
+	 * split archive the contents may carry on in the next volume, 
+	 * which only the reader knows how to follow. */
+	if (sink->copy && size > 0 && !reader->next_volume &&
+			sink->copy(sink, reader->fd, size) == 0) {
+		mtReaderAdvance(reader, size);
+		progressAdd(size, 0);
 	}
 	
-	restoreTimes(header, name, fdout);
-	free(data);
-	close(fdout);
+	status = mtReaderExtract(reader, &to);
+	if (status != MT_OK) {
+		fprintf(stderr, "error reading archive: %s\n", 
+				mtStrerror(status));
+		exit(EXIT_FAILURE);
+	}
+	
+	sink->close(sink, &entry->header);
 	return;
 }
 
-/* A lot of the logic used in here is reused from list since they both read
- * through an archive. */
-void extractArchive(int numPaths, char *paths[], int strict, int verbose) {
-	int i, j;
+/* Extracts the archive or stripe in job->name, going on through the
+ * rest of its volumes with --multi-volume. Runs on its own thread for
+ * each stripe. The directories are left in job->dirs to be restored
+ * once every stripe is done, since another stripe may still be
+ * extracting into them. */
+void *extractJob(void *arg) {
+	ExtractJob *job = arg;
+	Options *opts = job->opts;
+	int verbose = opts->verbose;
 	/* Flag indicating if a file was extracted or not */
 	int was_extracted;
-	/* The number of data blocks to possibly skip over */
-	int num_dblocks = 0;
-	/* This is what the checksum of a given header should be */
-	unsigned int csum;
-	/* This is what the header's checksum is */
-	unsigned int hcsum;
-	/* This is a counter to check end of archive */
-	int eoa = 0;
-	/* The name of a path can be at most 256 chars. plus a null terminating
-	 * char. */
-	char name[PATH_LIMIT + 1];
-	long int size;
 	int fdarchive;
-	/* Don't need to calloc since header data will get overwritten with
-	 * archive headers. */
-	Header *header;
+	/* Reads the archive a member at a time */
+	MtReader reader;
+	MtEntry *entry;
+	int status;
+	/* The range of bytes skipped to recover from a damaged header */
+	off_t from;
+	off_t to;
 	/* Flag to signify that we are extracting, not listing since both
-	 * list and extract use the same function, isValid, to see what is
+	 * list and extract use the same function, filterMatch, to see what is
 	 * valid to list/extract. */
 	int t_flag = 0;
-	/* Check if a valid archive was given which is paths[2] */
+	/* The volumes being read */
+	VolumeSet volumes;
+	/* Directories that have been made or found already */
+	DirCache created;
+	/* The path arguments and excludes, compiled once */
+	Filter filter;
+	/* Where extracted files go */
+	Sink sink;
+	/* The filesystem synced before each checkpoint */
+	int sync_fd = -1;
 	
-	header = malloc(sizeof(Header) * 1);
-	if (!header) {
+	entry = malloc(sizeof(MtEntry));
+	if (!entry) {
 		perror("malloc");
 		exit(EXIT_FAILURE);
 	}
 	
 	/* Open the archive for reading */
-	fdarchive = open(paths[2], O_RDONLY);
+	fdarchive = statsOpen(job->name, O_RDONLY, 0);
 	if (fdarchive == -1) {
-		perror(paths[2]);
-		free(header);
+		perror(job->name);
 		exit(EXIT_FAILURE);
 	}
-	
-	while (1) {
-		/* Read a header */
-		if (read(fdarchive, header, BLOCK_SIZE) == -1) {
-			perror(paths[2]);
+	mtReaderInit(&reader, fdarchive, opts->strict ? MT_STRICT : 0);
+	volumeInit(&volumes, job->name);
+	if (opts->multi_volume && 
+			mtReaderVolumes(&reader, readVolume, &volumes) != 
+			MT_OK) {
+		perror(job->name);
+		exit(EXIT_FAILURE);
+	}
+	if (job->checkpoint.enabled) {
+		sync_fd = statsOpen(".", O_RDONLY | O_DIRECTORY, 0);
+		if (sync_fd == -1) {
+			perror(".");
 			exit(EXIT_FAILURE);
 		}
-		/* Error checking for read goes here */
-		/* End of archive reached, return */
-		if (eoa == 2) {
-			return;
-		}
-
-		/* Check if the header's checksum is the same as what the
-		 * checksum should actually be */
-		csum = getChksum(header);
-		hcsum = strtol(header->chksum, NULL, OCTAL_BASE);
-		/* Checksums don't match */
-		if (csum != hcsum) {
-			/* Potentially end of archive */
-			if (csum == 256) {
-				for (j = 0; j < BLOCK_SIZE; j++) {
-					if (((unsigned char *)header)[j] != 
-							'\0') {
-						fprintf(stderr, 
-								"Incorrect" 
-								"header " 
-								"checksum\n");
-						free(header);
-						exit(EXIT_FAILURE);
-					}
-				}
-				/* Increment the eoa counter */
-				eoa += 1;
-				continue;
-			}
-			else {
-				fprintf(stderr, "Incorrect header checksum\n");
-				free(header);
-				exit(EXIT_FAILURE);
-			}
+	}
+	/* Go straight to the member after the last one checkpointed. The
+	 * directories before it are still to be restored, so they come
+	 * back from the checkpoint too. */
+	if (opts->resume && checkpointLoad(&job->checkpoint, job->prog, 
+				&job->dirs)) {
+		status = mtReaderSeek(&reader, job->checkpoint.volume,
+				job->checkpoint.offset);
+		if (status != MT_OK) {
+			fprintf(stderr, "%s: can't resume: %s\n", job->name,
+					mtStrerror(status));
+			exit(EXIT_FAILURE);
 		}
-		else {
-			/* Reset the eoa counter */
-			eoa = 0;
+		progressAdd(volumeOffset(job->name, job->checkpoint.volume,
+					job->checkpoint.offset), 0);
+	}
+	compileFilter(&filter, job->num_paths, job->paths, opts);
+	if (opts->to_stdout) {
+		sinkStdout(&sink);
+	}
+	else {
+		sinkDisk(&sink, &created);
+	}
+	dirCacheInit(&created);
+	
+	while ((status = mtReaderNext(&reader, entry)) != MT_END) {
+		if (status == MT_ERR_IO) {
+			perror(job->name);
+			exit(EXIT_FAILURE);
 		}
-		
-		/* Strict is set so check magic and version */
-		if (strict) {
-			strictCheck(header);	
+		/* The member is still there, it just can't be extracted */
+		if (status == MT_ERR_TOOLONG) {
+			fprintf(stderr, "%s\n", mtStrerror(status));
+			continue;
 		}
-		/* Not strict so just check if magic field is ustar */
-		else {
-			if (strncmp(header->magic, 
-						"ustar", 
-						MAGIC_SIZE - 1) != 0) {
-				fprintf(stderr, "Header magic field "
-						"not valid\n");
-				free(header);
+		if (status != MT_OK) {
+			fprintf(stderr, "%s\n", mtStrerror(status));
+			if (!opts->recover || status == MT_ERR_TRUNCATED) {
 				exit(EXIT_FAILURE);
 			}
-		}
-
-		/* Get the size of the file */
-		size = strtol(header->size, NULL, OCTAL_BASE);
-		was_extracted = 0;
-		
-		/* Using strnlen, strncpy, and strncat because we can't
-		 * assume that the name or prefix is null-terminated. */
-		/* Check if path would be too long */
-		if (strnlen(header->name, NAME_SIZE) + 1 +
-				strnlen(header->prefix, PREFIX_SIZE) > 
-				PATH_LIMIT) {
-			fprintf(stderr, "path too long\n");
+			status = mtReaderRecover(&reader, &from, &to);
+			reportRecover(job->prog, status, from, to);
 			continue;
 		}
-		/* Construct name */
-		/* No prefix, so entire name is just in name field */
-		if (header->prefix[0] == '\0') {	
-			strncpy(name, header->name, NAME_SIZE);
-		}
-		/* Prefix exists */
-		else {
-			/* Copy over the prefix to name */
-			strncpy(name, header->prefix, PREFIX_SIZE);
-			/* Append a '/' */
-			strcat(name, "/");
-			/* Append the name field to name */
-			strncat(name, header->name, NAME_SIZE);
-		}
+		was_extracted = 0;
 
-		/* No paths were given, so extract the entire archive. */
-		if (numPaths < 4) {
-			/* Extract regular file */
-			if (*header->typeflag == REG_FLAG) {
-				extractFile(fdarchive, header, name, size);
+		/* Check if the current header was selected by the path 
+		 * arguments. When extracting, the directories leading to a 
+		 * path are selected too. This is to ensure that the 
+		 * directory is always created first if a path is a 
+		 * file/directory inside a directory. */
+		statsEntry(entry->size);
+		progressAdd(BLOCK_SIZE, 1);
+		if (filterMatch(&filter, entry->name, 
+					entry->type == DIR_FLAG, t_flag)) {
+			/* The contents are skipped over unread */
+			if (entry->type == REG_FLAG && sink.tree &&
+					keepExisting(entry, &created, opts, 
+					&job->arena)) {
+				statsSkipped(entry->size);
 			}
-			/* Extract directory */
-			else if (*header->typeflag == DIR_FLAG) {
-				extractDirectory(header, name);
+			else if (entry->type == REG_FLAG) {
+				extractFile(&reader, entry, &sink, 
+						&volumes.cache);
+				was_extracted = 1;
 			}
-			/* Extract symbolic link */
-			else if (*header->typeflag == SYM_FLAG) {
-				extractSymlink(header, name);
+			else if (entry->type == DIR_FLAG && sink.tree) {
+				extractDirectory(&entry->header, entry->name, 
+						&job->dirs, &created);
+				was_extracted = 1;
 			}
-			/* Wait until after extraction to print name */
-			if (verbose) {
-				printf("%s\n", name);
+			else if (entry->type == SYM_FLAG && sink.tree) {
+				extractSymlink(&entry->header, entry->name,
+						&created);
+				was_extracted = 1;
 			}
+			/* Wait until after extraction to print name. When
+			 * the contents go to stdout, names go to stderr. */
+			if (was_extracted && verbose) {
+				fprintf(opts->to_stdout ? stderr : stdout, 
+						"%s\n", entry->name);
+			}
+		}
+		/* Whatever is left of the contents, if only the padding, 
+		 * is skipped by the next mtReaderNext */
+		progressAdd(reader.left + reader.pad, 0);
+		cacheDrop(&volumes.cache, reader.fd, reader.offset + 
+				reader.left + reader.pad);
+		/* Once this member is skipped the reader is where the
+		 * next one starts */
+		if (checkpointDue(&job->checkpoint) && 
+				mtReaderSkip(&reader) == MT_OK) {
+			job->checkpoint.volume = reader.next_volume ? 
+				reader.volume : 1;
+			job->checkpoint.offset = reader.offset;
+			checkpointSave(&job->checkpoint, sync_fd, &job->dirs);
 		}
-		/* Paths were given */
-		else {
-			/* Start looping through each given path */
-			for (i = ARG_START; i < numPaths; i++) {
-				/* strcmp checks if the current header is a 
-				 * path argument that was passed. The 
-				 * arguments passed to strstr are flipped 
-				 from list.c. This is to ensure that the 
-				 directory is always created first if a path
-				 is a file/directory inside a directory. */
-				if (isValid(name, paths[i], t_flag)) {
-					if (*header->typeflag == REG_FLAG) {
-						extractFile(fdarchive, header, 
-								name, size);
-						if (verbose) {
-							printf("%s\n", name);
-						}
-						was_extracted = 1;
-						break;
-					}
-					else if (*header->typeflag==DIR_FLAG) {
-						extractDirectory(header, name);
-						if (verbose) {
-							printf("%s\n", name);
-						}
+		/* Everything that was asked for has been extracted */
+		if (filterDone(&filter)) {
+			break;
+		}
+	} /* This is the while loop */
+	cacheDone(&volumes.cache, reader.fd);
+	dirCacheFree(&created);
+	freeFilter(&filter);
+	free(entry);
+	close(reader.fd);
+	if (sync_fd != -1) {
+		close(sync_fd);
+	}
+	return NULL;
+}
 
-						was_extracted = 1;
-						break;
-					}
-					else if(*header->typeflag == SYM_FLAG) {
-						extractSymlink(header, name);
-						if (verbose) {
-							printf("%s\n", name);
-						}
-						was_extracted = 1;
-						break;
-					}
-				}
-			}
-			/* Once out of the for loop one of two scenarios have
-			 * occured:
-			 * 1: The current header matched one of the paths and
-			 * was successfully extracted.
-			 * 2: The current header did not match any of the given
-			 * paths. 
-			 * If case 2 occurred, then may need to lseek. */
-			if (!was_extracted) {
-				/* If the current header is a regular 
-				 * file, need to skip ahead to the next 
-				 * header */
-				if (*header->typeflag == REG_FLAG) {
-					/* Gets the ceiling of dividing the 
-					 * size with 512 which results in the 
-					 * number of blocks we need to skip 
-					 * over to reach the next header */
-					num_dblocks = size/BLOCK_SIZE + 
-						(size % BLOCK_SIZE != 0);
-					/* Skips over the contents */
-					if (lseek(fdarchive, 
-					  BLOCK_SIZE * num_dblocks, 
-					  SEEK_CUR) 
-					  == -1) {
-						perror("lseek");
-					/* if lseek fails, then the next 
-					 * header read will fail anyway */
-					}
-				}
-			}
+/* A lot of the logic used in here is reused from list since they both read
+ * through an archive. With --stripes every stripe is extracted at once
+ * by its own thread, unless the contents are going to stdout, where
+ * they're extracted one after another so they come out in order. Each
+ * stripe has a checkpoint of its own. */
+void extractArchive(int numPaths, char *paths[], Options *opts) {
+	int i;
+	int num_jobs = opts->stripes > 1 ? opts->stripes : 1;
+	ExtractJob *jobs;
+	pthread_t *threads;
+	/* Every volume's size, since progress counts every block read or
+	 * skipped */
+	uint64_t total = 0;
 
+	jobs = calloc(num_jobs, sizeof(ExtractJob));
+	threads = calloc(num_jobs, sizeof(pthread_t));
+	if (!jobs || !threads) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < num_jobs; i++) {
+		jobs[i].prog = paths[0];
+		jobs[i].name = volumeName(paths[TAR_INDEX], i + 1);
+		jobs[i].num_paths = numPaths;
+		jobs[i].paths = paths;
+		jobs[i].opts = opts;
+		arenaInit(&jobs[i].arena, ARENA_CHUNK);
+		checkpointInit(&jobs[i].checkpoint, jobs[i].name, 'x',
+				opts->checkpoint, opts->checkpoint_interval);
+		total += volumeTotal(jobs[i].name, opts->multi_volume);
+	}
+	if (opts->progress) {
+		progressStart(paths[0], opts->progress_interval, total, 0);
+	}
+
+	if (num_jobs == 1 || opts->to_stdout) {
+		for (i = 0; i < num_jobs; i++) {
+			extractJob(&jobs[i]);
+		}
+	}
+	else {
+		for (i = 0; i < num_jobs; i++) {
+			if (pthread_create(&threads[i], NULL, extractJob,
+						&jobs[i]) != 0) {
+				fprintf(stderr, "can't start stripe thread\n");
+				exit(EXIT_FAILURE);
+			}
 		}
+		for (i = 0; i < num_jobs; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	}
 
-	} /* This is the while loop */
-	free(header);
-	close(fdarchive);
+	/* Nothing's left to resume once the directories are restored */
+	for (i = 0; i < num_jobs; i++) {
+		restoreDirectories(&jobs[i].dirs);
+		checkpointFinish(&jobs[i].checkpoint);
+	}
+	progressStop();
+	for (i = 0; i < num_jobs; i++) {
+		if (opts->alloc_stats) {
+			arenaReport(&jobs[i].arena, paths[0]);
+		}
+		arenaFree(&jobs[i].arena);
+		free(jobs[i].name);
+	}
+	free(jobs);
+	free(threads);
 	return;
 }
-
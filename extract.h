@@ -1,13 +1,65 @@
 #ifndef EXTRACTH
 #define EXTRACTH
 
+#include <stddef.h>
+
 #include "header.h"
+#include "mytar.h"
+#include "options.h"
+#include "arena.h"
+#include "sink.h"
+#include "dircache.h"
+#include "libmytar.h"
+#include "cache.h"
+#include "checkpoint.h"
+
+/* A directory whose metadata still needs to be restored */
+typedef struct dirmeta {
+	char name[PATH_LIMIT + 1];
+	Header header;
+	int depth;
+} DirMeta;
+
+typedef struct dirlist {
+	DirMeta *entries;
+	size_t count;
+	size_t capacity;
+} DirList;
+
+/* One archive, or one stripe of a striped one, to be extracted */
+typedef struct extractjob {
+	char *prog;
+	/* The file it starts in */
+	char *name;
+	int num_paths;
+	char **paths;
+	Options *opts;
+	/* Directories whose metadata is restored once every job is done */
+	DirList dirs;
+	/* How far it's got, for --resume */
+	Checkpoint checkpoint;
+	/* Scratch memory for every member */
+	Arena arena;
+} ExtractJob;
+
+/* What extractWrite needs to hand a member's contents to a sink */
+typedef struct extractcall {
+	Sink *sink;
+	MtReader *reader;
+	CacheRange *range;
+} ExtractCall;
 
-void restoreTimes(Header *, char *, int);
-int checkDirectory(char *);
-void extractDirectory(Header *, char *);
-void extractSymlink(Header *, char *, int);
-void extractFile(int, Header *, char *, long int);
-void extractArchive(int, char **, int, int);
+void restoreMetadata(Header *, int);
+void deferDirectory(DirList *, Header *, char *);
+int compareDepth(const void *, const void *);
+void restoreDirectories(DirList *);
+void extractDirectory(Header *, char *, DirList *, DirCache *);
+void extractSymlink(Header *, char *, DirCache *);
+int hashExisting(int, char *, size_t, uint64_t *);
+int keepExisting(MtEntry *, DirCache *, Options *, Arena *);
+int extractWrite(void *, const void *, size_t);
+void extractFile(MtReader *, MtEntry *, Sink *, CacheRange *);
+void *extractJob(void *);
+void extractArchive(int, char **, Options *);
 
 #endif
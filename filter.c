@@ -0,0 +1,289 @@
+/* FNM_LEADING_DIR is a GNU extension */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+
+#include "filter.h"
+#include "mytar.h"
+
+/* One step of FNV-1a. Hashing a path one character at a time means the
+ * hash of every leading component of a name is available on the way
+ * to hashing the whole name. */
+uint32_t hashStep(uint32_t hash, unsigned char c) {
+	return (hash ^ c) * FNV_PRIME;
+}
+
+/* Copies src into dest without any leading "./", repeated slashes, or
+ * trailing slash, returning the new length. */
+size_t normalizePath(char *dest, const char *src) {
+	size_t len = 0;
+
+	while (src[0] == '.' && src[1] == '/') {
+		src += 2;
+		while (*src == '/') {
+			src++;
+		}
+	}
+	for (; *src != '\0'; src++) {
+		if (*src == '/' && len > 0 && dest[len - 1] == '/') {
+			continue;
+		}
+		dest[len] = *src;
+		len += 1;
+	}
+	while (len > 1 && dest[len - 1] == '/') {
+		len -= 1;
+	}
+	dest[len] = '\0';
+	return len;
+}
+
+/* Looks up the first len characters of path in the hash set */
+PathSlot *findPath(Filter *filter, const char *path, size_t len,
+		uint32_t hash) {
+	size_t i;
+	PathSlot *slot;
+
+	if (!filter->slots) {
+		return NULL;
+	}
+	for (i = hash & filter->mask; ; i = (i + 1) & filter->mask) {
+		slot = &filter->slots[i];
+		if (!slot->path) {
+			return NULL;
+		}
+		if (slot->hash == hash && slot->len == len &&
+				memcmp(slot->path, path, len) == 0) {
+			return slot;
+		}
+	}
+}
+
+/* Adds the first len characters of path to the hash set, or adds kind
+ * to it if it's already there. */
+void insertPath(Filter *filter, const char *path, size_t len,
+		uint32_t hash, int kind) {
+	size_t i;
+	PathSlot *slot = findPath(filter, path, len, hash);
+
+	if (slot) {
+		/* A path given twice is still one target */
+		if ((kind & FILTER_TARGET) && !(slot->kind & FILTER_TARGET)) {
+			filter->num_targets += 1;
+		}
+		slot->kind |= kind;
+		return;
+	}
+	for (i = hash & filter->mask; filter->slots[i].path;
+			i = (i + 1) & filter->mask) {
+		;
+	}
+	slot = &filter->slots[i];
+	slot->path = path;
+	slot->len = len;
+	slot->hash = hash;
+	slot->kind = kind;
+	slot->seen = 0;
+	if (kind & FILTER_TARGET) {
+		filter->num_targets += 1;
+	}
+	return;
+}
+
+/* Compiles the path arguments, paths[ARG_START] onward, into a filter.
+ * Components are counted first so the hash set never has to grow and
+ * stays at most half full. */
+void compileFilter(Filter *filter, int numPaths, char *paths[],
+		Options *opts) {
+	int i;
+	size_t j;
+	size_t len;
+	size_t capacity = FILTER_MIN_SLOTS;
+	size_t components = 0;
+	uint32_t hash;
+	char *path;
+
+	memset(filter, 0, sizeof(Filter));
+	filter->occurrence = opts->occurrence;
+	filter->excludes = opts->excludes;
+	filter->num_excludes = opts->num_excludes;
+	if (numPaths <= ARG_START) {
+		return;
+	}
+
+	filter->owned = calloc(numPaths, sizeof(char *));
+	filter->globs = calloc(numPaths, sizeof(char *));
+	if (!filter->owned || !filter->globs) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = ARG_START; i < numPaths; i++) {
+		path = malloc(strlen(paths[i]) + 1);
+		if (!path) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		len = normalizePath(path, paths[i]);
+		filter->owned[filter->num_owned] = path;
+		filter->num_owned += 1;
+		if (opts->wildcards && strpbrk(path, "*?[")) {
+			filter->globs[filter->num_globs] = path;
+			filter->num_globs += 1;
+			continue;
+		}
+		for (j = 0; j < len; j++) {
+			components += (path[j] == '/');
+		}
+		components += 1;
+	}
+
+	while (capacity < components * 2) {
+		capacity *= 2;
+	}
+	filter->slots = calloc(capacity, sizeof(PathSlot));
+	if (!filter->slots) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	filter->mask = capacity - 1;
+
+	for (i = 0; i < filter->num_owned; i++) {
+		path = filter->owned[i];
+		if (opts->wildcards && strpbrk(path, "*?[")) {
+			continue;
+		}
+		hash = FNV_OFFSET;
+		for (j = 0; path[j] != '\0'; j++) {
+			/* Every leading component is an ancestor */
+			if (path[j] == '/' && j > 0) {
+				insertPath(filter, path, j, hash,
+						FILTER_ANCESTOR);
+			}
+			hash = hashStep(hash, path[j]);
+		}
+		insertPath(filter, path, j, hash, FILTER_TARGET);
+	}
+	filter->outstanding = filter->num_targets;
+	return;
+}
+
+void freeFilter(Filter *filter) {
+	size_t i;
+
+	for (i = 0; i < filter->num_owned; i++) {
+		free(filter->owned[i]);
+	}
+	free(filter->owned);
+	free(filter->globs);
+	free(filter->slots);
+	memset(filter, 0, sizeof(Filter));
+	return;
+}
+
+/* Checks a name (without its trailing slash) against the --exclude
+ * patterns. Like tar, a pattern can match starting at any component,
+ * so "*.o" excludes object files anywhere and "build" excludes every
+ * directory called build along with its contents. */
+int filterExcluded(Filter *filter, const char *name) {
+	size_t i;
+	const char *start;
+
+	for (i = 0; i < filter->num_excludes; i++) {
+		start = name;
+		while (start) {
+			if (fnmatch(filter->excludes[i], start,
+						FNM_LEADING_DIR) == 0) {
+				return 1;
+			}
+			start = strchr(start, '/');
+			if (start) {
+				start++;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Checks if a header's name was selected by the path arguments. A name
+ * is selected when it is one of the paths or inside of one. When
+ * extracting (t_flag is 0), the directories leading to a path are
+ * selected as well. Nothing is allocated, and apart from the globs,
+ * the name is only walked once.
+ *
+ * A non-directory member named exactly by a path only counts on its
+ * selected occurrence, which also satisfies that path. Directories
+ * never satisfy a path since their contents can appear anywhere. */
+int filterMatch(Filter *filter, const char *name, int is_dir, int t_flag) {
+	size_t i;
+	size_t len = strlen(name);
+	uint32_t hash = FNV_OFFSET;
+	PathSlot *slot;
+	/* The name without its trailing slash, for fnmatch */
+	char trimmed[PATH_LIMIT + 1];
+
+	while (len > 1 && name[len - 1] == '/') {
+		len -= 1;
+	}
+	if (len > PATH_LIMIT) {
+		return 0;
+	}
+	memcpy(trimmed, name, len);
+	trimmed[len] = '\0';
+
+	if (filter->num_excludes && filterExcluded(filter, trimmed)) {
+		return 0;
+	}
+	/* No paths were given, so everything is selected */
+	if (filter->num_targets == 0 && filter->num_globs == 0) {
+		return 1;
+	}
+
+	for (i = 0; i <= len; i++) {
+		if (i == len || (name[i] == '/' && i > 0)) {
+			slot = findPath(filter, name, i, hash);
+			if (slot && i == len && !is_dir &&
+					(slot->kind & FILTER_TARGET)) {
+				slot->seen += 1;
+				if (filter->occurrence == 0) {
+					return 1;
+				}
+				if (slot->seen == filter->occurrence) {
+					filter->outstanding -= 1;
+					return 1;
+				}
+				return 0;
+			}
+			if (slot && (slot->kind & FILTER_TARGET)) {
+				return 1;
+			}
+			if (slot && i == len && !t_flag &&
+					(slot->kind & FILTER_ANCESTOR)) {
+				return 1;
+			}
+			if (i == len) {
+				break;
+			}
+		}
+		hash = hashStep(hash, name[i]);
+	}
+
+	for (i = 0; i < filter->num_globs; i++) {
+		if (fnmatch(filter->globs[i], trimmed,
+					FNM_LEADING_DIR) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Checks if every path argument has been satisfied, meaning nothing
+ * later in the archive can be selected and reading can stop. That is
+ * never the case with globs, when selecting every occurrence, or when
+ * one of the paths turned out to be a directory. */
+int filterDone(Filter *filter) {
+	return filter->num_targets > 0 && filter->num_globs == 0 &&
+		filter->occurrence > 0 && filter->outstanding == 0;
+}
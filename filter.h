@@ -0,0 +1,58 @@
+#ifndef FILTERH
+#define FILTERH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "options.h"
+
+/* Kinds of paths stored in the filter's hash set. A path argument
+ * "a/b/c" is stored as a target, and its leading components "a" and
+ * "a/b" as ancestors so extraction can create the directories that
+ * lead to it. One path can be both. */
+#define FILTER_TARGET 1
+#define FILTER_ANCESTOR 2
+
+/* A slot in the hash set of literal paths. Ancestors point into the
+ * same string as their target, just with a shorter length. */
+typedef struct pathslot {
+	const char *path;
+	size_t len;
+	uint32_t hash;
+	int kind;
+	/* Times a non-directory member with exactly this name was seen */
+	int seen;
+} PathSlot;
+
+/* The path arguments compiled once so each header can be matched in
+ * time proportional to the length of its name. */
+typedef struct filter {
+	/* Open addressing hash set, capacity is a power of two */
+	PathSlot *slots;
+	size_t mask;
+	size_t num_targets;
+	/* Targets that haven't been satisfied yet, see filterDone */
+	size_t outstanding;
+	/* Which occurrence of a member to select, 0 selects them all */
+	int occurrence;
+	/* Path arguments treated as globs because of --wildcards */
+	char **globs;
+	size_t num_globs;
+	char **excludes;
+	size_t num_excludes;
+	/* Normalized copies of the path arguments */
+	char **owned;
+	size_t num_owned;
+} Filter;
+
+uint32_t hashStep(uint32_t, unsigned char);
+size_t normalizePath(char *, const char *);
+PathSlot *findPath(Filter *, const char *, size_t, uint32_t);
+void insertPath(Filter *, const char *, size_t, uint32_t, int);
+void compileFilter(Filter *, int, char *[], Options *);
+void freeFilter(Filter *);
+int filterExcluded(Filter *, const char *);
+int filterMatch(Filter *, const char *, int, int);
+int filterDone(Filter *);
+
+#endif
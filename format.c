@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "format.h"
+#include "utilities.h"
+
+/* Builds the permission table so a mode's rwx string is one copy */
+void initFormat(Format *fmt) {
+	int mode;
+	int bit;
+	/* The character for each bit, from S_IRUSR down to S_IXOTH */
+	const char *rwx = "rwxrwxrwx";
+
+	for (mode = 0; mode < PERMS_COMBOS; mode++) {
+		for (bit = 0; bit < PERMS_WIDTH - 1; bit++) {
+			if (mode & (S_IRUSR >> bit)) {
+				fmt->perms[mode][bit] = rwx[bit];
+			}
+			else {
+				fmt->perms[mode][bit] = '-';
+			}
+		}
+	}
+	/* Nothing is cached yet */
+	fmt->day_start = 0;
+	fmt->day_end = 0;
+	return;
+}
+
+/* Writes val in decimal right aligned to width, like "%*lu", returning
+ * the number of characters written. */
+size_t formatUint(char *dest, unsigned long val, int width) {
+	/* Enough for a 64 bit number */
+	char digits[DIGITS_MAX];
+	int num = 0;
+	int i;
+	size_t len = 0;
+
+	do {
+		digits[num] = '0' + val % 10;
+		num += 1;
+		val /= 10;
+	} while (val > 0);
+
+	for (i = num; i < width; i++) {
+		dest[len] = ' ';
+		len += 1;
+	}
+	while (num > 0) {
+		num -= 1;
+		dest[len] = digits[num];
+		len += 1;
+	}
+	return len;
+}
+
+/* Writes a two digit, zero padded number */
+void formatTwo(char *dest, int val) {
+	dest[0] = '0' + val / 10;
+	dest[1] = '0' + val % 10;
+	return;
+}
+
+/* Writes mtime as "YYYY-MM-DD HH:MM" in local time, returning
+ * MTIME_WIDTH. localtime_r (and its timezone lookups) only runs the
+ * first time a day is seen. After that, the day's start time gives the
+ * hour and minute directly. A day that contains a daylight saving
+ * change isn't cached since its hours aren't all the same length. */
+size_t formatMtime(Format *fmt, time_t mtime, char *dest) {
+	struct tm tm;
+	struct tm start;
+	struct tm end;
+	time_t secs;
+	int year;
+	char wide[LINE_MAX_LEN];
+
+	if (mtime < fmt->day_start || mtime >= fmt->day_end) {
+		localtime_r(&mtime, &tm);
+		year = REL_YEAR + tm.tm_year;
+		/* Years past 9999 don't fit, so let snprintf handle them 
+		 * and cut them off at MTIME_WIDTH like printVerbose did */
+		if (year < 0 || year > MAX_YEAR) {
+			snprintf(wide, LINE_MAX_LEN, 
+					"%04d-%02d-%02d %02d:%02d", year,
+					JANUARY + tm.tm_mon, tm.tm_mday,
+					tm.tm_hour, tm.tm_min);
+			memcpy(dest, wide, MTIME_WIDTH);
+			return MTIME_WIDTH;
+		}
+		dest[0] = '0' + year / 1000;
+		dest[1] = '0' + year / 100 % 10;
+		formatTwo(dest + 2, year % 100);
+		dest[4] = '-';
+		formatTwo(dest + 5, JANUARY + tm.tm_mon);
+		dest[7] = '-';
+		formatTwo(dest + 8, tm.tm_mday);
+		dest[10] = ' ';
+		formatTwo(dest + 11, tm.tm_hour);
+		dest[13] = ':';
+		formatTwo(dest + 14, tm.tm_min);
+
+		/* Remember the day if its offset doesn't change */
+		fmt->day_start = mtime - tm.tm_hour * SECS_PER_HOUR -
+			tm.tm_min * SECS_PER_MIN - tm.tm_sec;
+		localtime_r(&fmt->day_start, &start);
+		secs = fmt->day_start + SECS_PER_DAY - 1;
+		localtime_r(&secs, &end);
+		if (start.tm_gmtoff == tm.tm_gmtoff &&
+				end.tm_gmtoff == tm.tm_gmtoff &&
+				end.tm_mday == tm.tm_mday) {
+			fmt->day_end = fmt->day_start + SECS_PER_DAY;
+			memcpy(fmt->date, dest, DATE_WIDTH);
+		}
+		else {
+			fmt->day_start = 0;
+			fmt->day_end = 0;
+		}
+		return MTIME_WIDTH;
+	}
+
+	secs = mtime - fmt->day_start;
+	memcpy(dest, fmt->date, DATE_WIDTH);
+	dest[10] = ' ';
+	formatTwo(dest + 11, secs / SECS_PER_HOUR);
+	dest[13] = ':';
+	formatTwo(dest + 14, secs % SECS_PER_HOUR / SECS_PER_MIN);
+	return MTIME_WIDTH;
+}
+
+/* Formats a verbose listing line into line, which must hold at least
+ * LINE_MAX_LEN characters, returning its length. The line is the same
+ * as printf("%10s %-17s %8ld %16s %s\n") of the permissions,
+ * owner/group, size, mtime, and name. */
+size_t formatVerbose(Format *fmt, Header *header, char *name, char *line) {
+	size_t len = 0;
+	size_t field;
+	unsigned long mode;
+
+	/* Permissions */
+	if (*header->typeflag == DIR_FLAG) {
+		line[TYPE_INDEX] = 'd';
+	}
+	else if (*header->typeflag == SYM_FLAG) {
+		line[TYPE_INDEX] = 'l';
+	}
+	else {
+		line[TYPE_INDEX] = '-';
+	}
+	mode = parseOctal(header->mode, MODE_SIZE);
+	memcpy(line + USR_R, fmt->perms[mode & (PERMS_COMBOS - 1)],
+			PERMS_WIDTH - 1);
+	len = PERMS_WIDTH;
+	line[len] = ' ';
+	len += 1;
+
+	/* Owner/group, padded to at least OWNGRP_WIDTH */
+	field = strnlen(header->uname, UNAME_SIZE);
+	memcpy(line + len, header->uname, field);
+	len += field;
+	line[len] = '/';
+	len += 1;
+	field += 1 + strnlen(header->gname, GNAME_SIZE);
+	memcpy(line + len, header->gname, strnlen(header->gname, GNAME_SIZE));
+	len += strnlen(header->gname, GNAME_SIZE);
+	while (field < OWNGRP_WIDTH) {
+		line[len] = ' ';
+		len += 1;
+		field += 1;
+	}
+	line[len] = ' ';
+	len += 1;
+
+	/* Size */
+	len += formatUint(line + len, parseOctal(header->size, SIZE_SIZE),
+			FSIZE_WIDTH);
+	line[len] = ' ';
+	len += 1;
+
+	/* Mtime */
+	len += formatMtime(fmt, (time_t)parseOctal(header->mtime, 
+				MTIME_SIZE), line + len);
+	line[len] = ' ';
+	len += 1;
+
+	len += formatName(line + len, name);
+	return len;
+}
+
+/* Copies a name and a newline into line, returning the length */
+size_t formatName(char *line, char *name) {
+	size_t len = strlen(name);
+
+	memcpy(line, name, len);
+	line[len] = '\n';
+	return len + 1;
+}
+
+/* Gets the name of a member's type for structured listings */
+const char *typeName(char typeflag) {
+	if (typeflag == REG_FLAG || typeflag == '\0') {
+		return "file";
+	}
+	else if (typeflag == DIR_FLAG) {
+		return "directory";
+	}
+	else if (typeflag == SYM_FLAG) {
+		return "symlink";
+	}
+	return "other";
+}
+
+/* Writes at most len characters of src as a quoted JSON string,
+ * escaping quotes, backslashes, and control characters. Other bytes
+ * are copied as is. Returns the number of characters written, which
+ * is at most 6 * len + 2. */
+size_t formatJsonString(char *dest, const char *src, size_t len) {
+	const char *hex = "0123456789abcdef";
+	size_t out = 0;
+	size_t i;
+	unsigned char c;
+
+	dest[out++] = '"';
+	for (i = 0; i < len && src[i] != '\0'; i++) {
+		c = (unsigned char)src[i];
+		if (c == '"' || c == '\\') {
+			dest[out++] = '\\';
+			dest[out++] = c;
+		}
+		else if (c < ' ') {
+			dest[out++] = '\\';
+			dest[out++] = 'u';
+			dest[out++] = '0';
+			dest[out++] = '0';
+			dest[out++] = hex[c >> 4];
+			dest[out++] = hex[c & 0xf];
+		}
+		else {
+			dest[out++] = c;
+		}
+	}
+	dest[out++] = '"';
+	return out;
+}
+
+/* Writes at most len characters of src as a CSV field, quoting it only
+ * if it contains a comma, quote, or line break. Returns the number of
+ * characters written, which is at most 2 * len + 2. */
+size_t formatCsvString(char *dest, const char *src, size_t len) {
+	size_t out = 0;
+	size_t i;
+
+	len = strnlen(src, len);
+	if (strcspn(src, ",\"\r\n") >= len) {
+		memcpy(dest, src, len);
+		return len;
+	}
+	dest[out++] = '"';
+	for (i = 0; i < len; i++) {
+		if (src[i] == '"') {
+			dest[out++] = '"';
+		}
+		dest[out++] = src[i];
+	}
+	dest[out++] = '"';
+	return out;
+}
+
+/* Copies a null-terminated string without its null byte */
+size_t formatLiteral(char *dest, const char *src) {
+	size_t len = strlen(src);
+
+	memcpy(dest, src, len);
+	return len;
+}
+
+/* Writes a mode as MODE_DIGITS octal digits */
+size_t formatMode(char *dest, unsigned long mode) {
+	int i;
+
+	for (i = 0; i < MODE_DIGITS; i++) {
+		dest[i] = '0' + ((mode >> (3 * (MODE_DIGITS - 1 - i))) & 07);
+	}
+	return MODE_DIGITS;
+}
+
+/* Writes a member as one JSON object and a newline into line, which
+ * must hold at least RECORD_MAX_LEN characters, and returns its
+ * length. offset is where the member's header starts in the archive;
+ * its data starts one block later. */
+size_t formatJsonRecord(Header *header, char *name, unsigned long offset,
+		char *line) {
+	size_t len = 0;
+	const char *type = typeName(*header->typeflag);
+
+	len += formatLiteral(line + len, "{\"name\":");
+	len += formatJsonString(line + len, name, PATH_LIMIT);
+	len += formatLiteral(line + len, ",\"type\":");
+	len += formatJsonString(line + len, type, strlen(type));
+	len += formatLiteral(line + len, ",\"mode\":\"");
+	len += formatMode(line + len, parseOctal(header->mode, MODE_SIZE));
+	len += formatLiteral(line + len, "\",\"uid\":");
+	len += formatUint(line + len, getHeaderId(header->uid, UID_SIZE), 0);
+	len += formatLiteral(line + len, ",\"gid\":");
+	len += formatUint(line + len, getHeaderId(header->gid, GID_SIZE), 0);
+	len += formatLiteral(line + len, ",\"uname\":");
+	len += formatJsonString(line + len, header->uname, UNAME_SIZE);
+	len += formatLiteral(line + len, ",\"gname\":");
+	len += formatJsonString(line + len, header->gname, GNAME_SIZE);
+	len += formatLiteral(line + len, ",\"size\":");
+	len += formatUint(line + len, parseOctal(header->size, SIZE_SIZE), 0);
+	len += formatLiteral(line + len, ",\"mtime\":");
+	len += formatUint(line + len, 
+			parseOctal(header->mtime, MTIME_SIZE), 0);
+	len += formatLiteral(line + len, ",\"linkname\":");
+	len += formatJsonString(line + len, header->linkname, LINKNAME_SIZE);
+	len += formatLiteral(line + len, ",\"header_offset\":");
+	len += formatUint(line + len, offset, 0);
+	len += formatLiteral(line + len, ",\"data_offset\":");
+	len += formatUint(line + len, offset + BLOCK_SIZE, 0);
+	len += formatLiteral(line + len, "}\n");
+	return len;
+}
+
+/* Same as formatJsonRecord, but as a CSV row with the columns of
+ * CSV_COLUMNS */
+size_t formatCsvRecord(Header *header, char *name, unsigned long offset,
+		char *line) {
+	size_t len = 0;
+	const char *type = typeName(*header->typeflag);
+
+	len += formatCsvString(line + len, name, PATH_LIMIT);
+	line[len++] = ',';
+	len += formatLiteral(line + len, type);
+	line[len++] = ',';
+	len += formatMode(line + len, parseOctal(header->mode, MODE_SIZE));
+	line[len++] = ',';
+	len += formatUint(line + len, getHeaderId(header->uid, UID_SIZE), 0);
+	line[len++] = ',';
+	len += formatUint(line + len, getHeaderId(header->gid, GID_SIZE), 0);
+	line[len++] = ',';
+	len += formatCsvString(line + len, header->uname, UNAME_SIZE);
+	line[len++] = ',';
+	len += formatCsvString(line + len, header->gname, GNAME_SIZE);
+	line[len++] = ',';
+	len += formatUint(line + len, parseOctal(header->size, SIZE_SIZE), 0);
+	line[len++] = ',';
+	len += formatUint(line + len, 
+			parseOctal(header->mtime, MTIME_SIZE), 0);
+	line[len++] = ',';
+	len += formatCsvString(line + len, header->linkname, LINKNAME_SIZE);
+	line[len++] = ',';
+	len += formatUint(line + len, offset, 0);
+	line[len++] = ',';
+	len += formatUint(line + len, offset + BLOCK_SIZE, 0);
+	line[len++] = '\n';
+	return len;
+}
@@ -0,0 +1,36 @@
+#ifndef FORMATH
+#define FORMATH
+
+#include <stddef.h>
+#include <time.h>
+
+#include "header.h"
+#include "mytar.h"
+
+/* State for formatting listing lines by hand instead of through
+ * printf and localtime for every member. */
+typedef struct format {
+	/* The 9 rwx characters for every combination of permission bits */
+	char perms[PERMS_COMBOS][PERMS_WIDTH - 1];
+	/* The local day that was last formatted, as the range of times
+	 * [day_start, day_end) it covers and its "YYYY-MM-DD" */
+	time_t day_start;
+	time_t day_end;
+	char date[DATE_WIDTH];
+} Format;
+
+void initFormat(Format *);
+void formatTwo(char *, int);
+size_t formatUint(char *, unsigned long, int);
+size_t formatMtime(Format *, time_t, char *);
+size_t formatVerbose(Format *, Header *, char *, char *);
+size_t formatName(char *, char *);
+const char *typeName(char);
+size_t formatJsonString(char *, const char *, size_t);
+size_t formatCsvString(char *, const char *, size_t);
+size_t formatLiteral(char *, const char *);
+size_t formatMode(char *, unsigned long);
+size_t formatJsonRecord(Header *, char *, unsigned long, char *);
+size_t formatCsvRecord(Header *, char *, unsigned long, char *);
+
+#endif
@@ -0,0 +1,156 @@
+#include <string.h>
+
+#include "hash.h"
+
+/* The XXH64 primes */
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+#define STRIPE 32
+
+static uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+/* Little endian loads, whatever the host is. Compilers turn these into
+ * plain loads on little endian machines. */
+static uint64_t read64(const unsigned char *p) {
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+		(uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+		(uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+		(uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t read32(const unsigned char *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input) {
+	acc += input * PRIME2;
+	acc = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+	acc ^= round64(0, lane);
+	return acc * PRIME1 + PRIME4;
+}
+
+/* Runs every whole stripe of data through the lanes, returning how
+ * many bytes were used */
+static size_t consumeStripes(uint64_t *lanes, const unsigned char *data,
+		size_t len) {
+	size_t i;
+	uint64_t v1 = lanes[0];
+	uint64_t v2 = lanes[1];
+	uint64_t v3 = lanes[2];
+	uint64_t v4 = lanes[3];
+
+	for (i = 0; i + STRIPE <= len; i += STRIPE) {
+		v1 = round64(v1, read64(data + i));
+		v2 = round64(v2, read64(data + i + 8));
+		v3 = round64(v3, read64(data + i + 16));
+		v4 = round64(v4, read64(data + i + 24));
+	}
+	lanes[0] = v1;
+	lanes[1] = v2;
+	lanes[2] = v3;
+	lanes[3] = v4;
+	return i;
+}
+
+/* Starts a hash with a seed of 0 */
+void hashInit(HashState *state) {
+	state->lanes[0] = PRIME1 + PRIME2;
+	state->lanes[1] = PRIME2;
+	state->lanes[2] = 0;
+	state->lanes[3] = -PRIME1;
+	state->total = 0;
+	state->buf_len = 0;
+	return;
+}
+
+/* Adds len more bytes of data to the hash */
+void hashUpdate(HashState *state, const void *data, size_t len) {
+	const unsigned char *p = data;
+	size_t fill;
+	size_t used;
+
+	state->total += len;
+	/* Finish off a stripe left over from the last update */
+	if (state->buf_len) {
+		fill = STRIPE - state->buf_len;
+		if (fill > len) {
+			fill = len;
+		}
+		memcpy(state->buf + state->buf_len, p, fill);
+		state->buf_len += fill;
+		p += fill;
+		len -= fill;
+		if (state->buf_len < STRIPE) {
+			return;
+		}
+		consumeStripes(state->lanes, state->buf, STRIPE);
+		state->buf_len = 0;
+	}
+	used = consumeStripes(state->lanes, p, len);
+	memcpy(state->buf, p + used, len - used);
+	state->buf_len = len - used;
+	return;
+}
+
+/* Returns the hash of everything added so far */
+uint64_t hashDigest(HashState *state) {
+	uint64_t h;
+	const unsigned char *p = state->buf;
+	const unsigned char *end = state->buf + state->buf_len;
+
+	if (state->total >= STRIPE) {
+		h = rotl(state->lanes[0], 1) + rotl(state->lanes[1], 7) +
+			rotl(state->lanes[2], 12) + rotl(state->lanes[3], 18);
+		h = mergeRound(h, state->lanes[0]);
+		h = mergeRound(h, state->lanes[1]);
+		h = mergeRound(h, state->lanes[2]);
+		h = mergeRound(h, state->lanes[3]);
+	}
+	else {
+		h = PRIME5;
+	}
+	h += state->total;
+
+	while (p + 8 <= end) {
+		h ^= round64(0, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= *p * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+/* Hashes len bytes of data in one go */
+uint64_t hashBuffer(const void *data, size_t len) {
+	HashState state;
+
+	hashInit(&state);
+	hashUpdate(&state, data, len);
+	return hashDigest(&state);
+}
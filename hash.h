@@ -0,0 +1,23 @@
+#ifndef HASHH
+#define HASHH
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A running XXH64 hash of a member's contents, fed as the contents are
+ * read so nothing has to be read twice. Stripes of 32 bytes go through
+ * four independent lanes; whatever is left of a stripe waits in buf
+ * for the next update. */
+typedef struct hashstate {
+	uint64_t lanes[4];
+	uint64_t total;
+	unsigned char buf[32];
+	size_t buf_len;
+} HashState;
+
+void hashInit(HashState *);
+void hashUpdate(HashState *, const void *, size_t);
+uint64_t hashDigest(HashState *);
+uint64_t hashBuffer(const void *, size_t);
+
+#endif
@@ -31,6 +31,8 @@
 #define REG_FLAG '0'
 #define SYM_FLAG '2'
 #define DIR_FLAG '5'
+/* A PAX extended header, whose records apply to the next member */
+#define PAX_FLAG 'x'
 
 #define CHKSUM_OFFSET 148
 
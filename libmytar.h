@@ -0,0 +1,227 @@
+#ifndef LIBMYTARH
+#define LIBMYTARH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "header.h"
+#include "mytar.h"
+
+/* libmytar reads and writes ustar archives through a descriptor the
+ * caller opened, without printing anything or exiting. Every call
+ * returns MT_OK or one of the codes below, which mtStrerror describes,
+ * so a service can go through any number of archives in one process.
+ * The mytar command is built on top of it. */
+
+#define MT_OK 0
+/* The end of archive marker, or the end of the file, was reached */
+#define MT_END 1
+/* A read or write failed, errno says why */
+#define MT_ERR_IO -1
+#define MT_ERR_CHKSUM -2
+#define MT_ERR_MAGIC -3
+/* The checks done with MT_STRICT */
+#define MT_ERR_VERSION -4
+#define MT_ERR_BADUID -5
+#define MT_ERR_BADGID -6
+/* The member's name is longer than PATH_LIMIT. It can still be
+ * skipped or read. */
+#define MT_ERR_TOOLONG -7
+#define MT_ERR_TRUNCATED -8
+#define MT_ERR_NOMEM -9
+/* Called at the wrong point, like writing contents with no member
+ * begun */
+#define MT_ERR_STATE -10
+/* More or less contents were written than the member's size */
+#define MT_ERR_SIZE -11
+/* Values too big for their fields, which MT_STRICT writers refuse
+ * instead of storing them as special ints */
+#define MT_ERR_BIGUID -12
+#define MT_ERR_BIGGID -13
+#define MT_ERR_BIGSIZE -14
+#define MT_ERR_BIGMTIME -15
+/* The next volume of a split archive doesn't carry on the member the
+ * last one ended in */
+#define MT_ERR_VOLUME -16
+/* Volumes have to be whole blocks and at least MT_MIN_VOLUME bytes */
+#define MT_ERR_VOLSIZE -17
+/* An MtSink's write refused the contents it was given */
+#define MT_ERR_SINK -18
+
+/* Flags for mtReaderInit and mtWriterInit */
+/* Hold headers to the ustar spec exactly, like -S */
+#define MT_STRICT 1
+
+/* The smallest volume a split archive can have, one tar record, which
+ * leaves room for a member's continuation headers and some contents */
+#define MT_MIN_VOLUME (20 * BLOCK_SIZE)
+/* The PAX record at the start of a volume saying how far into the
+ * member it continues the contents pick up */
+#define MT_VOLUME_KEY "MYTAR.volume.offset"
+
+/* Called when a split archive needs its next volume, numbered from 1
+ * for the first. fd is the volume that's done, which the callback is
+ * free to close. Returns the next volume's descriptor, or -1 with errno
+ * set, ENOENT meaning a reader has run out of volumes. */
+typedef int (*MtVolumeFn)(void *, int, int);
+
+/* A member of an archive. The reader fills in every field, the raw
+ * header included. The writer only looks at the decoded fields. */
+typedef struct mtentry {
+	char name[PATH_LIMIT + 1];
+	char linkname[LINKNAME_SIZE + 1];
+	char uname[UNAME_SIZE + 1];
+	char gname[GNAME_SIZE + 1];
+	/* REG_FLAG, DIR_FLAG, SYM_FLAG, or whatever the header had */
+	char type;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	uint64_t size;
+	time_t mtime;
+	/* Where its header is in the archive */
+	off_t offset;
+	/* A PAX header gave it a content checksum */
+	int has_checksum;
+	uint64_t checksum;
+	Header header;
+} MtEntry;
+
+/* Reads an archive front to back. mtReaderNext returns each member in
+ * turn, after which its contents can be read with mtReaderRead, or
+ * left alone, in which case the next call skips them. PAX headers are
+ * read for the members they describe and never returned. */
+typedef struct mtreader {
+	int fd;
+	int flags;
+	/* Where the next byte will be read from */
+	off_t offset;
+	/* Contents of the current member not read yet, and the padding
+	 * after them */
+	uint64_t left;
+	uint64_t pad;
+	/* Zero blocks in a row, two of which end the archive */
+	int zeros;
+	int done;
+	/* The descriptor is a pipe or socket, so skipping reads */
+	int no_seek;
+	/* The archive is mapped, see mtReaderMap, and blocks are copied
+	 * out of the mapping instead of read from the descriptor */
+	const unsigned char *map;
+	off_t map_size;
+	/* A checksum waiting for the member its PAX header came before */
+	int has_pending;
+	uint64_t pending;
+	/* For split archives, see mtReaderVolumes, or NULL */
+	MtVolumeFn next_volume;
+	void *volume_arg;
+	int volume;
+	/* The current volume's size */
+	off_t volume_end;
+	/* The current member's size and header, which a continuation in
+	 * the next volume has to match */
+	uint64_t size;
+	Header member;
+	char block[BLOCK_SIZE];
+} MtReader;
+
+/* Appends members to an archive. Each one is begun with its entry,
+ * given its contents with any number of mtWriterWrite calls, and ended
+ * with mtWriterEnd. Contents are written straight through in whole
+ * blocks; only a partial block waits in tail. */
+typedef struct mtwriter {
+	int fd;
+	int flags;
+	/* Where the next byte will be written in fd */
+	off_t offset;
+	/* A member has been begun and not ended */
+	int in_entry;
+	/* Contents of the current member still to be written */
+	uint64_t left;
+	char tail[BLOCK_SIZE];
+	size_t tail_len;
+	/* For split archives, see mtWriterSplit. volume_size is 0 for an
+	 * archive that isn't split. */
+	uint64_t volume_size;
+	MtVolumeFn next_volume;
+	void *volume_arg;
+	int volume;
+	/* The current member's header, and how many bytes of its contents
+	 * have gone out, for continuing it in the next volume */
+	Header member;
+	uint64_t size;
+	uint64_t written;
+} MtWriter;
+
+/* Where mtReaderExtract sends a member's contents. write is called
+ * with arg and each piece of the contents in order, and returns 0, or
+ * -1 to stop. mtSinkMemory makes one that collects them in an
+ * MtBuffer. */
+typedef struct mtsink {
+	int (*write)(void *, const void *, size_t);
+	void *arg;
+} MtSink;
+
+/* Contents collected by a memory sink. len goes back to 0 to reuse it
+ * for the next member. */
+typedef struct mtbuffer {
+	char *data;
+	size_t len;
+	size_t cap;
+} MtBuffer;
+
+/* Columns decoded from a run of header blocks by mtDecodeHeaders, with
+ * one row per block whether or not it's a header, so row i is the
+ * block at i * BLOCK_SIZE. Keeping each field in an array of its own
+ * lets index builders and scans go through millions of members without
+ * touching the blocks again. */
+typedef struct mtheaderbatch {
+	/* Rows filled in, and how many there's room for */
+	size_t count;
+	size_t cap;
+	/* 1 where the block has the ustar magic and a right checksum. The
+	 * other columns are only filled in for those rows. */
+	unsigned char *valid;
+	char *type;
+	mode_t *mode;
+	uint64_t *size;
+	time_t *mtime;
+} MtHeaderBatch;
+
+const char *mtStrerror(int);
+int mtStrictCheck(Header *);
+int mtParseChecksum(const char *, size_t, uint64_t *);
+
+void mtReaderInit(MtReader *, int, int);
+int mtReaderNext(MtReader *, MtEntry *);
+ssize_t mtReaderRead(MtReader *, void *, size_t);
+void mtReaderAdvance(MtReader *, uint64_t);
+int mtReaderSkip(MtReader *);
+int mtReaderRecover(MtReader *, off_t *, off_t *);
+int mtReaderVolumes(MtReader *, MtVolumeFn, void *);
+int mtReaderSeek(MtReader *, int, off_t);
+int mtReaderMap(MtReader *, const void *, off_t);
+int mtReaderExtract(MtReader *, MtSink *);
+void mtSinkMemory(MtSink *, MtBuffer *);
+int mtBufferWrite(void *, const void *, size_t);
+void mtBufferFree(MtBuffer *);
+
+void mtBatchInit(MtHeaderBatch *);
+void mtBatchFree(MtHeaderBatch *);
+int mtDecodeHeaders(MtHeaderBatch *, const void *, size_t);
+
+void mtWriterInit(MtWriter *, int, int);
+int mtWriterSplit(MtWriter *, uint64_t, MtVolumeFn, void *);
+int mtWriterResume(MtWriter *, int, off_t);
+int mtEntryFromStat(MtEntry *, const char *, struct stat *);
+int mtEntryFromStatat(MtEntry *, const char *, int, const char *, 
+		struct stat *);
+int mtBuildHeader(MtWriter *, MtEntry *);
+int mtWriterBegin(MtWriter *, MtEntry *);
+int mtWriterWrite(MtWriter *, const void *, size_t);
+int mtWriterEnd(MtWriter *);
+int mtWriterClose(MtWriter *);
+
+#endif
@@ -1,3 +1,6 @@
+/* fwrite_unlocked is a GNU extension */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -10,326 +13,210 @@
 #include "header.h"
 #include "utilities.h"
 #include "mytar.h"
+#include "filter.h"
+#include "arena.h"
+#include "format.h"
+#include "stats.h"
+#include "scan.h"
+#include "cache.h"
+#include "list.h"
+#include "libmytar.h"
+#include "volume.h"
 
-/* Gets the of a file given its corresponding header */
-char *getPerms(Header *header, char *perms) {
-	long int h_mode = strtol(header->mode, NULL, OCTAL_BASE);
-
-	/* Check type of file */
-	if (*header->typeflag == REG_FLAG) {
-		perms[TYPE_INDEX] = '-';
-	}
-	else if (*header->typeflag == DIR_FLAG) {
-		perms[TYPE_INDEX] = 'd';
-	}
-	else if (*header->typeflag == SYM_FLAG) {
-		perms[TYPE_INDEX] = 'l';
-	}
+/* Prints out permissions, owner/group, size, mtime,
+ * and name fields of a file if verbose was set. The line is
+ * formatted by hand into arena memory and written in one go. */
+void printVerbose(Format *fmt, Header *header, char *name, Arena *arena) {
+	char *line = arenaAlloc(arena, LINE_MAX_LEN);
+	size_t len = formatVerbose(fmt, header, name, line);
 
-	/* User permissions */
-	if (h_mode & S_IRUSR) {
-		perms[USR_R] = 'r';
-	}
-	else {
-		perms[USR_R] = '-';
-	}
-	if (h_mode & S_IWUSR) {
-		perms[USR_W] = 'w';
-	}
-	else {
-		perms[USR_W] = '-';
-	}
-	if (h_mode & S_IXUSR) {
-		perms[USR_X] = 'x';
-	}
-	else {
-		perms[USR_X] = '-';
-	}
+	fwrite_unlocked(line, 1, len, stdout);
+	return;
+}
 
-	/* Group permissions */
-	if (h_mode & S_IRGRP) {
-		perms[GRP_R] = 'r';
-	}
-	else {
-		perms[GRP_R] = '-';
-	}
-	if (h_mode & S_IWGRP) {
-		perms[GRP_W] = 'w';
-	}
-	else {
-		perms[GRP_W] = '-';
-	}
-	if (h_mode & S_IXGRP) {
-		perms[GRP_X] = 'x';
-	}
-	else {
-		perms[GRP_X] = '-';
-	}
+/* Prints a member as a JSON Lines or CSV record, see formatJsonRecord */
+void printRecord(Header *header, char *name, unsigned long offset,
+		int list_format, Arena *arena) {
+	char *line = arenaAlloc(arena, RECORD_MAX_LEN);
+	size_t len;
 
-	/* Other permissions */
-	if (h_mode & S_IROTH) {
-		perms[OTH_R] = 'r';
-	}
-	else {
-		perms[OTH_R] = '-';
-	}
-	if (h_mode & S_IWOTH) {
-		perms[OTH_W] = 'w';
-	}
-	else {
-		perms[OTH_W] = '-';
-	}
-	if (h_mode & S_IXOTH) {
-		perms[OTH_X] = 'x';
+	if (list_format == LIST_CSV) {
+		len = formatCsvRecord(header, name, offset, line);
 	}
 	else {
-		perms[OTH_X] = '-';
+		len = formatJsonRecord(header, name, offset, line);
 	}
-	perms[PERMS_WIDTH] = '\0';
-	return perms;
+	fwrite_unlocked(line, 1, len, stdout);
+	return;
 }
 
-/* Prints out permissions, owner/group, size, mtime,
- * and name fields of a file if verbose was set. */
-void printVerbose(Header *header, char *name) {
-	char perms[PERMS_WIDTH + 1];
-	char *owngrp;
-	long int size = 0;
-	char mtime[MTIME_WIDTH + 1];
-	time_t header_mtime = 0;
-	struct tm *time;
-	int year = 0;
-	int month = 0;
-	int day = 0;
-	int hour = 0;
-	int minute = 0;
-	/* The length of the uname, gname, a slash character, and 
-	 * null-terminating character. */
-	size_t owngrp_size = strnlen(header->uname, UNAME_SIZE) + 
-		strnlen(header->gname, GNAME_SIZE) +
-		1 + 1;
-
-	time = malloc(sizeof(struct tm) * 1);
-	if (!time) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
-	}
-	owngrp = calloc(owngrp_size, sizeof(char));
-	if (!owngrp) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
-	/* Sets the permissions field */
-	getPerms(header, perms);
-	/* Copies over at most, 18 bytes (the last byte being a null
-	 * character. First, as much of the uname will be copied over, 
-	 * then if there is still space, a slash is added, then if 
-	 * there is still space, as much of the gname */
-	snprintf(owngrp, owngrp_size, 
-					"%s/%s", 
-					header->uname, 
-					header->gname);
-	/* Get the size of the file */
-	size = strtol(header->size, NULL, OCTAL_BASE);
+/* Prints just the name of a file */
+void printName(char *name, Arena *arena) {
+	char *line = arenaAlloc(arena, PATH_LIMIT + 2);
+	size_t len = formatName(line, name);
 
-	/* Convert the header->mtime to a long int via strtol, then type 
-	 * cast that to time_t */
-	header_mtime = (time_t)strtol(header->mtime, NULL, OCTAL_BASE);
-	time = localtime(&header_mtime);
-	year = REL_YEAR + time->tm_year;
-	month = JANUARY + time->tm_mon;
-	day = time->tm_mday;
-	hour = time->tm_hour;
-	minute = time->tm_min;
-	snprintf(mtime, MTIME_WIDTH + 1, "%04d-%02d-%02d %02d:%02d", 
-			year, month, day, hour, minute);
-	/* Print out every field */
-	printf("%10s %-17s %8ld %16s %s\n", perms, owngrp, size, mtime, name);
+	fwrite_unlocked(line, 1, len, stdout);
 	return;
 }
 
 
-/* Lists the contents of an archive. 
- * All contents are listed if no path(s) are given, otherwise only
- * those paths are listed. */
-void listArchive(int numPaths, char *paths[], int strict, int verbose) {
-	int i, j;
-	/* The number of data blocks to possibly skip over */
-	int num_dblocks = 0;
-	/* This is what the checksum of a given header should be */
-	unsigned int csum;
-	/* This is what the header's checksum is */
-	unsigned int hcsum;
-	/* This is a counter to check end of archive */
-	int eoa = 0;
-	/* The name of a path can be at most 256 chars. */
-	char name[PATH_LIMIT];
-	long int size;
+/* Lists the members of the archive in the file name, going on through
+ * the rest of its volumes with --multi-volume, that the filter
+ * selects. Returns 1 once everything the filter asked for has been
+ * listed. */
+int listMembers(char *prog, char *name, MtEntry *entry, Filter *filter,
+		Format *fmt, Options *opts) {
+	int verbose = opts->verbose;
 	int fdarchive;
-	/* Don't need to calloc since header data will get overwritten with
-	 * archive headers. */
-	Header *header;
+	/* Reads the archive a member at a time */
+	MtReader reader;
+	int status;
+	int done = 0;
+	/* The range of bytes skipped to recover from a damaged header */
+	off_t from;
+	off_t to;
+	/* When the current phase started, for --stats */
+	uint64_t start;
 	/* Flag to signify that we are listing, not extracting since both
-	 * list and extract use the same function, isValid, to see what is
+	 * list and extract use the same function, filterMatch, to see what is
 	 * valid to list/extract. */
 	int t_flag = 1;
+	/* The volumes being read */
+	VolumeSet volumes;
+	/* Scratch memory for every member */
+	Arena arena;
+	ArenaMark mark;
 
-	/* Check if a valid archive was given which is paths[2] */
-
-	header = malloc(sizeof(Header) * 1);
-	if (!header) {
-		perror("malloc");
-		exit(EXIT_FAILURE);
-	}
 	/* Open the archive for reading */
-	fdarchive = open(paths[2], O_RDONLY);
+	fdarchive = statsOpen(name, O_RDONLY, 0);
 	if (fdarchive == -1) {
-		perror(paths[2]);
-		free(header);
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	mtReaderInit(&reader, fdarchive, opts->strict ? MT_STRICT : 0);
+	volumeInit(&volumes, name);
+	if (opts->multi_volume && 
+			mtReaderVolumes(&reader, readVolume, &volumes) != 
+			MT_OK) {
+		perror(name);
 		exit(EXIT_FAILURE);
 	}
+	arenaInit(&arena, ARENA_CHUNK);
+	mark = arenaMark(&arena);
 
-	while (1) {
-		/* Read a header */
-		if (read(fdarchive, header, BLOCK_SIZE) == -1) {
-			perror(paths[2]);
+	while ((status = mtReaderNext(&reader, entry)) != MT_END) {
+		if (status == MT_ERR_IO) {
+			perror(name);
 			exit(EXIT_FAILURE);
 		}
-		/* End of archive reached, return */
-		if (eoa == 2) {
-			return;
-		}
-
-		/* Check if the header's checksum is the same as what the
-		 * checksum should actually be */
-		csum = getChksum(header);
-		hcsum = strtol(header->chksum, NULL, OCTAL_BASE);
-		/* Checksums don't match */
-		if (csum != hcsum) {
-			/* Potentially end of archive */
-			if (csum == 256) {
-				for (j = 0; j < BLOCK_SIZE; j++) {
-					if (((unsigned char *)header)[j] != 
-							'\0') {
-						fprintf(stderr, 
-								"Incorrect "
-								"header "
-								"checksum\n");
-						free(header);
-						exit(EXIT_FAILURE);
-					}
-				}
-				/* Increment the eoa counter */
-				eoa += 1;
-				continue;
-			}
-			else {
-				fprintf(stderr, "Incorrect header checksum\n");
-				free(header);
-				exit(EXIT_FAILURE);
-			}
-		}
-		else {
-			/* Reset the eoa counter */
-			eoa = 0;
-		}
-
-		/* Strict is set so check magic and version */
-		if (strict) {
-			strictCheck(header);	
+		/* The member is still there, it just can't be listed */
+		if (status == MT_ERR_TOOLONG) {
+			fprintf(stderr, "%s\n", mtStrerror(status));
+			continue;
 		}
-		/* Not strict so just check if magic field is ustar */
-		else {
-			if (strncmp(header->magic, "ustar", 
-						MAGIC_SIZE - 1) != 0) {
-				fprintf(stderr, "Header magic field "
-						"not valid\n");
-				free(header);
+		if (status != MT_OK) {
+			fprintf(stderr, "%s\n", mtStrerror(status));
+			if (!opts->recover || status == MT_ERR_TRUNCATED) {
 				exit(EXIT_FAILURE);
 			}
-		}
-
-		/* Get the size of the file */
-		size = strtol(header->size, NULL, OCTAL_BASE);
-
-		/* Using strnlen, strncpy, and strncat because we can't
-		 * assume that the name or prefix is null-terminated. */
-		/* Check if path would be too long */
-		if (strnlen(header->name, NAME_SIZE) + 1 +
-				strnlen(header->prefix, PREFIX_SIZE) > 
-				PATH_LIMIT) {
-			fprintf(stderr, "path too long\n");
-			free(header);
+			status = mtReaderRecover(&reader, &from, &to);
+			reportRecover(prog, status, from, to);
 			continue;
 		}
-		/* Construct name */
-		/* No prefix, so entire name is just in name field */
-		if (header->prefix[0] == '\0') {	
-			strncpy(name, header->name, NAME_SIZE);
-		}
-		/* Prefix exists */
-		else {
-			/* Copy over the prefix to name */
-			strncpy(name, header->prefix, PREFIX_SIZE);
-			/* Append a '/' */
-			strcat(name, "/");
-			/* Append the name field to name */
-			strncat(name, header->name, NAME_SIZE);
-		}
 
-		/* No paths were given, so print the entire archive. */
-		if (numPaths < 4) {
+		/* From the mytar demo, entries are listed in the order 
+		 * they appear in the archive, not the order in which they 
+		 * were passed as arguments. */
+		statsEntry(entry->size);
+		if (filterMatch(filter, entry->name, 
+					entry->type == DIR_FLAG, t_flag)) {
+			start = statsStart();
+			/* Structured records always have every field */
+			if (opts->list_format != LIST_TEXT) {
+				printRecord(&entry->header, entry->name, 
+						entry->offset, 
+						opts->list_format, &arena);
+			}
 			/* Verbose set */
-			if (verbose) {
-				printVerbose(header, name);
+			else if (verbose) {
+				printVerbose(fmt, &entry->header, 
+						entry->name, &arena);
 			}
 			/* Verbose not set */
 			else {
-				printf("%s\n", name);
-			}
-		}	
-		/* Paths were given */
-		else {
-			/* From the mytar demo, entries are listed in the 
-			 * order they appear in the archive, not the order 
-			 * in which they were passed as arguments. */
-			for (i = ARG_START; i < numPaths; i++) {
-				/* Check if one of the given path is 
-				 * the same as the current header. */
-				if (isValid(name, paths[i], t_flag)) {
-					/* Verbose set */
-					if (verbose) {
-						printVerbose(header, name);
-						break;
-					}
-					/* Verbose not set */
-					else {
-						printf("%s\n", name);
-						break;
-					}
-				}
+				printName(entry->name, &arena);
 			}
+			arenaRelease(&arena, mark);
+			statsAdd(STAT_PRINT, start, 0);
 		}
-		/* Checks if the file has contents */
-		if (size > 0) {
-			/* Gets the ceiling of dividing the size with 512 
-			 * which results in the number of blocks we need to 
-			 * skip over to reach the next header */
-			num_dblocks = size/BLOCK_SIZE + 
-				(size % BLOCK_SIZE != 0);
-			/* Skips over the contents */
-			if (lseek(fdarchive, 
-					  BLOCK_SIZE * num_dblocks, 
-					  SEEK_CUR) 
-					  == -1) {
-				perror("lseek");
-				/* if lseek fails, then the next header read 
-				 * will fail anyway */
-			}
+		/* The contents are skipped by the next mtReaderNext, so
+		 * drop up to where they end */
+		cacheDrop(&volumes.cache, reader.fd, reader.offset + 
+				reader.left + reader.pad);
+		/* Everything that was asked for has been listed */
+		if (filterDone(filter)) {
+			done = 1;
+			break;
 		}
 	}
-	free(header);
-	close(fdarchive);
-	return;
+	cacheDone(&volumes.cache, reader.fd);
+	if (opts->alloc_stats) {
+		arenaReport(&arena, prog);
+	}
+	arenaFree(&arena);
+	close(reader.fd);
+	return done;
 }
 
+/* Lists the contents of an archive. 
+ * All contents are listed if no path(s) are given, otherwise only
+ * those paths are listed. With --stripes each stripe is listed in
+ * turn. */
+void listArchive(int numPaths, char *paths[], Options *opts) {
+	MtEntry *entry;
+	int i;
+	int num_stripes = opts->stripes > 1 ? opts->stripes : 1;
+	int done = 0;
+	char *name;
+	/* The path arguments and excludes, compiled once */
+	Filter filter;
+	/* Permission table and date cache for verbose lines */
+	Format fmt;
+	/* Holds the listing until it's big enough to be worth a write. 
+	 * It's static since stdio can still flush it during exit. */
+	static char out_buf[LIST_BUF_SIZE];
+
+	/* Several threads scan the archive instead, which needs it to be
+	 * one file */
+	if (opts->jobs > 1 && !opts->multi_volume && num_stripes == 1) {
+		listParallel(numPaths, paths, opts);
+		return;
+	}
+
+	entry = malloc(sizeof(MtEntry));
+	if (!entry) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	compileFilter(&filter, numPaths, paths, opts);
+	initFormat(&fmt);
+	/* Terminals stay line buffered so the listing shows up as it 
+	 * goes */
+	if (!isatty(STDOUT_FILENO)) {
+		setvbuf(stdout, out_buf, _IOFBF, LIST_BUF_SIZE);
+	}
+	if (opts->list_format == LIST_CSV) {
+		fputs(CSV_COLUMNS, stdout);
+	}
+
+	for (i = 1; i <= num_stripes && !done; i++) {
+		name = volumeName(paths[TAR_INDEX], i);
+		done = listMembers(paths[0], name, entry, &filter, &fmt, 
+				opts);
+		free(name);
+	}
+	fflush(stdout);
+	freeFilter(&filter);
+	free(entry);
+	return;
+}
@@ -2,9 +2,17 @@
 #define LISTH
 
 #include "header.h"
+#include "options.h"
+#include "arena.h"
+#include "format.h"
+#include "filter.h"
+#include "libmytar.h"
 
-void printVerbose(Header *, char *);
-char *getPerms(Header *, char *);
-void listArchive(int, char **, int, int);
+void printVerbose(Format *, Header *, char *, Arena *);
+void printRecord(Header *, char *, unsigned long, int, Arena *);
+void printName(char *, Arena *);
+int listMembers(char *, char *, MtEntry *, Filter *, Format *, 
+		Options *);
+void listArchive(int, char **, Options *);
 
 #endif
@@ -6,6 +6,13 @@
 #include "create.h"
 #include "list.h"
 #include "extract.h"
+#include "options.h"
+#include "stats.h"
+#include "verify.h"
+#include "compare.h"
+#include "serve.h"
+#include "cache.h"
+#include "throttle.h"
 #include "mytar.h"
 
 int main(int argc, char *argv[]) {
@@ -14,16 +21,42 @@ int main(int argc, char *argv[]) {
 	int c_flag = 0;
 	int t_flag = 0;
 	int x_flag = 0;
+	int d_flag = 0;
 	int v_flag = 0;
 	int f_flag = 0;
 	int s_flag = 0;
-	/* Represents, uniquely, how many of the c, t, and x 
+	int o_flag = 0;
+	/* Represents, uniquely, how many of the c, t, x, and d 
 	 * flags are set */
 	int req_flags = 0;
 	int unique_flags = 0;
+	Options opts;
+	/* Members that failed --verify or differ */
+	size_t failed = 0;
+
+	memset(&opts, 0, sizeof(Options));
+	/* Stop at the first occurrence of every named member */
+	opts.occurrence = 1;
+	/* Long options can go anywhere, so take them out first */
+	argc = parseLongOptions(argc, argv, &opts);
+	/* The server takes no archive or paths, just requests */
+	if (opts.serve) {
+		if (argc > 1) {
+			fprintf(stderr, "usage: %s --serve=socket "
+					"[--serve-root=dir] [--cache-size=size]"
+					"\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		if (opts.stats) {
+			statsInit(argv[0], opts.stats_interval);
+		}
+		i = serveArchives(argv[0], &opts);
+		freeOptions(&opts);
+		return i;
+	}
 
 	if (argc < 3) {
-		fprintf(stderr, "usage: %s [ctxvS]f tarfile "
+		fprintf(stderr, "usage: %s [ctxdvOS]f tarfile "
 				"[ path [ ... ] ]\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
@@ -51,6 +84,13 @@ int main(int argc, char *argv[]) {
 			}
 			x_flag += 1;
 		}
+		else if (argv[OPTS_INDEX][i] == 'd') {
+			if (d_flag == 0) {
+				req_flags += 1;
+				unique_flags += 1;
+			}
+			d_flag += 1;
+		}
 		else if (argv[OPTS_INDEX][i] == 'v') {
 			if (v_flag == 0) {
 				unique_flags += 1;
@@ -69,38 +109,44 @@ int main(int argc, char *argv[]) {
 			}
 			s_flag += 1;
 		}
+		else if (argv[OPTS_INDEX][i] == 'O') {
+			if (o_flag == 0) {
+				unique_flags += 1;
+			}
+			o_flag += 1;
+		}
 		else {
-			fprintf(stderr, "usage: %s [ctxvS]f tarfile "
+			fprintf(stderr, "usage: %s [ctxdvOS]f tarfile "
 					"[ path [ ... ] ]\n", argv[0]);
 			exit(EXIT_FAILURE);
 		}
-		/* c, t, and x options can only be set once */
-		if (c_flag > 1 || t_flag > 1 || x_flag > 1) {
+		/* c, t, x, and d options can only be set once */
+		if (c_flag > 1 || t_flag > 1 || x_flag > 1 || d_flag > 1) {
 			fprintf(stderr, "%s: you must choose " 
-					"one of the 'ctx' options.\n"
-					"usage: %s [ctxvS]f tarfile "
+					"one of the 'ctxd' options.\n"
+					"usage: %s [ctxdvOS]f tarfile "
 					"[ path [ ... ] ]\n", 
 					argv[0], argv[0]);
 			exit(EXIT_FAILURE);
 		}	
 	}
 
-	/* Only one of c, t, or x options can be chosen */
+	/* Only one of c, t, x, or d options can be chosen */
 	if (req_flags != NUM_REQ_OPTS) {
 		fprintf(stderr, "%s: you must choose " 
-				"one of the 'ctx' options.\n"
-				"usage: %s [ctxvS]f tarfile "
+				"one of the 'ctxd' options.\n"
+				"usage: %s [ctxdvOS]f tarfile "
 				"[ path [ ... ] ]\n", 
 				argv[0], argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
-	/* Can't have more than 4 options or less than 2 options */
+	/* Can't have more than 5 options or less than 2 options */
 	if (unique_flags > MAX_OPTS || 
 		unique_flags < MIN_OPTS) {
 		fprintf(stderr, "%s: you must choose " 
-				"one of the 'ctx' options.\n"
-				"usage: %s [ctxvS]f tarfile "
+				"one of the 'ctxd' options.\n"
+				"usage: %s [ctxdvOS]f tarfile "
 				"[ path [ ... ] ]\n", 
 				argv[0], argv[0]);
 		exit(EXIT_FAILURE);
@@ -109,8 +155,8 @@ int main(int argc, char *argv[]) {
 	/* f option wasn't given */
 	if (f_flag == 0) {
 		fprintf(stderr, "%s: you must choose " 
-				"one of the 'ctx' options.\n"
-				"usage: %s [ctxvS]f tarfile "
+				"one of the 'ctxd' options.\n"
+				"usage: %s [ctxdvOS]f tarfile "
 				"[ path [ ... ] ]\n", 
 				argv[0], argv[0]);
 		exit(EXIT_FAILURE);
@@ -118,16 +164,69 @@ int main(int argc, char *argv[]) {
 
 	/* After all that checking, if we make it this far, then
 	 * all flags are valid  */
+	opts.strict = s_flag;
+	opts.verbose = v_flag;
+	opts.to_stdout = o_flag;
+	if (opts.stats) {
+		statsInit(argv[0], opts.stats_interval);
+	}
+	cacheInit(opts.no_cache, opts.readahead);
+	if ((opts.read_limit || opts.read_iops || opts.write_limit || 
+				opts.write_iops || opts.throttle_file) && 
+			!c_flag) {
+		fprintf(stderr, "%s: the I/O limits only work with the 'c' "
+				"option\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	throttleInit(argv[0], &opts);
+	if (opts.verify && (x_flag || d_flag)) {
+		fprintf(stderr, "%s: --verify only works with the 'c' or 't' "
+				"options\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (opts.multi_volume && opts.stripes > 1) {
+		fprintf(stderr, "%s: an archive can't be both split into "
+				"volumes and striped\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	/* Those map the archive as a single file */
+	if ((opts.verify || d_flag) && 
+			(opts.multi_volume || opts.stripes > 1)) {
+		fprintf(stderr, "%s: --verify and the 'd' option don't work "
+				"with split or striped archives\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	/* Those are the ones that leave something on disk to sync */
+	if (opts.checkpoint && (!(c_flag || x_flag) || opts.to_stdout)) {
+		fprintf(stderr, "%s: --checkpoint and --resume only work with "
+				"the 'c' or 'x' options, without 'O'\n", 
+				argv[0]);
+		exit(EXIT_FAILURE);
+	}
 	if (c_flag) {
-		createArchive(argc, argv, s_flag, v_flag);
+		createArchive(argc, argv, &opts);
+		/* Read back what was just written */
+		if (opts.verify) {
+			failed = verifyArchive(argv[0], argv[TAR_INDEX], &opts);
+		}
 	}
 	else if (t_flag) {
-		listArchive(argc, argv, s_flag, v_flag);
+		/* Verifying takes the place of listing */
+		if (opts.verify) {
+			failed = verifyArchive(argv[0], argv[TAR_INDEX], &opts);
+		}
+		else {
+			listArchive(argc, argv, &opts);
+		}
 	}
 	else if (x_flag) {
-		extractArchive(argc, argv, s_flag, v_flag);
+		extractArchive(argc, argv, &opts);
+	}
+	else if (d_flag) {
+		failed = compareArchive(argc, argv, &opts);
 	}
 
-	return 0;
+	freeOptions(&opts);
+	return failed ? EXIT_FAILURE : 0;
 }
 
@@ -10,7 +10,7 @@
 /* The index of the options */
 #define OPTS_INDEX 1
 #define NUM_REQ_OPTS 1
-#define MAX_OPTS 4
+#define MAX_OPTS 5
 #define MIN_OPTS 2
 /* The index in argv of the tar file */
 #define TAR_INDEX 2
@@ -31,8 +31,14 @@
 #define OTH_W 8
 #define OTH_X 9
 
+/* Every combination of the 9 rwx permission bits */
+#define PERMS_COMBOS 512
+/* Longest verbose listing line: perms, owner/group, a 64 bit size,
+ * mtime, a full path, and the spaces and newline between them */
+#define LINE_MAX_LEN 512
+
 #define OWNGRP_WIDTH 17
-#define SIZE_WIDTH 8
+#define FSIZE_WIDTH 8
 #define MTIME_WIDTH 16
 
 /* These are for converting the tm struct members into actual numbers.
@@ -41,4 +47,191 @@
  * 1900, respectively, according to the man page. */
 #define JANUARY 1
 #define REL_YEAR 1900
+/* Last year that fits in YYYY */
+#define MAX_YEAR 9999
+/* Length of "YYYY-MM-DD" */
+#define DATE_WIDTH 10
+#define SECS_PER_MIN 60
+#define SECS_PER_HOUR 3600
+#define SECS_PER_DAY 86400
+/* Decimal digits in the largest 64 bit number */
+#define DIGITS_MAX 20
+/* Longest structured listing record, with every string field fully
+ * escaped */
+#define RECORD_MAX_LEN 4096
+/* Octal digits of a mode in structured listings */
+#define MODE_DIGITS 4
+/* Header row of CSV listings */
+#define CSV_COLUMNS "name,type,mode,uid,gid,uname,gname,size,mtime," \
+	"linkname,header_offset,data_offset\n"
+/* Listing formats given with --list-format */
+#define LIST_TEXT 0
+#define LIST_JSON 1
+#define LIST_CSV 2
+/* Length of "--stats=" */
+#define STATS_LEN 8
+#define NANOS_PER_SEC 1000000000ULL
+#define BYTES_PER_MB (1024.0 * 1024.0)
+/* Length of "--progress=" */
+#define PROGRESS_LEN 11
+/* Default seconds between --progress lines */
+#define PROGRESS_INTERVAL 1.0
+/* Sizes of the pieces of a progress line */
+#define PROGRESS_FIELD 32
+#define PROGRESS_UNITS 6
+/* Length of "--jobs=" */
+#define JOBS_LEN 7
+#define MAX_JOBS 256
+/* Bytes each scan thread reads at a time */
+#define SCAN_CHUNK (1 << 20)
+/* Bytes moved at a time when extracting to stdout */
+#define COPY_CHUNK (1 << 20)
+/* Bytes of a member mtReaderExtract reads at a time */
+#define EXTRACT_CHUNK (16 * BLOCK_SIZE)
+/* Bytes of a file each compare thread reads at a time */
+#define COMPARE_CHUNK (1 << 20)
+/* Most bytes of the archive in one region of a parallel listing, and
+ * how many regions per thread can be scanned ahead of the listing */
+#define SCAN_REGION (64 << 20)
+#define SCAN_AHEAD 2
+/* Starting sizes of a region's candidates and of a walk's names */
+#define SCAN_START_CANDS 1024
+#define SCAN_START_POOL 65536
+/* Smallest number of rows mtDecodeHeaders allocates */
+#define BATCH_START 256
+/* Length of "--list-format=" */
+#define LIST_FORMAT_LEN 14
+
+/* stdout buffer for listing when it isn't a terminal */
+#define LIST_BUF_SIZE (1 << 20)
+
+/* Orders files are read in when creating, given with --read-order */
+#define READ_READDIR 0
+#define READ_INODE 1
+#define READ_EXTENT 2
+/* Length of "--read-order=" */
+#define READ_ORDER_LEN 13
+/* Bytes of files read ahead in disk order at a time with --keep-order */
+#define READ_WINDOW (64 << 20)
+/* Length of "--readahead=" */
+#define READAHEAD_LEN 12
+/* Files read ahead with a bare --readahead, and the most allowed */
+#define READAHEAD_FILES 4
+#define MAX_READAHEAD 1024
+/* Bytes read or written between page cache drops with
+ * --no-cache-pollution */
+#define CACHE_WINDOW (8 << 20)
+/* Bytes of directory entries read with each getdents64 call */
+#define DIRENT_BUF (128 << 10)
+/* Starting capacity of a directory's collected entries, and the
+ * average name length their names start out with room for */
+#define ENTRIES_START 64
+#define NAME_START 16
+
+/* Starting capacity of the list of directories awaiting their
+ * metadata after extraction */
+#define DIRLIST_START 64
+/* Starting number of directories the created-directory cache has room
+ * for, and how many of them it keeps descriptors open on */
+#define DIRCACHE_START 64
+#define DIRCACHE_FDS 64
+
+
+/* Length of "--volume-size=" and "--stripes=" */
+#define VOLUME_SIZE_LEN 14
+#define STRIPES_LEN 10
+/* Decimal digits in the biggest volume number */
+#define VOLUME_DIGITS 10
+
+/* Length of "--checkpoint=" */
+#define CHECKPOINT_LEN 13
+/* Default seconds between checkpoints */
+#define CHECKPOINT_INTERVAL 30.0
+/* What's put after an archive's name to name its state file, and after
+ * that for the new one while it's written */
+#define CHECKPOINT_SUFFIX ".checkpoint"
+#define CHECKPOINT_TEMP ".new"
+/* First line of every state file */
+#define CHECKPOINT_MAGIC "mytar checkpoint 1"
+
+/* How --skip-unchanged tells a file on disk is the same as the member:
+ * not at all, by size and mtime, or by the hash of its contents */
+#define SKIP_NONE 0
+#define SKIP_MTIME 1
+#define SKIP_CHECKSUM 2
+/* Length of "--skip-unchanged=" */
+#define SKIP_UNCHANGED_LEN 17
+
+/* Length of "--read-limit=", "--read-iops=", "--write-limit=",
+ * "--write-iops=", and "--throttle-file=" */
+#define READ_LIMIT_LEN 13
+#define READ_IOPS_LEN 12
+#define WRITE_LIMIT_LEN 14
+#define WRITE_IOPS_LEN 13
+#define THROTTLE_FILE_LEN 16
+/* Bytes of a source file read at a time when creating */
+#define FILE_CHUNK (64 << 10)
+/* How much I/O each stripe does before paying for it out of the
+ * shared token buckets, so the limits cost a lock every few hundred
+ * KiB rather than one per block */
+#define THROTTLE_CHUNK (256 << 10)
+#define THROTTLE_OPS 16
+/* Longest wait between looks at the limits, in seconds */
+#define THROTTLE_TICK 0.1
+/* Longest line of a --throttle-file */
+#define THROTTLE_LINE_MAX 256
+
+/* Length of "--serve=", "--cache-size=" and "--serve-root=" */
+#define SERVE_LEN 8
+#define CACHE_SIZE_LEN 13
+#define SERVE_ROOT_LEN 13
+/* Bytes of archive blocks --serve keeps in memory by default */
+#define SERVE_CACHE_SIZE (64 << 20)
+/* Size of each block the server caches */
+#define SERVE_BLOCK (64 << 10)
+/* Members at least this big are sent with sendfile instead of through
+ * the block cache */
+#define SERVE_SENDFILE_MIN (4 * SERVE_BLOCK)
+/* Longest request line, an archive's path, a tab, and a member's name */
+#define SERVE_LINE_MAX (PATH_MAX + PATH_LIMIT + 2)
+/* Longest reply line */
+#define SERVE_REPLY_MAX 128
+#define SERVE_BACKLOG 64
+/* Starting number of members in each archive's index, and of archives */
+#define SERVE_START_MEMBERS 1024
+#define SERVE_START_ARCHIVES 16
+/* Most archives the server keeps open, and the permissions the socket
+ * gets, so only the user running the server can connect */
+#define SERVE_MAX_ARCHIVES 64
+#define SERVE_SOCKET_UMASK 0177
+/* Where the archive goes in a cached block's key, and the multiplier
+ * that spreads keys over the buckets */
+#define SERVE_ARCHIVE_SHIFT 40
+#define FIBONACCI_MULT 0x9E3779B97F4A7C15ULL
+
+/* Length of "--exclude=" */
+#define EXCLUDE_LEN 10
+/* Length of "--occurrence=" */
+#define OCCURRENCE_LEN 13
+
+/* FNV-1a constants used to hash paths in the filter */
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+/* Smallest hash set the filter allocates */
+#define FILTER_MIN_SLOTS 16
+
+/* Size of each chunk of an arena, which is enough for every member's
+ * scratch memory at a couple hundred directories deep */
+#define ARENA_CHUNK 65536
+/* Alignment of every arena allocation */
+#define ARENA_ALIGN 16
 
+/* The PAX record holding a member's content hash, as 16 hex digits.
+ * Its length is fixed so it can be written ahead of the contents and
+ * filled in once they've been read. */
+#define CHECKSUM_KEY "MYTAR.xxh64"
+#define CHECKSUM_DIGITS 16
+#define CHECKSUM_RECORD_LEN 32
+/* Where the PAX headers of members go, like GNU tar's */
+#define PAX_DIR "PaxHeaders/"
+#define PAX_MODE 0644
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "mytar.h"
+#include "libmytar.h"
+
+/* Parses a size in bytes, which may end in K, M, or G for KiB, MiB,
+ * or GiB. Returns 0, or -1 if it isn't one. */
+int parseSize(const char *arg, uint64_t *size) {
+	char *end;
+	unsigned long long val = strtoull(arg, &end, 10);
+	int shift = 0;
+
+	if (end == arg || *arg == '-') {
+		return -1;
+	}
+	if (*end == 'K' || *end == 'k') {
+		shift = 10;
+	}
+	else if (*end == 'M' || *end == 'm') {
+		shift = 20;
+	}
+	else if (*end == 'G' || *end == 'g') {
+		shift = 30;
+	}
+	if (shift) {
+		end++;
+	}
+	if (*end != '\0' || val > (UINT64_MAX >> shift)) {
+		return -1;
+	}
+	*size = (uint64_t)val << shift;
+	return 0;
+}
+
+/* Parses the value of one of the I/O limits, exiting if it isn't a
+ * size */
+void parseLimit(char *prog, const char *arg, uint64_t *limit) {
+	if (parseSize(arg, limit) == -1) {
+		fprintf(stderr, "%s: invalid limit '%s'\n", prog, arg);
+		exit(EXIT_FAILURE);
+	}
+	return;
+}
+
+/* Pulls every long option (anything starting with "--") out of argv,
+ * recording it in opts, and shifts the remaining arguments down so the
+ * indices in mytar.h still apply. Returns the new argc. */
+int parseLongOptions(int argc, char *argv[], Options *opts) {
+	int i;
+	int new_argc = 1;
+	char *arg;
+	char *end;
+
+	opts->excludes = calloc(argc, sizeof(char *));
+	if (!opts->excludes) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+		/* Not a long option, so keep it */
+		if (strncmp(arg, "--", 2) != 0) {
+			argv[new_argc] = arg;
+			new_argc += 1;
+			continue;
+		}
+
+		if (strcmp(arg, "--wildcards") == 0) {
+			opts->wildcards = 1;
+		}
+		else if (strcmp(arg, "--no-wildcards") == 0) {
+			opts->wildcards = 0;
+		}
+		else if (strncmp(arg, "--exclude=", EXCLUDE_LEN) == 0) {
+			opts->excludes[opts->num_excludes] = arg + EXCLUDE_LEN;
+			opts->num_excludes += 1;
+		}
+		else if (strcmp(arg, "--occurrence") == 0) {
+			opts->occurrence = 1;
+		}
+		else if (strncmp(arg, "--occurrence=", OCCURRENCE_LEN) == 0) {
+			opts->occurrence = strtol(arg + OCCURRENCE_LEN,
+					&end, 10);
+			if (*end != '\0' || opts->occurrence < 1) {
+				fprintf(stderr, "%s: invalid occurrence "
+						"'%s'\n", argv[0],
+						arg + OCCURRENCE_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--all-occurrences") == 0) {
+			opts->occurrence = 0;
+		}
+		else if (strncmp(arg, "--list-format=", 
+					LIST_FORMAT_LEN) == 0) {
+			arg += LIST_FORMAT_LEN;
+			if (strcmp(arg, "text") == 0) {
+				opts->list_format = LIST_TEXT;
+			}
+			else if (strcmp(arg, "json") == 0 ||
+					strcmp(arg, "jsonl") == 0) {
+				opts->list_format = LIST_JSON;
+			}
+			else if (strcmp(arg, "csv") == 0) {
+				opts->list_format = LIST_CSV;
+			}
+			else {
+				fprintf(stderr, "%s: invalid list format "
+						"'%s'\n", argv[0], arg);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--stats") == 0) {
+			opts->stats = 1;
+		}
+		else if (strncmp(arg, "--stats=", STATS_LEN) == 0) {
+			opts->stats = 1;
+			opts->stats_interval = strtod(arg + STATS_LEN, &end);
+			if (*end != '\0' || opts->stats_interval <= 0) {
+				fprintf(stderr, "%s: invalid stats interval "
+						"'%s'\n", argv[0], 
+						arg + STATS_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--progress") == 0) {
+			opts->progress = 1;
+			opts->progress_interval = PROGRESS_INTERVAL;
+		}
+		else if (strncmp(arg, "--progress=", PROGRESS_LEN) == 0) {
+			opts->progress = 1;
+			opts->progress_interval = strtod(arg + PROGRESS_LEN, 
+					&end);
+			if (*end != '\0' || opts->progress_interval <= 0) {
+				fprintf(stderr, "%s: invalid progress interval "
+						"'%s'\n", argv[0], 
+						arg + PROGRESS_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strncmp(arg, "--jobs=", JOBS_LEN) == 0) {
+			opts->jobs = strtol(arg + JOBS_LEN, &end, 10);
+			if (*end != '\0' || opts->jobs < 1 || 
+					opts->jobs > MAX_JOBS) {
+				fprintf(stderr, "%s: invalid number of jobs "
+						"'%s'\n", argv[0], 
+						arg + JOBS_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--recover") == 0) {
+			opts->recover = 1;
+		}
+		else if (strcmp(arg, "--checksum") == 0) {
+			opts->checksum = 1;
+		}
+		else if (strcmp(arg, "--verify") == 0) {
+			opts->verify = 1;
+		}
+		else if (strncmp(arg, "--read-order=", READ_ORDER_LEN) == 0) {
+			arg += READ_ORDER_LEN;
+			if (strcmp(arg, "readdir") == 0) {
+				opts->read_order = READ_READDIR;
+			}
+			else if (strcmp(arg, "inode") == 0) {
+				opts->read_order = READ_INODE;
+			}
+			else if (strcmp(arg, "extent") == 0) {
+				opts->read_order = READ_EXTENT;
+			}
+			else {
+				fprintf(stderr, "%s: invalid read order "
+						"'%s'\n", argv[0], arg);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--keep-order") == 0) {
+			opts->keep_order = 1;
+		}
+		else if (strcmp(arg, "--readahead") == 0) {
+			opts->readahead = READAHEAD_FILES;
+		}
+		else if (strncmp(arg, "--readahead=", READAHEAD_LEN) == 0) {
+			opts->readahead = strtol(arg + READAHEAD_LEN, &end, 10);
+			if (*end != '\0' || opts->readahead < 0 ||
+					opts->readahead > MAX_READAHEAD) {
+				fprintf(stderr, "%s: invalid number of files to "
+						"read ahead '%s'\n", argv[0],
+						arg + READAHEAD_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--no-cache-pollution") == 0) {
+			opts->no_cache = 1;
+		}
+		else if (strncmp(arg, "--volume-size=", VOLUME_SIZE_LEN) == 0) {
+			if (parseSize(arg + VOLUME_SIZE_LEN, 
+						&opts->volume_size) == -1 ||
+					opts->volume_size < MT_MIN_VOLUME) {
+				fprintf(stderr, "%s: invalid volume size '%s', "
+						"it has to be at least %d\n", 
+						argv[0], arg + VOLUME_SIZE_LEN,
+						MT_MIN_VOLUME);
+				exit(EXIT_FAILURE);
+			}
+			opts->multi_volume = 1;
+		}
+		else if (strcmp(arg, "--multi-volume") == 0) {
+			opts->multi_volume = 1;
+		}
+		else if (strncmp(arg, "--stripes=", STRIPES_LEN) == 0) {
+			opts->stripes = strtol(arg + STRIPES_LEN, &end, 10);
+			if (*end != '\0' || opts->stripes < 1 || 
+					opts->stripes > MAX_JOBS) {
+				fprintf(stderr, "%s: invalid number of stripes "
+						"'%s'\n", argv[0], 
+						arg + STRIPES_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--checkpoint") == 0) {
+			opts->checkpoint = 1;
+		}
+		else if (strncmp(arg, "--checkpoint=", CHECKPOINT_LEN) == 0) {
+			opts->checkpoint = 1;
+			opts->checkpoint_interval = strtod(arg + 
+					CHECKPOINT_LEN, &end);
+			if (*end != '\0' || opts->checkpoint_interval <= 0) {
+				fprintf(stderr, "%s: invalid checkpoint "
+						"interval '%s'\n", argv[0], 
+						arg + CHECKPOINT_LEN);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--resume") == 0) {
+			opts->resume = 1;
+		}
+		else if (strcmp(arg, "--skip-unchanged") == 0) {
+			opts->skip_unchanged = SKIP_MTIME;
+		}
+		else if (strncmp(arg, "--skip-unchanged=", 
+					SKIP_UNCHANGED_LEN) == 0) {
+			arg += SKIP_UNCHANGED_LEN;
+			if (strcmp(arg, "mtime") == 0) {
+				opts->skip_unchanged = SKIP_MTIME;
+			}
+			else if (strcmp(arg, "checksum") == 0) {
+				opts->skip_unchanged = SKIP_CHECKSUM;
+			}
+			else {
+				fprintf(stderr, "%s: invalid way to tell files "
+						"are unchanged '%s'\n", argv[0],
+						arg);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--keep-newer-files") == 0) {
+			opts->keep_newer = 1;
+		}
+		else if (strncmp(arg, "--serve=", SERVE_LEN) == 0) {
+			opts->serve = arg + SERVE_LEN;
+			if (*opts->serve == '\0') {
+				fprintf(stderr, "%s: --serve needs a socket "
+						"path\n", argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strncmp(arg, "--serve-root=", SERVE_ROOT_LEN) == 0) {
+			opts->serve_root = arg + SERVE_ROOT_LEN;
+			if (*opts->serve_root == '\0') {
+				fprintf(stderr, "%s: --serve-root needs a "
+						"directory\n", argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strncmp(arg, "--cache-size=", CACHE_SIZE_LEN) == 0) {
+			if (parseSize(arg + CACHE_SIZE_LEN, 
+						&opts->cache_size) == -1) {
+				fprintf(stderr, "%s: invalid cache size '%s'\n",
+						argv[0], arg + CACHE_SIZE_LEN);
+				exit(EXIT_FAILURE);
+			}
+			opts->cache_set = 1;
+		}
+		else if (strncmp(arg, "--read-limit=", READ_LIMIT_LEN) == 0) {
+			parseLimit(argv[0], arg + READ_LIMIT_LEN, 
+					&opts->read_limit);
+		}
+		else if (strncmp(arg, "--read-iops=", READ_IOPS_LEN) == 0) {
+			parseLimit(argv[0], arg + READ_IOPS_LEN, 
+					&opts->read_iops);
+		}
+		else if (strncmp(arg, "--write-limit=", WRITE_LIMIT_LEN) == 0) {
+			parseLimit(argv[0], arg + WRITE_LIMIT_LEN, 
+					&opts->write_limit);
+		}
+		else if (strncmp(arg, "--write-iops=", WRITE_IOPS_LEN) == 0) {
+			parseLimit(argv[0], arg + WRITE_IOPS_LEN, 
+					&opts->write_iops);
+		}
+		else if (strncmp(arg, "--throttle-file=", 
+					THROTTLE_FILE_LEN) == 0) {
+			opts->throttle_file = arg + THROTTLE_FILE_LEN;
+			if (*opts->throttle_file == '\0') {
+				fprintf(stderr, "%s: --throttle-file needs a "
+						"path\n", argv[0]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(arg, "--alloc-stats") == 0) {
+			opts->alloc_stats = 1;
+		}
+		else {
+			fprintf(stderr, "%s: unrecognized option '%s'\n",
+					argv[0], arg);
+			exit(EXIT_FAILURE);
+		}
+	}
+	/* A resumed run goes on saving checkpoints, in case it's
+	 * interrupted too */
+	if (opts->resume) {
+		opts->checkpoint = 1;
+	}
+	if (!opts->cache_set) {
+		opts->cache_size = SERVE_CACHE_SIZE;
+	}
+	if (opts->checkpoint && opts->checkpoint_interval == 0) {
+		opts->checkpoint_interval = CHECKPOINT_INTERVAL;
+	}
+	argv[new_argc] = NULL;
+	return new_argc;
+}
+
+void freeOptions(Options *opts) {
+	free(opts->excludes);
+	opts->excludes = NULL;
+	opts->num_excludes = 0;
+	return;
+}
@@ -0,0 +1,92 @@
+#ifndef OPTIONSH
+#define OPTIONSH
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every option that changes how an archive is created, listed, or
+ * extracted. The single letter options come from argv[OPTS_INDEX] and
+ * the rest from long options, which may appear anywhere. */
+typedef struct options {
+	int strict;
+	int verbose;
+	/* Extract contents to stdout instead of creating files */
+	int to_stdout;
+	/* Treat path arguments containing *, ?, or [ as globs */
+	int wildcards;
+	/* Patterns given with --exclude */
+	char **excludes;
+	size_t num_excludes;
+	/* Which occurrence of a named member to select, 0 selects every
+	 * occurrence and reads the whole archive */
+	int occurrence;
+	/* Report the arena's malloc count when done */
+	int alloc_stats;
+	/* One of LIST_TEXT, LIST_JSON, or LIST_CSV */
+	int list_format;
+	/* Count and time calls and phases, see stats.h */
+	int stats;
+	/* Seconds between --stats progress lines, 0 for none */
+	double stats_interval;
+	/* Show a status line with an ETA every progress_interval seconds */
+	int progress;
+	double progress_interval;
+	/* Threads to list with, see listParallel */
+	int jobs;
+	/* Skip past damaged headers instead of giving up */
+	int recover;
+	/* Store a hash of every file's contents when creating */
+	int checksum;
+	/* Check the contents of every member against its hash */
+	int verify;
+	/* One of READ_READDIR, READ_INODE, or READ_EXTENT */
+	int read_order;
+	/* Archive in readdir order even when reading in another order */
+	int keep_order;
+	/* Source files to read ahead, see cache.h */
+	int readahead;
+	/* Drop what's been read or written from the page cache */
+	int no_cache;
+	/* Bytes in each volume of an archive split with --volume-size, 0
+	 * for an archive that isn't split */
+	uint64_t volume_size;
+	/* Read an archive split into volumes */
+	int multi_volume;
+	/* Independent archives written or extracted at the same time, 0
+	 * for just the one */
+	int stripes;
+	/* Save how far c or x has got every checkpoint_interval seconds,
+	 * see checkpoint.h */
+	int checkpoint;
+	double checkpoint_interval;
+	/* Pick up from the last checkpoint */
+	int resume;
+	/* One of SKIP_NONE, SKIP_MTIME, or SKIP_CHECKSUM, for leaving
+	 * files that are already extracted alone */
+	int skip_unchanged;
+	/* Don't replace files newer than the member */
+	int keep_newer;
+	/* The socket to serve members from, see serve.h, or NULL */
+	char *serve;
+	/* Bytes of archive blocks the server keeps in memory */
+	uint64_t cache_size;
+	int cache_set;
+	/* The directory served archives have to be under, or NULL for
+	 * the current one */
+	char *serve_root;
+	/* Bytes and operations per second to read source files and write
+	 * the archive at when creating, 0 for no limit, see throttle.h */
+	uint64_t read_limit;
+	uint64_t read_iops;
+	uint64_t write_limit;
+	uint64_t write_iops;
+	/* A file of limits read again on SIGHUP, or NULL */
+	char *throttle_file;
+} Options;
+
+int parseSize(const char *, uint64_t *);
+void parseLimit(char *, const char *, uint64_t *);
+int parseLongOptions(int, char *[], Options *);
+void freeOptions(Options *);
+
+#endif
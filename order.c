@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include "order.h"
+#include "mytar.h"
+#include "cache.h"
+#include "stats.h"
+
+/* Records an entry read from a directory, copying its name since the
+ * directory stream reuses its buffer */
+void addEntry(EntryList *list, const char *name, ino_t ino,
+		unsigned char type) {
+	DirEntry *entry;
+	size_t len = strlen(name) + 1;
+
+	if (list->num_entries == list->cap_entries) {
+		list->cap_entries = list->cap_entries ?
+			list->cap_entries * 2 : ENTRIES_START;
+		list->entries = realloc(list->entries,
+				sizeof(DirEntry) * list->cap_entries);
+		if (!list->entries) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	while (list->names_len + len > list->names_cap) {
+		list->names_cap = list->names_cap ?
+			list->names_cap * 2 : ENTRIES_START * NAME_START;
+		list->names = realloc(list->names, list->names_cap);
+		if (!list->names) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	entry = &list->entries[list->num_entries];
+	entry->name = list->names_len;
+	entry->index = list->num_entries;
+	entry->key = ino;
+	entry->size = 0;
+	entry->type = type;
+	memcpy(list->names + list->names_len, name, len);
+	list->names_len += len;
+	list->num_entries += 1;
+	return;
+}
+
+/* Finds the physical address of the first extent of an open file with
+ * FIEMAP. Returns 0 and sets *offset, or -1 if the filesystem can't
+ * say, or the file has no extents yet. */
+int physicalOffset(int fd, uint64_t *offset) {
+	struct {
+		struct fiemap map;
+		struct fiemap_extent extent;
+	} fm;
+
+	memset(&fm, 0, sizeof(fm));
+	fm.map.fm_start = 0;
+	fm.map.fm_length = FIEMAP_MAX_OFFSET;
+	fm.map.fm_extent_count = 1;
+	if (ioctl(fd, FS_IOC_FIEMAP, &fm.map) == -1 ||
+			fm.map.fm_mapped_extents == 0) {
+		return -1;
+	}
+	*offset = fm.extent.fe_physical;
+	return 0;
+}
+
+/* Works out the sort key of every entry, the inode number readdir
+ * already gave unless order is READ_EXTENT. Files are only opened when
+ * their extents or sizes (for keep_order's window) are needed, and
+ * then only files readdir says are regular or couldn't say. path holds
+ * the directory, dir_len characters long, with room to append a
+ * name. */
+void keyEntries(EntryList *list, char *path, size_t dir_len, int order,
+		int keep_order) {
+	DirEntry *entry;
+	struct stat info;
+	size_t i;
+	int fd;
+	uint64_t offset;
+
+	if (order != READ_EXTENT && !keep_order) {
+		return;
+	}
+	for (i = 0; i < list->num_entries; i++) {
+		entry = &list->entries[i];
+		strcpy(path + dir_len, list->names + entry->name);
+		/* Only stat the entries readdir couldn't type */
+		if (entry->type == DT_UNKNOWN && statsLstat(path, &info) == 0 &&
+				S_ISREG(info.st_mode)) {
+			entry->type = DT_REG;
+		}
+		if (entry->type != DT_REG) {
+			continue;
+		}
+		fd = statsOpen(path, O_RDONLY | O_NOFOLLOW, 0);
+		if (fd == -1) {
+			continue;
+		}
+		if (fstat(fd, &info) == 0) {
+			entry->size = info.st_size;
+		}
+		if (order == READ_EXTENT && physicalOffset(fd, &offset) == 0) {
+			entry->key = offset;
+		}
+		close(fd);
+	}
+	path[dir_len] = '\0';
+	return;
+}
+
+/* Sorts entries by key. With READ_EXTENT, keys of regular files are
+ * physical addresses and the rest are inode numbers, so regular files
+ * are kept together after everything else. */
+int compareEntries(const void *a, const void *b) {
+	const DirEntry *x = a;
+	const DirEntry *y = b;
+
+	if ((x->type == DT_REG) != (y->type == DT_REG)) {
+		return (x->type == DT_REG) - (y->type == DT_REG);
+	}
+	if (x->key != y->key) {
+		return x->key < y->key ? -1 : 1;
+	}
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Puts the entries in the order they'll be read and archived */
+void sortEntries(EntryList *list) {
+	qsort(list->entries, list->num_entries, sizeof(DirEntry),
+			compareEntries);
+	return;
+}
+
+/* For keeping the archive in readdir order while reading in disk
+ * order. Takes the entries from first on, in readdir order, until
+ * their regular files add up to READ_WINDOW bytes, and asks for those
+ * files to be read into the page cache in disk order. Archiving them
+ * in readdir order afterwards then reads from memory. Returns the
+ * index of the first entry after the window. */
+size_t prefetchEntries(EntryList *list, char *path, size_t dir_len,
+		size_t first) {
+	DirEntry *window;
+	uint64_t total = 0;
+	size_t end = first;
+	size_t num = 0;
+	size_t i;
+	int fd;
+
+	while (end < list->num_entries && (end == first ||
+				total + list->entries[end].size <= READ_WINDOW)) {
+		total += list->entries[end].size;
+		end++;
+	}
+	window = malloc(sizeof(DirEntry) * (end - first));
+	if (!window) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = first; i < end; i++) {
+		if (list->entries[i].size) {
+			window[num] = list->entries[i];
+			num++;
+		}
+	}
+	qsort(window, num, sizeof(DirEntry), compareEntries);
+	for (i = 0; i < num; i++) {
+		strcpy(path + dir_len, list->names + window[i].name);
+		fd = statsOpen(path, O_RDONLY | O_NOFOLLOW, 0);
+		if (fd == -1) {
+			continue;
+		}
+		posix_fadvise(fd, 0, window[i].size, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+	path[dir_len] = '\0';
+	free(window);
+	return end;
+}
+
+/* Asks for the regular files among entries first up to end to be read
+ * ahead in the background. Returns where it stopped, so the next call
+ * can pick up from there. */
+size_t adviseEntries(EntryList *list, char *path, size_t dir_len,
+		size_t first, size_t end) {
+	size_t i;
+
+	if (end > list->num_entries) {
+		end = list->num_entries;
+	}
+	for (i = first; i < end; i++) {
+		if (list->entries[i].type == DT_REG ||
+				list->entries[i].type == DT_UNKNOWN) {
+			strcpy(path + dir_len, list->names + 
+					list->entries[i].name);
+			cacheWillNeed(path);
+		}
+	}
+	path[dir_len] = '\0';
+	return end;
+}
+
+void freeEntries(EntryList *list) {
+	free(list->entries);
+	free(list->names);
+	memset(list, 0, sizeof(EntryList));
+	return;
+}
@@ -0,0 +1,45 @@
+#ifndef ORDERH
+#define ORDERH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* A directory entry waiting to be archived */
+typedef struct direntry {
+	/* Where its name starts in the list's names */
+	size_t name;
+	/* Its position in readdir order */
+	size_t index;
+	/* Where it is on disk: its inode number, or with READ_EXTENT the
+	 * physical address of a regular file's first extent */
+	uint64_t key;
+	/* Only known for regular files, and only when needed */
+	uint64_t size;
+	/* What readdir said it is, fixed up to DT_REG for regular files it
+	 * couldn't type. Regular files are read after the rest when
+	 * ordering by extent. */
+	unsigned char type;
+} DirEntry;
+
+/* The entries of one directory, collected so they can be read in the
+ * order they're laid out on disk rather than the order readdir gives */
+typedef struct entrylist {
+	DirEntry *entries;
+	size_t num_entries;
+	size_t cap_entries;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+} EntryList;
+
+void addEntry(EntryList *, const char *, ino_t, unsigned char);
+int physicalOffset(int, uint64_t *);
+void keyEntries(EntryList *, char *, size_t, int, int);
+int compareEntries(const void *, const void *);
+void sortEntries(EntryList *);
+size_t prefetchEntries(EntryList *, char *, size_t, size_t);
+size_t adviseEntries(EntryList *, char *, size_t, size_t, size_t);
+void freeEntries(EntryList *);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "progress.h"
+#include "stats.h"
+#include "mytar.h"
+
+Progress progress;
+
+/* Counts bytes and entries of work done. Costs one branch when
+ * progress isn't being reported. */
+void progressAdd(uint64_t bytes, uint64_t entries) {
+	if (!progress.enabled) {
+		return;
+	}
+	atomic_fetch_add_explicit(&progress.bytes, bytes, 
+			memory_order_relaxed);
+	atomic_fetch_add_explicit(&progress.entries, entries, 
+			memory_order_relaxed);
+	return;
+}
+
+/* Starts the reporter thread, which prints a status line every
+ * interval seconds until progressStop. */
+void progressStart(char *prog, double interval, uint64_t total_bytes,
+		uint64_t total_entries) {
+	progress.prog = prog;
+	progress.interval = interval;
+	progress.total_bytes = total_bytes;
+	progress.total_entries = total_entries;
+	progress.start = statsNow();
+	progress.tty = isatty(STDERR_FILENO);
+	progress.done = 0;
+	atomic_init(&progress.bytes, 0);
+	atomic_init(&progress.entries, 0);
+	pthread_mutex_init(&progress.lock, NULL);
+	pthread_cond_init(&progress.cond, NULL);
+	if (pthread_create(&progress.thread, NULL, progressThread, 
+				NULL) != 0) {
+		fprintf(stderr, "%s: can't start progress thread\n", prog);
+		return;
+	}
+	progress.enabled = 1;
+	return;
+}
+
+/* Stops the reporter thread and prints the final status line */
+void progressStop(void) {
+	if (!progress.enabled) {
+		return;
+	}
+	pthread_mutex_lock(&progress.lock);
+	progress.done = 1;
+	pthread_cond_signal(&progress.cond);
+	pthread_mutex_unlock(&progress.lock);
+	pthread_join(progress.thread, NULL);
+	progress.enabled = 0;
+	progressLine('\n');
+	return;
+}
+
+/* Waits out each interval on a condition variable, so stopping doesn't
+ * have to wait for the interval to end. */
+void *progressThread(void *arg) {
+	struct timespec wake;
+	uint64_t nanos;
+
+	(void)arg;
+	pthread_mutex_lock(&progress.lock);
+	while (!progress.done) {
+		clock_gettime(CLOCK_REALTIME, &wake);
+		nanos = wake.tv_nsec + 
+			(uint64_t)(progress.interval * NANOS_PER_SEC);
+		wake.tv_sec += nanos / NANOS_PER_SEC;
+		wake.tv_nsec = nanos % NANOS_PER_SEC;
+		pthread_cond_timedwait(&progress.cond, &progress.lock, &wake);
+		if (!progress.done) {
+			progressLine(progress.tty ? '\r' : '\n');
+		}
+	}
+	pthread_mutex_unlock(&progress.lock);
+	return NULL;
+}
+
+/* Writes a byte count with a binary unit, like "1.5 GiB" */
+int formatBytes(char *dest, size_t size, double bytes) {
+	const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+	int unit = 0;
+
+	while (bytes >= 1024 && unit < PROGRESS_UNITS - 1) {
+		bytes /= 1024;
+		unit += 1;
+	}
+	return snprintf(dest, size, "%.1f %s", bytes, units[unit]);
+}
+
+/* Prints where the work is at: bytes and entries done out of the
+ * totals, throughput, and an ETA based on the average rate so far. */
+void progressLine(char end) {
+	uint64_t bytes = atomic_load_explicit(&progress.bytes, 
+			memory_order_relaxed);
+	uint64_t entries = atomic_load_explicit(&progress.entries, 
+			memory_order_relaxed);
+	double secs = (statsNow() - progress.start) / (double)NANOS_PER_SEC;
+	double rate;
+	char done[PROGRESS_FIELD];
+	char total[PROGRESS_FIELD];
+	char speed[PROGRESS_FIELD];
+	char eta[PROGRESS_FIELD];
+	char count[PROGRESS_FIELD];
+	/* Clears what's left of a longer previous line on a terminal */
+	const char *clear = progress.tty ? "\033[K" : "";
+	long remaining;
+
+	if (secs <= 0) {
+		secs = 1.0 / NANOS_PER_SEC;
+	}
+	rate = bytes / secs;
+	formatBytes(done, sizeof(done), bytes);
+	formatBytes(speed, sizeof(speed), rate);
+	strcpy(eta, "--:--:--");
+	if (progress.total_entries > 0) {
+		snprintf(count, sizeof(count), "%llu/%llu",
+				(unsigned long long)entries,
+				(unsigned long long)progress.total_entries);
+	}
+	else {
+		snprintf(count, sizeof(count), "%llu",
+				(unsigned long long)entries);
+	}
+	if (progress.total_bytes > 0) {
+		formatBytes(total, sizeof(total), progress.total_bytes);
+		if (rate > 0 && bytes <= progress.total_bytes) {
+			remaining = (progress.total_bytes - bytes) / rate;
+			snprintf(eta, sizeof(eta), "%ld:%02ld:%02ld", 
+					remaining / SECS_PER_HOUR,
+					remaining % SECS_PER_HOUR / SECS_PER_MIN,
+					remaining % SECS_PER_MIN);
+		}
+		fprintf(stderr, "%s: %s / %s (%.0f%%), %s entries, %s/s, "
+				"ETA %s%s%c", progress.prog, done, total, 
+				100.0 * bytes / progress.total_bytes, count, 
+				speed, eta, clear, end);
+	}
+	else {
+		fprintf(stderr, "%s: %s, %s entries, %s/s%s%c", 
+				progress.prog, done, count, speed, clear, end);
+	}
+	return;
+}
@@ -0,0 +1,39 @@
+#ifndef PROGRESSH
+#define PROGRESSH
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/* State for --progress. Like stats there's a single instance, since
+ * the reporter thread and the code doing the work both need it. The
+ * work only ever does relaxed atomic adds to the counters; everything
+ * else belongs to the reporter thread. */
+typedef struct progress {
+	int enabled;
+	char *prog;
+	atomic_ullong bytes;
+	atomic_ullong entries;
+	/* What the counters will be when done, 0 if unknown */
+	uint64_t total_bytes;
+	uint64_t total_entries;
+	uint64_t start;
+	double interval;
+	/* Ends a line with '\r' instead of '\n' on a terminal */
+	int tty;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done;
+} Progress;
+
+extern Progress progress;
+
+void progressAdd(uint64_t, uint64_t);
+void progressStart(char *, double, uint64_t, uint64_t);
+void progressStop(void);
+void *progressThread(void *);
+void progressLine(char);
+int formatBytes(char *, size_t, double);
+
+#endif
@@ -0,0 +1,729 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "libmytar.h"
+#include "header.h"
+#include "utilities.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Describes one of the MT_ codes */
+const char *mtStrerror(int status) {
+	switch (status) {
+	case MT_OK:
+		return "Success";
+	case MT_END:
+		return "End of archive";
+	case MT_ERR_IO:
+		return strerror(errno);
+	case MT_ERR_CHKSUM:
+		return "Incorrect header checksum";
+	case MT_ERR_MAGIC:
+		return "Header magic field not valid";
+	case MT_ERR_VERSION:
+		return "Header version field not valid";
+	case MT_ERR_BADUID:
+		return "Header uid field invalid";
+	case MT_ERR_BADGID:
+		return "Header gid field invalid";
+	case MT_ERR_TOOLONG:
+		return "path too long";
+	case MT_ERR_TRUNCATED:
+		return "Unexpected end of archive";
+	case MT_ERR_NOMEM:
+		return "Out of memory";
+	case MT_ERR_STATE:
+		return "Call out of order";
+	case MT_ERR_SIZE:
+		return "Contents don't match the member's size";
+	case MT_ERR_BIGUID:
+		return "uid too big";
+	case MT_ERR_BIGGID:
+		return "gid too big";
+	case MT_ERR_BIGSIZE:
+		return "size too big";
+	case MT_ERR_BIGMTIME:
+		return "mtime too big";
+	case MT_ERR_VOLUME:
+		return "Volume doesn't continue the one before it";
+	case MT_ERR_VOLSIZE:
+		return "Volume size too small";
+	case MT_ERR_SINK:
+		return "Sink didn't take the contents";
+	}
+	return "Unknown error";
+}
+
+/* Checks if a header's magic and version fields are "ustar" null-
+ * terminated and "00" respectively, and that the uid and gid fit.
+ * Returns what's wrong with the header, or MT_OK if nothing is. */
+int mtStrictCheck(Header *header) {
+	/* Checks if the header->magic field is "ustar" null-terminated */
+	if (strncmp(header->magic, "ustar", MAGIC_SIZE) != 0) {
+		return MT_ERR_MAGIC;
+	}
+	/* Checks if the header->version field is "00" */
+	if (strncmp(header->version, "00", VERSION_SIZE) != 0) {
+		return MT_ERR_VERSION;
+	}
+	/* Checks if the header->uid field is too long. Octal fields
+	 * always fit, so only special ints can be. */
+	if (getHeaderId(header->uid, UID_SIZE) > MAX_UID_SIZE) {
+		return MT_ERR_BADUID;
+	}
+	/* Checks if the header->gid field is too long */
+	if (getHeaderId(header->gid, GID_SIZE) > MAX_GID_SIZE) {
+		return MT_ERR_BADGID;
+	}
+	return MT_OK;
+}
+
+/* Looks through the records of a PAX header, each "length key=value\n",
+ * for key. Returns where its value starts and sets *value_len to the
+ * value's length without the newline, or returns NULL if it isn't
+ * there. */
+static const char *findRecord(const char *records, size_t len, 
+		const char *key, size_t *value_len) {
+	size_t pos = 0;
+	size_t rec_len;
+	size_t key_len = strlen(key);
+	const char *rec;
+	const char *start;
+
+	while (pos < len) {
+		rec = records + pos;
+		rec_len = 0;
+		while (pos + rec_len < len && rec[rec_len] >= '0' &&
+				rec[rec_len] <= '9') {
+			rec_len++;
+		}
+		if (rec_len == 0 || pos + rec_len >= len ||
+				rec[rec_len] != ' ') {
+			return NULL;
+		}
+		start = rec + rec_len + 1;
+		rec_len = strtoul(rec, NULL, 10);
+		if (rec_len == 0 || pos + rec_len > len) {
+			return NULL;
+		}
+		/* The key, the '=', the value, and the newline */
+		if (start + key_len + 2 <= rec + rec_len &&
+				strncmp(start, key, key_len) == 0 &&
+				start[key_len] == '=') {
+			start += key_len + 1;
+			*value_len = rec + rec_len - 1 - start;
+			return start;
+		}
+		pos += rec_len;
+	}
+	return NULL;
+}
+
+/* Looks through the records of a PAX header for a member's checksum.
+ * Returns 1 and sets *hash if it's there. */
+int mtParseChecksum(const char *records, size_t len, uint64_t *hash) {
+	const char *value;
+	size_t value_len;
+	char digits[CHECKSUM_DIGITS + 1];
+	char *end;
+
+	value = findRecord(records, len, CHECKSUM_KEY, &value_len);
+	if (!value || value_len != CHECKSUM_DIGITS) {
+		return 0;
+	}
+	memcpy(digits, value, CHECKSUM_DIGITS);
+	digits[CHECKSUM_DIGITS] = '\0';
+	*hash = strtoull(digits, &end, 16);
+	return *end == '\0';
+}
+
+void mtReaderInit(MtReader *reader, int fd, int flags) {
+	memset(reader, 0, sizeof(MtReader));
+	reader->fd = fd;
+	reader->flags = flags;
+	return;
+}
+
+/* Reads a split archive, see mtWriterSplit, going on to the volumes
+ * after the reader's descriptor with next_volume as each one ends.
+ * Returns MT_OK, or MT_ERR_IO if the volume's size can't be found. */
+int mtReaderVolumes(MtReader *reader, MtVolumeFn next_volume, void *arg) {
+	struct stat info;
+
+	if (fstat(reader->fd, &info) == -1) {
+		return MT_ERR_IO;
+	}
+	reader->next_volume = next_volume;
+	reader->volume_arg = arg;
+	reader->volume = 1;
+	reader->volume_end = info.st_size;
+	return MT_OK;
+}
+
+/* Reads the archive from a mapping of all size bytes of it instead of
+ * through the descriptor, so walking the headers of a big archive
+ * costs no calls into the kernel. Split archives can't be mapped.
+ * Returns MT_OK, or MT_ERR_STATE if the reader is reading volumes. */
+int mtReaderMap(MtReader *reader, const void *map, off_t size) {
+	if (reader->next_volume) {
+		return MT_ERR_STATE;
+	}
+	reader->map = map;
+	reader->map_size = size;
+	return MT_OK;
+}
+
+/* Goes to offset in the volume numbered volume, where an earlier
+ * reader stopped between two members, so the next mtReaderNext reads
+ * the member after them. Volumes other than the current one are opened
+ * with the reader's next_volume, so only split archives can have any.
+ * Returns MT_OK, MT_ERR_TRUNCATED if there's no such volume, or
+ * MT_ERR_IO if it can't be seeked. */
+int mtReaderSeek(MtReader *reader, int volume, off_t offset) {
+	struct stat info;
+	int fd;
+
+	if (offset < 0 || offset % BLOCK_SIZE != 0 || volume < 1 ||
+			(volume > 1 && !reader->next_volume)) {
+		return MT_ERR_STATE;
+	}
+	if (reader->next_volume && volume != reader->volume) {
+		fd = reader->next_volume(reader->volume_arg, volume, 
+				reader->fd);
+		if (fd == -1) {
+			return errno == ENOENT ? MT_ERR_TRUNCATED : MT_ERR_IO;
+		}
+		if (fstat(fd, &info) == -1) {
+			return MT_ERR_IO;
+		}
+		reader->fd = fd;
+		reader->volume = volume;
+		reader->volume_end = info.st_size;
+	}
+	if (!reader->map && statsLseek(reader->fd, offset, SEEK_SET) == -1) {
+		return MT_ERR_IO;
+	}
+	reader->offset = offset;
+	reader->left = 0;
+	reader->pad = 0;
+	reader->zeros = 0;
+	reader->done = 0;
+	reader->has_pending = 0;
+	return MT_OK;
+}
+
+/* Reads len bytes from where the reader is, going back for more after
+ * short reads from pipes. Returns how many were read, which is less
+ * than len only at the end of the file, or -1 if a read failed. */
+static ssize_t readFull(MtReader *reader, void *buf, size_t len) {
+	size_t got = 0;
+	ssize_t res;
+
+	if (reader->map) {
+		if (reader->offset >= reader->map_size) {
+			return 0;
+		}
+		if ((off_t)len > reader->map_size - reader->offset) {
+			len = reader->map_size - reader->offset;
+		}
+		memcpy(buf, reader->map + reader->offset, len);
+		return len;
+	}
+	while (got < len) {
+		res = statsRead(reader->fd, (char *)buf + got, len - got);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (res == 0) {
+			break;
+		}
+		got += res;
+	}
+	return got;
+}
+
+/* Moves on to the next volume of a split archive. Returns MT_OK, or
+ * MT_END if there aren't any more. */
+static int openVolume(MtReader *reader) {
+	struct stat info;
+	int fd = reader->next_volume(reader->volume_arg, reader->volume + 1,
+			reader->fd);
+
+	if (fd == -1) {
+		return errno == ENOENT ? MT_END : MT_ERR_IO;
+	}
+	if (fstat(fd, &info) == -1) {
+		return MT_ERR_IO;
+	}
+	reader->fd = fd;
+	reader->volume += 1;
+	reader->offset = 0;
+	reader->volume_end = info.st_size;
+	return MT_OK;
+}
+
+/* Reads a header block, going on into the next volume if the archive
+ * is split and this one has ended. Returns what readFull does. */
+static ssize_t readBlock(MtReader *reader, void *buf) {
+	ssize_t got = readFull(reader, buf, BLOCK_SIZE);
+	int status;
+
+	if (got != 0 || !reader->next_volume) {
+		return got;
+	}
+	status = openVolume(reader);
+	if (status == MT_END) {
+		return 0;
+	}
+	if (status != MT_OK) {
+		return -1;
+	}
+	return readFull(reader, buf, BLOCK_SIZE);
+}
+
+/* Reads the next block of a continuation and checks that it's a
+ * header with the right checksum */
+static int readContinued(MtReader *reader, Header *header) {
+	ssize_t got = readFull(reader, header, BLOCK_SIZE);
+
+	if (got == -1) {
+		return MT_ERR_IO;
+	}
+	if (got < BLOCK_SIZE) {
+		return MT_ERR_TRUNCATED;
+	}
+	reader->offset += BLOCK_SIZE;
+	if (getChksum(header) != parseOctal(header->chksum, CHKSUM_SIZE)) {
+		return MT_ERR_VOLUME;
+	}
+	return MT_OK;
+}
+
+/* Moves on to the volume that the current member's contents carry on
+ * in, which starts with a PAX header saying how far into them it picks
+ * up and then the member's header again */
+static int continueMember(MtReader *reader) {
+	Header header;
+	uint64_t done = reader->size - reader->left;
+	uint64_t len;
+	const char *value;
+	size_t value_len;
+	char *end;
+	ssize_t got;
+	int status;
+
+	status = openVolume(reader);
+	if (status == MT_END) {
+		return MT_ERR_TRUNCATED;
+	}
+	if (status != MT_OK) {
+		return status;
+	}
+	if ((status = readContinued(reader, &header)) != MT_OK) {
+		return status;
+	}
+	len = parseOctal(header.size, SIZE_SIZE);
+	if (*header.typeflag != PAX_FLAG || len > BLOCK_SIZE) {
+		return MT_ERR_VOLUME;
+	}
+	got = readFull(reader, reader->block, BLOCK_SIZE);
+	if (got == -1) {
+		return MT_ERR_IO;
+	}
+	if (got < BLOCK_SIZE) {
+		return MT_ERR_TRUNCATED;
+	}
+	reader->offset += BLOCK_SIZE;
+	value = findRecord(reader->block, len, MT_VOLUME_KEY, &value_len);
+	if (!value || strtoull(value, &end, 10) != done || 
+			end != value + value_len) {
+		return MT_ERR_VOLUME;
+	}
+
+	if ((status = readContinued(reader, &header)) != MT_OK) {
+		return status;
+	}
+	if (memcmp(header.name, reader->member.name, NAME_SIZE) != 0 ||
+			memcmp(header.prefix, reader->member.prefix, 
+				PREFIX_SIZE) != 0 ||
+			parseOctal(header.size, SIZE_SIZE) != reader->left) {
+		return MT_ERR_VOLUME;
+	}
+	return MT_OK;
+}
+
+/* Skips whatever is left of the current member's contents and their
+ * padding, seeking past them unless the archive is a pipe */
+int mtReaderSkip(MtReader *reader) {
+	uint64_t skip;
+	size_t chunk;
+	ssize_t got;
+	int status;
+
+	/* Contents that carry on into later volumes are skipped a volume
+	 * at a time */
+	while (reader->next_volume && 
+			reader->left > (uint64_t)(reader->volume_end - 
+				reader->offset)) {
+		reader->left -= reader->volume_end - reader->offset;
+		reader->offset = reader->volume_end;
+		if ((status = continueMember(reader)) != MT_OK) {
+			return status;
+		}
+	}
+	skip = reader->left + reader->pad;
+	if (skip == 0) {
+		return MT_OK;
+	}
+	if (reader->map) {
+		reader->offset += skip;
+		reader->left = 0;
+		reader->pad = 0;
+		return MT_OK;
+	}
+	if (!reader->no_seek) {
+		if (statsLseek(reader->fd, skip, SEEK_CUR) != -1) {
+			reader->offset += skip;
+			reader->left = 0;
+			reader->pad = 0;
+			return MT_OK;
+		}
+		if (errno != ESPIPE) {
+			return MT_ERR_IO;
+		}
+		reader->no_seek = 1;
+	}
+	while (skip > 0) {
+		chunk = skip < BLOCK_SIZE ? skip : BLOCK_SIZE;
+		got = readFull(reader, reader->block, chunk);
+		if (got == -1) {
+			return MT_ERR_IO;
+		}
+		if (got < chunk) {
+			return MT_ERR_TRUNCATED;
+		}
+		reader->offset += got;
+		skip -= got;
+	}
+	reader->left = 0;
+	reader->pad = 0;
+	return MT_OK;
+}
+
+/* Reads a PAX header's records, keeping the checksum for the member
+ * that comes next. Records bigger than a block have nothing mytar
+ * wrote in them, so they're just skipped. */
+static int readPax(MtReader *reader) {
+	ssize_t got;
+
+	reader->has_pending = 0;
+	if (reader->left == 0 || reader->left > BLOCK_SIZE) {
+		return mtReaderSkip(reader);
+	}
+	got = readBlock(reader, reader->block);
+	if (got == -1) {
+		return MT_ERR_IO;
+	}
+	if (got < BLOCK_SIZE) {
+		return MT_ERR_TRUNCATED;
+	}
+	reader->offset += BLOCK_SIZE;
+	reader->has_pending = mtParseChecksum(reader->block, reader->left,
+			&reader->pending);
+	reader->left = 0;
+	reader->pad = 0;
+	return MT_OK;
+}
+
+/* Decodes a header that's been checked into entry */
+static void fillEntry(MtReader *reader, MtEntry *entry) {
+	Header *header = &entry->header;
+
+	entry->type = *header->typeflag;
+	entry->mode = parseOctal(header->mode, MODE_SIZE);
+	entry->uid = getHeaderId(header->uid, UID_SIZE);
+	entry->gid = getHeaderId(header->gid, GID_SIZE);
+	entry->size = reader->left;
+	entry->mtime = parseOctal(header->mtime, MTIME_SIZE);
+	memcpy(entry->linkname, header->linkname, LINKNAME_SIZE);
+	entry->linkname[LINKNAME_SIZE] = '\0';
+	memcpy(entry->uname, header->uname, UNAME_SIZE);
+	entry->uname[UNAME_SIZE] = '\0';
+	memcpy(entry->gname, header->gname, GNAME_SIZE);
+	entry->gname[GNAME_SIZE] = '\0';
+	entry->has_checksum = reader->has_pending;
+	entry->checksum = reader->pending;
+	reader->has_pending = 0;
+	if (reader->next_volume) {
+		reader->size = reader->left;
+		reader->member = *header;
+	}
+	return;
+}
+
+/* Reads the next member's header into entry, first skipping whatever
+ * of the last member's contents weren't read. Returns MT_END once the
+ * archive is over. After a damaged header, entry->offset says where it
+ * was and mtReaderRecover can look for the next one. With
+ * MT_ERR_TOOLONG the entry is complete except for its name, and the
+ * reader carries on past it like any other member. */
+int mtReaderNext(MtReader *reader, MtEntry *entry) {
+	Header *header = &entry->header;
+	unsigned int csum;
+	uint64_t start;
+	uint64_t size;
+	ssize_t got;
+	int status;
+
+	status = mtReaderSkip(reader);
+	if (status != MT_OK) {
+		return status;
+	}
+	while (!reader->done) {
+		got = readBlock(reader, header);
+		if (got == -1) {
+			return MT_ERR_IO;
+		}
+		/* Archives that just stop are treated as ended, like tar
+		 * does */
+		if (got == 0) {
+			reader->done = 1;
+			break;
+		}
+		if (got < BLOCK_SIZE) {
+			return MT_ERR_TRUNCATED;
+		}
+		entry->offset = reader->offset;
+		reader->offset += BLOCK_SIZE;
+
+		/* Check if the header's checksum is the same as what the
+		 * checksum should actually be */
+		start = statsStart();
+		csum = getChksum(header);
+		statsAdd(STAT_CHKSUM, start, 0);
+		if (csum != parseOctal(header->chksum, CHKSUM_SIZE)) {
+			/* Potentially end of archive */
+			if (isZeroBlock(header)) {
+				reader->zeros += 1;
+				reader->done = (reader->zeros == 2);
+				continue;
+			}
+			return MT_ERR_CHKSUM;
+		}
+		reader->zeros = 0;
+		if (reader->flags & MT_STRICT) {
+			status = mtStrictCheck(header);
+			if (status != MT_OK) {
+				return status;
+			}
+		}
+		/* Not strict so just check if magic field is ustar */
+		else if (strncmp(header->magic, "ustar", MAGIC_SIZE - 1) != 0) {
+			return MT_ERR_MAGIC;
+		}
+
+		size = parseOctal(header->size, SIZE_SIZE);
+		reader->left = size;
+		reader->pad = (BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE;
+		/* PAX headers only describe the next member, so they
+		 * aren't members themselves */
+		if (*header->typeflag == PAX_FLAG) {
+			status = readPax(reader);
+			if (status != MT_OK) {
+				return status;
+			}
+			continue;
+		}
+		fillEntry(reader, entry);
+		if (getName(header, entry->name) == -1) {
+			entry->name[0] = '\0';
+			return MT_ERR_TOOLONG;
+		}
+		return MT_OK;
+	}
+	return MT_END;
+}
+
+/* Reads up to len bytes of the current member's contents. Returns how
+ * many were read, which in a split archive can be fewer than len and
+ * still more than 0, 0 once they've all been read, or an MT_ error. */
+ssize_t mtReaderRead(MtReader *reader, void *buf, size_t len) {
+	ssize_t got;
+	int status;
+
+	if (len > reader->left) {
+		len = reader->left;
+	}
+	if (len == 0) {
+		return 0;
+	}
+	/* Reads stop at the end of a volume, and the next one picks up
+	 * where it left off */
+	if (reader->next_volume) {
+		if (reader->offset == reader->volume_end &&
+				(status = continueMember(reader)) != MT_OK) {
+			return status;
+		}
+		if (len > reader->volume_end - reader->offset) {
+			len = reader->volume_end - reader->offset;
+		}
+	}
+	got = readFull(reader, buf, len);
+	if (got == -1) {
+		return MT_ERR_IO;
+	}
+	if (got < len) {
+		return MT_ERR_TRUNCATED;
+	}
+	reader->left -= got;
+	reader->offset += got;
+	return got;
+}
+
+/* Tells the reader n bytes of contents were taken straight from its
+ * descriptor, say with splice, without going through mtReaderRead */
+void mtReaderAdvance(MtReader *reader, uint64_t n) {
+	reader->left -= n;
+	reader->offset += n;
+	return;
+}
+
+/* Hands the rest of the current member's contents to sink, then
+ * leaves the reader at its padding for the next mtReaderNext to skip.
+ * A mapped archive's contents are handed over straight out of the
+ * mapping; otherwise they're read EXTRACT_CHUNK bytes at a time.
+ * Returns MT_OK, MT_ERR_SINK if the sink stopped it, or a read error,
+ * after which the reader is wherever it got to. */
+int mtReaderExtract(MtReader *reader, MtSink *sink) {
+	char buf[EXTRACT_CHUNK];
+	const void *data;
+	ssize_t got;
+
+	while (reader->left > 0) {
+		if (reader->map) {
+			if (reader->offset >= reader->map_size) {
+				return MT_ERR_TRUNCATED;
+			}
+			got = reader->map_size - reader->offset < 
+				(off_t)EXTRACT_CHUNK ? 
+				reader->map_size - reader->offset : 
+				EXTRACT_CHUNK;
+			got = (uint64_t)got < reader->left ? got : 
+				(ssize_t)reader->left;
+			data = reader->map + reader->offset;
+			mtReaderAdvance(reader, got);
+		}
+		else {
+			got = mtReaderRead(reader, buf, sizeof(buf));
+			if (got < 0) {
+				return got;
+			}
+			data = buf;
+		}
+		if (sink->write(sink->arg, data, got) == -1) {
+			return MT_ERR_SINK;
+		}
+	}
+	return MT_OK;
+}
+
+/* Makes sink collect contents in buffer, which starts out empty */
+void mtSinkMemory(MtSink *sink, MtBuffer *buffer) {
+	memset(buffer, 0, sizeof(MtBuffer));
+	sink->write = mtBufferWrite;
+	sink->arg = buffer;
+	return;
+}
+
+/* The write of a memory sink. Returns -1 if the buffer can't grow. */
+int mtBufferWrite(void *arg, const void *data, size_t len) {
+	MtBuffer *buffer = arg;
+	size_t cap = buffer->cap;
+	char *grown;
+
+	while (buffer->len + len > cap) {
+		cap = cap ? cap * 2 : BLOCK_SIZE;
+	}
+	if (cap != buffer->cap) {
+		grown = realloc(buffer->data, cap);
+		if (!grown) {
+			return -1;
+		}
+		buffer->data = grown;
+		buffer->cap = cap;
+	}
+	memcpy(buffer->data + buffer->len, data, len);
+	buffer->len += len;
+	return 0;
+}
+
+void mtBufferFree(MtBuffer *buffer) {
+	free(buffer->data);
+	memset(buffer, 0, sizeof(MtBuffer));
+	return;
+}
+
+/* Recovers from a damaged header by scanning forward from the
+ * reader's position for the next block that looks like a header,
+ * reading big chunks at a time so the scan runs about as fast as the
+ * disk. *from is set to the damaged header and *to to the header that
+ * was found, which the next mtReaderNext returns, or to where the scan
+ * stopped. Returns MT_OK, or MT_END if no header was found before the
+ * end of the archive. Only works on archives that can be seeked. */
+int mtReaderRecover(MtReader *reader, off_t *from, off_t *to) {
+	off_t pos = reader->offset;
+	off_t found = -1;
+	char *chunk;
+	ssize_t got;
+	ssize_t i;
+
+	*from = pos - BLOCK_SIZE;
+	/* A mapped archive is scanned where it is */
+	while (reader->map && found == -1 && 
+			pos + BLOCK_SIZE <= reader->map_size) {
+		if (isCandidate((Header *)(reader->map + pos))) {
+			found = pos;
+		}
+		else {
+			pos += BLOCK_SIZE;
+		}
+	}
+	chunk = reader->map ? NULL : malloc(SCAN_CHUNK);
+	if (!reader->map && !chunk) {
+		return MT_ERR_NOMEM;
+	}
+	while (chunk && found == -1 &&
+			(got = pread(reader->fd, chunk, SCAN_CHUNK, pos)) >=
+			BLOCK_SIZE) {
+		for (i = 0; i + BLOCK_SIZE <= got; i += BLOCK_SIZE) {
+			if (isCandidate((Header *)(chunk + i))) {
+				found = pos + i;
+				break;
+			}
+		}
+		pos += got - got % BLOCK_SIZE;
+	}
+	free(chunk);
+
+	reader->left = 0;
+	reader->pad = 0;
+	reader->zeros = 0;
+	reader->has_pending = 0;
+	if (found == -1) {
+		*to = pos;
+		reader->done = 1;
+		return MT_END;
+	}
+	if (!reader->map && statsLseek(reader->fd, found, SEEK_SET) == -1) {
+		return MT_ERR_IO;
+	}
+	*to = found;
+	reader->offset = found;
+	return MT_OK;
+}
@@ -0,0 +1,405 @@
+/* fwrite_unlocked is a GNU extension */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "scan.h"
+#include "header.h"
+#include "utilities.h"
+#include "filter.h"
+#include "format.h"
+#include "mytar.h"
+#include "libmytar.h"
+#include "stats.h"
+
+/* Records a candidate, growing the region's array as needed */
+void addCandidate(Region *region, off_t offset, uint64_t size) {
+	Candidate *cand;
+
+	if (region->num_cands == region->cap_cands) {
+		region->cap_cands = region->cap_cands ? 
+			region->cap_cands * 2 : SCAN_START_CANDS;
+		region->cands = realloc(region->cands, 
+				sizeof(Candidate) * region->cap_cands);
+		if (!region->cands) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	cand = &region->cands[region->num_cands];
+	region->num_cands += 1;
+	cand->offset = offset;
+	cand->size = size;
+	return;
+}
+
+/* Reports how mtReaderRecover got past a damaged header: the range of
+ * bytes that was skipped, which starts with the damaged block, and
+ * whether another header was found after it */
+void reportRecover(char *prog, int status, off_t from, off_t to) {
+	if (status == MT_END) {
+		fprintf(stderr, "%s: skipped bytes %lld-%lld, no header found "
+				"before the end of the archive\n", prog, 
+				(long long)from, (long long)to);
+		return;
+	}
+	if (status != MT_OK) {
+		fprintf(stderr, "%s: %s\n", prog, mtStrerror(status));
+		exit(EXIT_FAILURE);
+	}
+	fprintf(stderr, "%s: skipped bytes %lld-%lld (%lld bytes) to the "
+			"next header\n", prog, (long long)from, 
+			(long long)to, (long long)(to - from));
+	return;
+}
+
+/* Reads every block of a region in big chunks, keeping each block
+ * that looks like a header */
+void scanRegion(Scan *scan, Region *region, char *chunk, 
+		MtHeaderBatch *batch) {
+	off_t pos;
+	ssize_t got;
+	size_t i;
+
+	for (pos = region->start; pos < region->end; pos += got) {
+		got = region->end - pos < SCAN_CHUNK ? 
+			region->end - pos : SCAN_CHUNK;
+		got = pread(scan->fd, chunk, got, pos);
+		if (got <= 0) {
+			region->error = (got == -1);
+			break;
+		}
+		/* Every block of the chunk is checked at once, and only
+		 * the ones that look like headers are kept */
+		if (mtDecodeHeaders(batch, chunk, got / BLOCK_SIZE) != MT_OK) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < batch->count; i++) {
+			if (batch->valid[i]) {
+				addCandidate(region, pos + i * BLOCK_SIZE, 
+						batch->size[i]);
+			}
+		}
+		/* Don't leave a partial block behind */
+		got -= got % BLOCK_SIZE;
+		if (got == 0) {
+			break;
+		}
+	}
+	return;
+}
+
+/* Thread that scans the next region there is, over and over, waiting
+ * whenever it gets too far ahead of the listing */
+void *scanThread(void *arg) {
+	Scan *scan = arg;
+	char *chunk = malloc(SCAN_CHUNK);
+	MtHeaderBatch batch;
+	size_t r;
+
+	if (!chunk) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	mtBatchInit(&batch);
+	pthread_mutex_lock(&scan->lock);
+	for (;;) {
+		while (!scan->stop && scan->next < scan->num_regions &&
+				scan->next >= scan->listing + scan->ahead) {
+			pthread_cond_wait(&scan->changed, &scan->lock);
+		}
+		if (scan->stop || scan->next >= scan->num_regions) {
+			break;
+		}
+		r = scan->next;
+		scan->next += 1;
+		pthread_mutex_unlock(&scan->lock);
+		scanRegion(scan, &scan->regions[r], chunk, &batch);
+		pthread_mutex_lock(&scan->lock);
+		scan->regions[r].done = 1;
+		pthread_cond_broadcast(&scan->changed);
+	}
+	pthread_mutex_unlock(&scan->lock);
+	mtBatchFree(&batch);
+	free(chunk);
+	return NULL;
+}
+
+/* Finds the candidate at offset in region, or if exact is 0, the first
+ * one at or after offset. Candidates are sorted by offset, so it's a
+ * binary search. */
+Candidate *findCandidate(Region *region, off_t offset, int exact) {
+	size_t lo = 0;
+	size_t hi = region->num_cands;
+	size_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (region->cands[mid].offset < offset) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if (lo < region->num_cands && (!exact || 
+				region->cands[lo].offset == offset)) {
+		return &region->cands[lo];
+	}
+	return NULL;
+}
+
+/* Waits for region r to be scanned and returns it, exiting if reading
+ * the archive, name, failed */
+Region *waitRegion(Scan *scan, size_t r, char *name) {
+	Region *region = &scan->regions[r];
+
+	pthread_mutex_lock(&scan->lock);
+	while (!region->done) {
+		pthread_cond_wait(&scan->changed, &scan->lock);
+	}
+	pthread_mutex_unlock(&scan->lock);
+	if (region->error) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	return region;
+}
+
+/* Frees region r once it's been listed, letting the threads scan
+ * further ahead. A region the chain skipped over, being all contents,
+ * is left unscanned if no thread has taken it yet. */
+void freeRegion(Scan *scan, size_t r) {
+	pthread_mutex_lock(&scan->lock);
+	if (scan->next <= r) {
+		scan->next = r + 1;
+	}
+	else {
+		while (!scan->regions[r].done) {
+			pthread_cond_wait(&scan->changed, &scan->lock);
+		}
+	}
+	free(scan->regions[r].cands);
+	scan->regions[r].cands = NULL;
+	scan->listing = r + 1;
+	pthread_cond_broadcast(&scan->changed);
+	pthread_mutex_unlock(&scan->lock);
+	return;
+}
+
+/* Reads back the header at offset, now that it's known to be real, and
+ * prints its listing line if the filter selects it. text has room for
+ * a name followed by its line. */
+void listCandidate(int fd, off_t offset, Options *opts, Format *fmt, 
+		Filter *filter, char *text) {
+	Header header;
+	size_t name_len;
+	size_t line_len;
+	int len;
+
+	if (pread(fd, &header, BLOCK_SIZE, offset) != BLOCK_SIZE) {
+		perror("pread");
+		exit(EXIT_FAILURE);
+	}
+	if (opts->strict && strictError(&header)) {
+		fflush(stdout);
+		fprintf(stderr, "%s\n", strictError(&header));
+		exit(EXIT_FAILURE);
+	}
+	len = getName(&header, text);
+	if (len == -1) {
+		fprintf(stderr, "path too long\n");
+		return;
+	}
+	if (*header.typeflag == PAX_FLAG || !filterMatch(filter, text, 
+				*header.typeflag == DIR_FLAG, 1)) {
+		return;
+	}
+	name_len = len + 1;
+	if (opts->list_format == LIST_JSON) {
+		line_len = formatJsonRecord(&header, text, offset,
+				text + name_len);
+	}
+	else if (opts->list_format == LIST_CSV) {
+		line_len = formatCsvRecord(&header, text, offset,
+				text + name_len);
+	}
+	else if (opts->verbose) {
+		line_len = formatVerbose(fmt, &header, text, text + name_len);
+	}
+	else {
+		line_len = formatName(text + name_len, text);
+	}
+	fwrite_unlocked(text + name_len, 1, line_len, stdout);
+	return;
+}
+
+/* Lists an archive with opts->jobs threads. The archive is split into
+ * regions of at most SCAN_REGION bytes, which the threads scan for
+ * candidates in order. Meanwhile the real headers are found by
+ * following the chain from offset 0, each header pointing to where the
+ * next one must be, exactly like the serial listing walks the archive,
+ * and listed as soon as the region they're in has been scanned. A
+ * region is freed once the chain has gone past it. Anything the chain
+ * lands on that isn't a candidate is read directly, which is how the
+ * end of archive marker, and any damage, are handled the same way
+ * listArchive handles them. */
+void listParallel(int numPaths, char *paths[], Options *opts) {
+	int fd;
+	int t;
+	int num_threads = opts->jobs;
+	int eoa = 0;
+	struct stat info;
+	off_t span;
+	off_t offset = 0;
+	/* Where a damaged header was, while looking for the next one */
+	off_t damaged = -1;
+	size_t r;
+	Scan scan;
+	Region *region = NULL;
+	Candidate *cand;
+	pthread_t *threads;
+	Header header;
+	Filter filter;
+	Format fmt;
+	/* Name followed by its listing line */
+	char *text;
+	static char out_buf[LIST_BUF_SIZE];
+
+	fd = statsOpen(paths[TAR_INDEX], O_RDONLY, 0);
+	if (fd == -1 || fstat(fd, &info) == -1) {
+		perror(paths[TAR_INDEX]);
+		exit(EXIT_FAILURE);
+	}
+	/* Split the archive on block boundaries, into enough regions
+	 * that every thread gets one even when it's small */
+	span = (info.st_size / BLOCK_SIZE + num_threads - 1) / num_threads *
+		BLOCK_SIZE;
+	span = span < SCAN_REGION ? span : SCAN_REGION;
+	span = span > 0 ? span : BLOCK_SIZE;
+	memset(&scan, 0, sizeof(Scan));
+	scan.fd = fd;
+	scan.num_regions = (info.st_size + span - 1) / span;
+	scan.ahead = (size_t)num_threads * SCAN_AHEAD;
+	scan.regions = calloc(scan.num_regions + 1, sizeof(Region));
+	threads = calloc(num_threads, sizeof(pthread_t));
+	text = malloc(PATH_LIMIT + 1 + RECORD_MAX_LEN);
+	if (!scan.regions || !threads || !text) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (r = 0; r < scan.num_regions; r++) {
+		scan.regions[r].start = span * r;
+		scan.regions[r].end = span * (r + 1) < info.st_size ?
+			span * (r + 1) : info.st_size;
+	}
+	pthread_mutex_init(&scan.lock, NULL);
+	pthread_cond_init(&scan.changed, NULL);
+	for (t = 0; t < num_threads; t++) {
+		if (pthread_create(&threads[t], NULL, scanThread, 
+					&scan) != 0) {
+			fprintf(stderr, "can't start scan thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (!isatty(STDOUT_FILENO)) {
+		setvbuf(stdout, out_buf, _IOFBF, LIST_BUF_SIZE);
+	}
+	if (opts->list_format == LIST_CSV) {
+		fputs(CSV_COLUMNS, stdout);
+	}
+	compileFilter(&filter, numPaths, paths, opts);
+	initFormat(&fmt);
+
+	/* Stitch the candidates together into the serial chain, a region
+	 * at a time */
+	r = 0;
+	while (offset < info.st_size && eoa < 2) {
+		while (offset >= scan.regions[r].end) {
+			freeRegion(&scan, r);
+			region = NULL;
+			r += 1;
+		}
+		if (!region) {
+			region = waitRegion(&scan, r, paths[TAR_INDEX]);
+		}
+		/* Every block was already checked, so the next header
+		 * after a damaged one is just the next candidate */
+		if (damaged != -1) {
+			cand = findCandidate(region, offset, 0);
+			if (!cand) {
+				offset = region->end;
+				continue;
+			}
+			reportRecover(paths[0], MT_OK, damaged, cand->offset);
+			damaged = -1;
+			offset = cand->offset;
+		}
+		cand = findCandidate(region, offset, 1);
+		if (!cand) {
+			/* Not a header, so it has to be the end of the 
+			 * archive */
+			if (pread(fd, &header, BLOCK_SIZE, offset) != 
+					BLOCK_SIZE) {
+				break;
+			}
+			if (isZeroBlock(&header)) {
+				eoa += 1;
+				offset += BLOCK_SIZE;
+				continue;
+			}
+			fflush(stdout);
+			if (getChksum(&header) != parseOctal(header.chksum, 
+						CHKSUM_SIZE)) {
+				fprintf(stderr, "Incorrect header checksum\n");
+			}
+			else {
+				fprintf(stderr, "Header magic field not "
+						"valid\n");
+			}
+			if (!opts->recover) {
+				exit(EXIT_FAILURE);
+			}
+			damaged = offset;
+			continue;
+		}
+		eoa = 0;
+		offset = cand->offset + BLOCK_SIZE + 
+			(cand->size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+		listCandidate(fd, cand->offset, opts, &fmt, &filter, text);
+		if (filterDone(&filter)) {
+			break;
+		}
+	}
+	if (damaged != -1) {
+		reportRecover(paths[0], MT_END, damaged, info.st_size);
+	}
+
+	fflush(stdout);
+	pthread_mutex_lock(&scan.lock);
+	scan.stop = 1;
+	pthread_cond_broadcast(&scan.changed);
+	pthread_mutex_unlock(&scan.lock);
+	for (t = 0; t < num_threads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	freeFilter(&filter);
+	for (r = 0; r < scan.num_regions; r++) {
+		free(scan.regions[r].cands);
+	}
+	pthread_mutex_destroy(&scan.lock);
+	pthread_cond_destroy(&scan.changed);
+	free(scan.regions);
+	free(threads);
+	free(text);
+	close(fd);
+	return;
+}
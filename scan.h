@@ -0,0 +1,68 @@
+#ifndef SCANH
+#define SCANH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "header.h"
+#include "options.h"
+#include "filter.h"
+#include "format.h"
+#include "libmytar.h"
+
+/* A block in the archive that looks like a header: the magic is there
+ * and the checksum is right. It might still be the contents of a file
+ * (an archive inside the archive), which stitching sorts out. Only
+ * where it is and what it says the size is are kept; the header is
+ * read again to list it once it's known to be real. */
+typedef struct candidate {
+	off_t offset;
+	uint64_t size;
+} Candidate;
+
+/* A stretch of the archive, at most SCAN_REGION bytes, scanned by one
+ * thread */
+typedef struct region {
+	off_t start;
+	off_t end;
+	Candidate *cands;
+	size_t num_cands;
+	size_t cap_cands;
+	/* Set once it's been scanned */
+	int done;
+	/* Set if reading the archive failed */
+	int error;
+} Region;
+
+/* An archive being listed by listParallel. The threads take its
+ * regions in order, but never more than SCAN_AHEAD regions per thread
+ * past the one being listed, so only that many regions' candidates are
+ * kept however many members the archive has. */
+typedef struct scan {
+	int fd;
+	Region *regions;
+	size_t num_regions;
+	size_t ahead;
+	/* The next region a thread will take, and the first one not
+	 * listed yet */
+	size_t next;
+	size_t listing;
+	/* Set to have the threads stop taking regions */
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} Scan;
+
+void addCandidate(Region *, off_t, uint64_t);
+void reportRecover(char *, int, off_t, off_t);
+void scanRegion(Scan *, Region *, char *, MtHeaderBatch *);
+void *scanThread(void *);
+Candidate *findCandidate(Region *, off_t, int);
+Region *waitRegion(Scan *, size_t, char *);
+void freeRegion(Scan *, size_t);
+void listCandidate(int, off_t, Options *, Format *, Filter *, char *);
+void listParallel(int, char *[], Options *);
+
+#endif
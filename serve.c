@@ -0,0 +1,609 @@
+/* sendfile is Linux specific */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/sendfile.h>
+
+#include "serve.h"
+#include "blockcache.h"
+#include "filter.h"
+#include "stats.h"
+#include "libmytar.h"
+#include "mytar.h"
+
+/* Set by SIGINT or SIGTERM to stop taking connections */
+static volatile sig_atomic_t stopping;
+
+static void stopServing(int sig) {
+	stopping = 1;
+	return;
+}
+
+/* Looks up the member named name, which is len characters long and
+ * hashes to hash. Returns NULL if the archive doesn't have one. */
+ServedMember *findMember(ServedArchive *archive, const char *name,
+		size_t len, uint32_t hash) {
+	size_t i;
+	ServedMember *member;
+
+	if (!archive->slots) {
+		return NULL;
+	}
+	for (i = hash & archive->mask; archive->slots[i];
+			i = (i + 1) & archive->mask) {
+		member = &archive->members[archive->slots[i] - 1];
+		if (member->hash == hash && member->len == len &&
+				memcmp(archive->names + member->name, name,
+					len) == 0) {
+			return member;
+		}
+	}
+	return NULL;
+}
+
+/* Adds entry, whose contents start at offset, to the archive's index,
+ * in place of any earlier member with the same name */
+void addMember(ServedArchive *archive, MtEntry *entry, off_t offset) {
+	size_t len = strlen(entry->name);
+	uint32_t hash = FNV_OFFSET;
+	ServedMember *member;
+	size_t cap = archive->slots ? archive->mask + 1 : 0;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < len; i++) {
+		hash = hashStep(hash, entry->name[i]);
+	}
+	member = findMember(archive, entry->name, len, hash);
+	if (member) {
+		member->type = entry->type;
+		member->offset = offset;
+		member->size = entry->size;
+		return;
+	}
+
+	if (archive->num_members == archive->cap_members) {
+		archive->cap_members = archive->cap_members ?
+			archive->cap_members * 2 : SERVE_START_MEMBERS;
+		archive->members = realloc(archive->members,
+				sizeof(ServedMember) * archive->cap_members);
+		if (!archive->members) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	while (archive->names_len + len > archive->names_cap) {
+		archive->names_cap = archive->names_cap ?
+			archive->names_cap * 2 :
+			SERVE_START_MEMBERS * NAME_START;
+		archive->names = realloc(archive->names, archive->names_cap);
+		if (!archive->names) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (2 * (archive->num_members + 1) > cap) {
+		cap = cap ? cap * 2 : 2 * SERVE_START_MEMBERS;
+		free(archive->slots);
+		archive->slots = calloc(cap, sizeof(size_t));
+		if (!archive->slots) {
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		archive->mask = cap - 1;
+		for (j = 0; j < archive->num_members; j++) {
+			for (i = archive->members[j].hash & archive->mask;
+					archive->slots[i];
+					i = (i + 1) & archive->mask) {
+				;
+			}
+			archive->slots[i] = j + 1;
+		}
+	}
+
+	member = &archive->members[archive->num_members];
+	member->name = archive->names_len;
+	member->len = len;
+	member->hash = hash;
+	member->type = entry->type;
+	member->offset = offset;
+	member->size = entry->size;
+	memcpy(archive->names + archive->names_len, entry->name, len);
+	archive->names_len += len;
+	for (i = hash & archive->mask; archive->slots[i];
+			i = (i + 1) & archive->mask) {
+		;
+	}
+	archive->num_members += 1;
+	archive->slots[i] = archive->num_members;
+	return;
+}
+
+/* Reads every header of the archive, the way listing does, seeking
+ * past the contents, and indexes the members by name. Returns MT_OK or
+ * the code of the first header that couldn't be read. */
+int indexArchive(ServedArchive *archive) {
+	MtReader reader;
+	MtEntry *entry = malloc(sizeof(MtEntry));
+	int status;
+
+	if (!entry) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	mtReaderInit(&reader, archive->fd, 0);
+	while ((status = mtReaderNext(&reader, entry)) != MT_END) {
+		/* It can't be asked for, but the rest can */
+		if (status == MT_ERR_TOOLONG) {
+			continue;
+		}
+		if (status != MT_OK) {
+			break;
+		}
+		/* The reader is at the start of its contents */
+		addMember(archive, entry, reader.offset);
+	}
+	free(entry);
+	return status == MT_END ? MT_OK : status;
+}
+
+void freeServed(ServedArchive *archive) {
+	if (archive->fd != -1) {
+		close(archive->fd);
+	}
+	free(archive->path);
+	free(archive->members);
+	free(archive->slots);
+	free(archive->names);
+	free(archive);
+	return;
+}
+
+/* Whether real, a real path, is under the directory archives are
+ * served from */
+int underRoot(Server *server, const char *real) {
+	size_t len = strlen(server->root);
+
+	/* Everything is under "/" */
+	if (len == 1) {
+		return 1;
+	}
+	return strncmp(real, server->root, len) == 0 && real[len] == '/';
+}
+
+/* Closes the archive that was asked for least recently of the ones no
+ * request is using, to make room for another. Returns 0, or -1 if
+ * they're all in use. Called with the lock held. */
+int closeUnused(Server *server) {
+	size_t i;
+	size_t oldest = server->num_archives;
+
+	for (i = 0; i < server->num_archives; i++) {
+		if (server->archives[i]->users == 0 && 
+				(oldest == server->num_archives ||
+				 server->archives[i]->used < 
+				 server->archives[oldest]->used)) {
+			oldest = i;
+		}
+	}
+	if (oldest == server->num_archives) {
+		return -1;
+	}
+	freeServed(server->archives[oldest]);
+	server->num_archives -= 1;
+	server->archives[oldest] = server->archives[server->num_archives];
+	return 0;
+}
+
+/* Returns the archive at path, opening and indexing it the first time
+ * it's asked for. Paths are matched as given first, and then by their
+ * real path, so every name for an archive shares its index and its
+ * cached blocks. Only archives whose real path is under the server's
+ * root are served. The index is built without holding the lock, so
+ * other clients aren't held up; if two build the same one, the first
+ * to finish is kept. With SERVE_MAX_ARCHIVES open, the one asked for
+ * least recently is closed to make room. The archive is in use until
+ * it's given to releaseArchive. Returns NULL, with why set to the
+ * reason, if it can't be opened or read. */
+ServedArchive *serverArchive(Server *server, char *path, const char **why) {
+	ServedArchive *archive = NULL;
+	char *real = NULL;
+	size_t i;
+	int pass;
+	int status;
+
+	for (pass = 0; pass < 2 && !archive; pass++) {
+		if (pass == 1) {
+			real = realpath(path, NULL);
+			if (!real) {
+				*why = strerror(errno);
+				return NULL;
+			}
+		}
+		pthread_mutex_lock(&server->lock);
+		for (i = 0; i < server->num_archives && !archive; i++) {
+			if (strcmp(server->archives[i]->path,
+						pass ? real : path) == 0) {
+				archive = server->archives[i];
+				archive->users += 1;
+				server->uses += 1;
+				archive->used = server->uses;
+			}
+		}
+		pthread_mutex_unlock(&server->lock);
+	}
+	if (archive) {
+		free(real);
+		return archive;
+	}
+	if (!underRoot(server, real)) {
+		*why = "not under the served directory";
+		free(real);
+		return NULL;
+	}
+
+	archive = calloc(1, sizeof(ServedArchive));
+	if (!archive) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	archive->path = real;
+	archive->fd = statsOpen(real, O_RDONLY, 0);
+	if (archive->fd == -1) {
+		*why = strerror(errno);
+		freeServed(archive);
+		return NULL;
+	}
+	if ((status = indexArchive(archive)) != MT_OK) {
+		*why = status == MT_ERR_IO ? strerror(errno) :
+			mtStrerror(status);
+		freeServed(archive);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&server->lock);
+	for (i = 0; i < server->num_archives; i++) {
+		if (strcmp(server->archives[i]->path, real) == 0) {
+			break;
+		}
+	}
+	if (i < server->num_archives) {
+		freeServed(archive);
+		archive = server->archives[i];
+	}
+	else if (server->num_archives == SERVE_MAX_ARCHIVES && 
+			closeUnused(server) == -1) {
+		pthread_mutex_unlock(&server->lock);
+		freeServed(archive);
+		*why = "too many archives in use";
+		return NULL;
+	}
+	else {
+		if (server->num_archives == server->cap_archives) {
+			server->cap_archives = server->cap_archives ?
+				server->cap_archives * 2 :
+				SERVE_START_ARCHIVES;
+			server->archives = realloc(server->archives,
+					sizeof(ServedArchive *) *
+					server->cap_archives);
+			if (!server->archives) {
+				perror("realloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		archive->id = server->next_id;
+		server->next_id += 1;
+		server->archives[server->num_archives] = archive;
+		server->num_archives += 1;
+	}
+	archive->users += 1;
+	server->uses += 1;
+	archive->used = server->uses;
+	pthread_mutex_unlock(&server->lock);
+	return archive;
+}
+
+/* Lets an archive from serverArchive be closed again */
+void releaseArchive(Server *server, ServedArchive *archive) {
+	pthread_mutex_lock(&server->lock);
+	archive->users -= 1;
+	pthread_mutex_unlock(&server->lock);
+	return;
+}
+
+/* Writes all of len bytes to the client. Returns 0, or -1 if it went
+ * away. */
+int sendAll(int fd, const char *data, size_t len) {
+	ssize_t got;
+
+	while (len > 0) {
+		got = statsWrite(fd, data, len);
+		if (got == -1 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return -1;
+		}
+		data += got;
+		len -= got;
+	}
+	return 0;
+}
+
+/* Sends a member's contents to the client. Small members go through
+ * the block cache, since the same ones tend to be asked for over and
+ * over and a cached block saves a pread. Big ones would only push
+ * everything else out of it, so they're sent with sendfile straight
+ * from the page cache instead, without being copied through mytar at
+ * all. Returns 0, or -1 if the connection has to be dropped. */
+int sendMember(Client *client, ServedArchive *archive,
+		ServedMember *member) {
+	BlockCache *cache = &client->server->cache;
+	off_t offset = member->offset;
+	uint64_t left = member->size;
+	size_t n;
+	ssize_t got;
+
+	if (member->size >= SERVE_SENDFILE_MIN || cache->max_blocks == 0) {
+		while (left > 0) {
+			got = sendfile(client->fd, archive->fd, &offset,
+					left < COPY_CHUNK ? left : COPY_CHUNK);
+			if (got == -1 && errno == EINTR) {
+				continue;
+			}
+			/* A short archive can't make up what was promised */
+			if (got <= 0) {
+				return -1;
+			}
+			left -= got;
+		}
+		return 0;
+	}
+	while (left > 0) {
+		n = left < SERVE_BLOCK ? left : SERVE_BLOCK;
+		got = blockCacheRead(cache, archive->id, archive->fd,
+				client->buf, n, offset, client->scratch);
+		if (got != (ssize_t)n || sendAll(client->fd, client->buf, n)
+				== -1) {
+			return -1;
+		}
+		offset += n;
+		left -= n;
+	}
+	return 0;
+}
+
+/* Answers one request, a line holding an archive's path and a member's
+ * name separated by a tab, with "OK size" and a newline followed by
+ * the member's contents, or "ERR reason" and a newline. Returns 0, or
+ * -1 if the connection has to be dropped. */
+int handleRequest(Client *client, char *line) {
+	char reply[SERVE_REPLY_MAX];
+	char *name = strchr(line, '\t');
+	ServedArchive *archive = NULL;
+	ServedMember *member;
+	const char *why = NULL;
+	uint32_t hash = FNV_OFFSET;
+	size_t len;
+	size_t i;
+	int status;
+
+	if (!name) {
+		why = "bad request";
+	}
+	else {
+		*name = '\0';
+		name++;
+		archive = serverArchive(client->server, line, &why);
+	}
+	if (!why) {
+		len = strlen(name);
+		for (i = 0; i < len; i++) {
+			hash = hashStep(hash, name[i]);
+		}
+		member = findMember(archive, name, len, hash);
+		if (!member) {
+			why = "no such member";
+		}
+		else if (member->type != REG_FLAG) {
+			why = "not a regular file";
+		}
+	}
+	if (why) {
+		snprintf(reply, sizeof(reply), "ERR %s\n", why);
+		status = sendAll(client->fd, reply, strlen(reply));
+	}
+	else {
+		snprintf(reply, sizeof(reply), "OK %llu\n",
+				(unsigned long long)member->size);
+		status = sendAll(client->fd, reply, strlen(reply));
+		if (status == 0) {
+			statsEntry(member->size);
+			status = sendMember(client, archive, member);
+		}
+	}
+	if (archive) {
+		releaseArchive(client->server, archive);
+	}
+	return status;
+}
+
+/* Serves one connection's requests, one line at a time, until it's
+ * closed */
+void *clientThread(void *arg) {
+	Client *client = arg;
+	ssize_t got;
+	char *end;
+	size_t used;
+	int alive = 1;
+
+	while (alive && (got = read(client->fd,
+					client->line + client->line_len,
+					SERVE_LINE_MAX - client->line_len)) > 0) {
+		client->line_len += got;
+		while (alive && (end = memchr(client->line, '\n',
+						client->line_len)) != NULL) {
+			*end = '\0';
+			alive = handleRequest(client, client->line) == 0;
+			used = end + 1 - client->line;
+			memmove(client->line, end + 1,
+					client->line_len - used);
+			client->line_len -= used;
+		}
+		if (client->line_len == SERVE_LINE_MAX) {
+			sendAll(client->fd, "ERR request too long\n",
+					strlen("ERR request too long\n"));
+			alive = 0;
+		}
+	}
+	close(client->fd);
+	free(client->buf);
+	free(client->scratch);
+	free(client);
+	return NULL;
+}
+
+/* Runs --serve: listens on the Unix socket at opts->serve, which only
+ * its owner can connect to, and serves members of archives under
+ * opts->serve_root that clients ask for, each connection on its own
+ * thread, until SIGINT or SIGTERM. Archives stay open and indexed once
+ * they've been asked for, up to SERVE_MAX_ARCHIVES of them, and their
+ * blocks share one cache of opts->cache_size bytes. Returns the exit
+ * status. */
+int serveArchives(char *prog, Options *opts) {
+	Server server;
+	struct sockaddr_un addr;
+	struct sigaction action;
+	sigset_t stop_signals;
+	sigset_t old_mask;
+	struct pollfd pfd;
+	struct stat info;
+	mode_t old_umask;
+	int listen_fd;
+	int fd;
+	int status;
+	Client *client;
+	pthread_t thread;
+
+	if (strlen(opts->serve) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", prog);
+		return EXIT_FAILURE;
+	}
+	memset(&server, 0, sizeof(Server));
+	server.prog = prog;
+	server.opts = opts;
+	server.root = realpath(opts->serve_root ? opts->serve_root : ".", 
+			NULL);
+	if (!server.root) {
+		perror(opts->serve_root ? opts->serve_root : ".");
+		return EXIT_FAILURE;
+	}
+	pthread_mutex_init(&server.lock, NULL);
+	blockCacheInit(&server.cache, opts->cache_size);
+
+	/* A client going away mid-reply shouldn't take the server with
+	 * it. SIGINT and SIGTERM are blocked everywhere but in the wait
+	 * for connections, so client threads, which inherit the mask,
+	 * never take them, and one that comes just before the wait isn't
+	 * missed. */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &action, NULL);
+	action.sa_handler = stopServing;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+	/* Non-blocking, in case a connection that poll saw goes away
+	 * before it's accepted */
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listen_fd == -1) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	/* A socket left behind by a server that's gone */
+	if (lstat(opts->serve, &info) == 0 && S_ISSOCK(info.st_mode)) {
+		unlink(opts->serve);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, opts->serve);
+	/* The socket's permissions come from the umask */
+	old_umask = umask(SERVE_SOCKET_UMASK);
+	status = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_umask);
+	if (status == -1 || listen(listen_fd, SERVE_BACKLOG) == -1) {
+		perror(opts->serve);
+		close(listen_fd);
+		return EXIT_FAILURE;
+	}
+
+	pfd.fd = listen_fd;
+	pfd.events = POLLIN;
+	while (!stopping) {
+		if (ppoll(&pfd, 1, NULL, &old_mask) == -1) {
+			if (errno != EINTR) {
+				perror("poll");
+			}
+			continue;
+		}
+		/* Accepted sockets don't inherit O_NONBLOCK */
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1) {
+			if (errno != EAGAIN && errno != EINTR && 
+					errno != ECONNABORTED) {
+				perror("accept");
+			}
+			continue;
+		}
+		client = calloc(1, sizeof(Client));
+		if (!client || !(client->buf = malloc(SERVE_BLOCK)) ||
+				!(client->scratch = malloc(SERVE_BLOCK))) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+		client->server = &server;
+		client->fd = fd;
+		if (pthread_create(&thread, NULL, clientThread, client) != 0) {
+			fprintf(stderr, "%s: can't start client thread\n",
+					prog);
+			close(fd);
+			free(client->buf);
+			free(client->scratch);
+			free(client);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	/* Client threads may still be using the archives and the cache,
+	 * so they're left for exit to clean up */
+	if (stats.enabled) {
+		pthread_mutex_lock(&server.cache.lock);
+		fprintf(stderr, "%s: stats cache hits=%llu misses=%llu "
+				"blocks=%zu archives=%zu\n", prog,
+				(unsigned long long)server.cache.hits,
+				(unsigned long long)server.cache.misses,
+				server.cache.num_blocks, server.num_archives);
+		pthread_mutex_unlock(&server.cache.lock);
+	}
+	close(listen_fd);
+	unlink(opts->serve);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	return 0;
+}
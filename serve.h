@@ -0,0 +1,98 @@
+#ifndef SERVEH
+#define SERVEH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "mytar.h"
+#include "options.h"
+#include "libmytar.h"
+#include "blockcache.h"
+
+/* A member of a served archive, found by its name */
+typedef struct servedmember {
+	/* Where its name starts in the archive's names */
+	size_t name;
+	size_t len;
+	uint32_t hash;
+	char type;
+	/* Where its contents start in the archive, and how many there are */
+	off_t offset;
+	uint64_t size;
+} ServedMember;
+
+/* An archive the server has opened and indexed. It's read once, the
+ * first time it's asked for, and kept open until SERVE_MAX_ARCHIVES
+ * others have been asked for since. Later members with the same name
+ * replace earlier ones, like extracting would. */
+typedef struct servedarchive {
+	/* Its real path, which requests are matched against */
+	char *path;
+	int fd;
+	/* Which it is, for the block cache. Never reused, so blocks left
+	 * in the cache by an archive that was closed are never hit. */
+	int id;
+	/* Requests using it, which keep it from being closed, and when it
+	 * was last asked for, counting requests */
+	int users;
+	uint64_t used;
+	ServedMember *members;
+	size_t num_members;
+	size_t cap_members;
+	/* Open addressing hash set of indices into members plus one, with
+	 * 0 for an empty slot. Capacity is a power of two. */
+	size_t *slots;
+	size_t mask;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+} ServedArchive;
+
+/* State shared by every client thread of --serve */
+typedef struct server {
+	char *prog;
+	Options *opts;
+	/* The real path of the directory archives are served from */
+	char *root;
+	/* The archives open, guarded by lock, with the id and use count
+	 * for the next one */
+	ServedArchive **archives;
+	size_t num_archives;
+	size_t cap_archives;
+	int next_id;
+	uint64_t uses;
+	pthread_mutex_t lock;
+	BlockCache cache;
+} Server;
+
+/* One connection, served by its own thread */
+typedef struct client {
+	Server *server;
+	int fd;
+	/* The request line being read */
+	char line[SERVE_LINE_MAX];
+	size_t line_len;
+	/* Members' contents on their way out, and blocks on their way into
+	 * the cache */
+	char *buf;
+	char *scratch;
+} Client;
+
+ServedMember *findMember(ServedArchive *, const char *, size_t, uint32_t);
+void addMember(ServedArchive *, MtEntry *, off_t);
+int indexArchive(ServedArchive *);
+void freeServed(ServedArchive *);
+int underRoot(Server *, const char *);
+int closeUnused(Server *);
+ServedArchive *serverArchive(Server *, char *, const char **);
+void releaseArchive(Server *, ServedArchive *);
+int sendAll(int, const char *, size_t);
+int sendMember(Client *, ServedArchive *, ServedMember *);
+int handleRequest(Client *, char *);
+void *clientThread(void *);
+int serveArchives(char *, Options *);
+
+#endif
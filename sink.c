@@ -0,0 +1,159 @@
+/* splice is Linux specific */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "sink.h"
+#include "header.h"
+#include "extract.h"
+#include "stats.h"
+#include "mytar.h"
+
+/* Extracts into files on disk, like x always has, creating them in
+ * the directories kept by created */
+void sinkDisk(Sink *sink, DirCache *created) {
+	memset(sink, 0, sizeof(Sink));
+	sink->created = created;
+	sink->open = diskOpen;
+	sink->write = diskWrite;
+	sink->close = diskClose;
+	sink->tree = 1;
+	sink->fd = -1;
+	return;
+}
+
+/* Writes every member's contents, one after another, to stdout */
+void sinkStdout(Sink *sink) {
+	memset(sink, 0, sizeof(Sink));
+	sink->open = stdoutOpen;
+	sink->write = stdoutWrite;
+	sink->copy = stdoutCopy;
+	sink->close = stdoutClose;
+	sink->fd = STDOUT_FILENO;
+	return;
+}
+
+/* Creates a file with the original name and perms. as was archived,
+ * along with any of its directories that are missing */
+int diskOpen(Sink *sink, Header *header, char *name) {
+	/* Get the file protection modes that correspond to this file */
+	mode_t modes = (mode_t)strtol(header->mode, NULL, OCTAL_BASE);
+	const char *base;
+	int dirfd = dirCacheParent(sink->created, name, &base);
+
+	if (dirfd != -1) {
+		sink->fd = statsOpenat(dirfd, base, 
+				O_WRONLY | O_CREAT | O_TRUNC, modes);
+	}
+	if (dirfd == -1 || sink->fd == -1) {
+		perror(name);
+		return -1;
+	}
+	sink->name = name;
+	memset(&sink->cache, 0, sizeof(CacheRange));
+	return 0;
+}
+
+int diskWrite(Sink *sink, const char *data, size_t len) {
+	if (statsWrite(sink->fd, data, len) == -1) {
+		perror(sink->name);
+		exit(EXIT_FAILURE);
+	}
+	cacheWrote(&sink->cache, sink->fd, len);
+	return 0;
+}
+
+/* Restores the file's metadata, now that nothing more will be written
+ * to change its mtime */
+void diskClose(Sink *sink, Header *header) {
+	cacheFinish(&sink->cache, sink->fd, 0);
+	restoreMetadata(header, sink->fd);
+	close(sink->fd);
+	sink->fd = -1;
+	return;
+}
+
+int stdoutOpen(Sink *sink, Header *header, char *name) {
+	sink->name = name;
+	return 0;
+}
+
+int stdoutWrite(Sink *sink, const char *data, size_t len) {
+	if (statsWrite(STDOUT_FILENO, data, len) == -1) {
+		perror("stdout");
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+/* Copies a member's contents to stdout without them passing through
+ * mytar: with splice when stdout is a pipe, with sendfile otherwise,
+ * and if neither works on this stdout, through one big buffer rather
+ * than a block at a time. The archive's position moves past the
+ * contents either way. */
+int stdoutCopy(Sink *sink, int fdarchive, uint64_t size) {
+	uint64_t left = size;
+	ssize_t got;
+	char *buf;
+
+	while (left > 0 && !sink->no_splice) {
+		got = splice(fdarchive, NULL, STDOUT_FILENO, NULL,
+				left < COPY_CHUNK ? left : COPY_CHUNK,
+				SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (got == -1 && left == size && errno == EINVAL) {
+			sink->no_splice = 1;
+			break;
+		}
+		if (got <= 0) {
+			perror("splice");
+			exit(EXIT_FAILURE);
+		}
+		left -= got;
+	}
+	while (left > 0 && !sink->no_sendfile) {
+		got = sendfile(STDOUT_FILENO, fdarchive, NULL,
+				left < COPY_CHUNK ? left : COPY_CHUNK);
+		if (got == -1 && left == size && errno == EINVAL) {
+			sink->no_sendfile = 1;
+			break;
+		}
+		if (got <= 0) {
+			perror("sendfile");
+			exit(EXIT_FAILURE);
+		}
+		left -= got;
+	}
+	if (left == 0) {
+		return 0;
+	}
+
+	buf = malloc(COPY_CHUNK);
+	if (!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	while (left > 0) {
+		got = statsRead(fdarchive, buf,
+				left < COPY_CHUNK ? left : COPY_CHUNK);
+		if (got <= 0) {
+			fprintf(stderr, "error reading archive\n");
+			exit(EXIT_FAILURE);
+		}
+		stdoutWrite(sink, buf, got);
+		left -= got;
+	}
+	free(buf);
+	return 0;
+}
+
+void stdoutClose(Sink *sink, Header *header) {
+	return;
+}
@@ -0,0 +1,48 @@
+#ifndef SINKH
+#define SINKH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "header.h"
+#include "cache.h"
+#include "dircache.h"
+
+/* Where extracted members' contents go. extractArchive parses the
+ * archive the same way whatever the sink is, and hands each selected
+ * regular file to it: open is called with the member's header, then
+ * its contents are given to copy if the sink has one, or to write a
+ * block at a time, then close is called. */
+typedef struct sink {
+	/* Returns -1 if the member can't be taken, in which case its
+	 * contents are skipped and close isn't called */
+	int (*open)(struct sink *, Header *, char *);
+	int (*write)(struct sink *, const char *, size_t);
+	/* Moves size bytes straight from the archive's descriptor, or
+	 * returns -1 without having read anything if it can't */
+	int (*copy)(struct sink *, int, uint64_t);
+	void (*close)(struct sink *, Header *);
+	/* Directories and symlinks are created too, not just files */
+	int tree;
+	/* Where disk sinks make directories and look them up */
+	DirCache *created;
+	/* The file being written */
+	int fd;
+	char *name;
+	CacheRange cache;
+	/* Set once splice or sendfile turns out not to work on it */
+	int no_splice;
+	int no_sendfile;
+} Sink;
+
+void sinkDisk(Sink *, DirCache *);
+void sinkStdout(Sink *);
+int diskOpen(Sink *, Header *, char *);
+int diskWrite(Sink *, const char *, size_t);
+void diskClose(Sink *, Header *);
+int stdoutOpen(Sink *, Header *, char *);
+int stdoutWrite(Sink *, const char *, size_t);
+int stdoutCopy(Sink *, int, uint64_t);
+void stdoutClose(Sink *, Header *);
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "stats.h"
+#include "mytar.h"
+
+Stats stats;
+
+/* Names of each STAT_ kind in reports */
+const char *stat_names[STAT_KINDS] = {
+	"lstat", "open", "read", "write", "lseek", "readdir", "readlink",
+	"nss", "mkdir", "symlink", "meta", "chksum", "print"
+};
+
+/* Turns on counting and reports at exit. interval is how often, in
+ * seconds, a progress line is printed, or 0 for never. */
+void statsInit(char *prog, double interval) {
+	memset(&stats, 0, sizeof(Stats));
+	stats.enabled = 1;
+	stats.prog = prog;
+	stats.interval = interval;
+	stats.start = statsNow();
+	stats.last_report = stats.start;
+	atexit(statsReport);
+	return;
+}
+
+/* Monotonic time in nanoseconds */
+uint64_t statsNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+}
+
+/* Starts timing something, returns 0 if stats aren't enabled */
+uint64_t statsStart(void) {
+	if (!stats.enabled) {
+		return 0;
+	}
+	return statsNow();
+}
+
+/* Counts one call of kind that started at start and moved bytes */
+void statsAdd(int kind, uint64_t start, uint64_t bytes) {
+	if (!stats.enabled) {
+		return;
+	}
+	atomic_fetch_add_explicit(&stats.count[kind], 1, 
+			memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.nanos[kind], statsNow() - start,
+			memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.kind_bytes[kind], bytes,
+			memory_order_relaxed);
+	return;
+}
+
+/* Counts a member with bytes of data, printing a progress line if the
+ * interval has passed */
+void statsEntry(uint64_t bytes) {
+	uint64_t now;
+
+	if (!stats.enabled) {
+		return;
+	}
+	atomic_fetch_add_explicit(&stats.entries, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.bytes, bytes, memory_order_relaxed);
+	if (stats.interval > 0) {
+		now = statsNow();
+		if (now - stats.last_report >= 
+				stats.interval * NANOS_PER_SEC) {
+			stats.last_report = now;
+			statsLine("progress");
+		}
+	}
+	return;
+}
+
+/* Counts a file that extraction left alone, whose bytes of contents
+ * didn't have to be written */
+void statsSkipped(uint64_t bytes) {
+	if (!stats.enabled) {
+		return;
+	}
+	atomic_fetch_add_explicit(&stats.skipped, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats.skipped_bytes, bytes, 
+			memory_order_relaxed);
+	return;
+}
+
+/* Prints the totals and rates so far as one key=value line */
+void statsLine(char *label) {
+	double secs = (statsNow() - stats.start) / (double)NANOS_PER_SEC;
+
+	if (secs <= 0) {
+		secs = 1.0 / NANOS_PER_SEC;
+	}
+	fprintf(stderr, "%s: stats %s elapsed=%.6f entries=%llu bytes=%llu "
+			"mb_per_s=%.2f entries_per_s=%.1f allocs=%llu "
+			"input_s=%.6f output_s=%.6f skipped=%llu "
+			"skipped_bytes=%llu\n", stats.prog, label, secs,
+			(unsigned long long)stats.entries,
+			(unsigned long long)stats.bytes,
+			stats.bytes / secs / BYTES_PER_MB,
+			stats.entries / secs,
+			(unsigned long long)stats.allocs,
+			stats.nanos[STAT_READ] / (double)NANOS_PER_SEC,
+			stats.nanos[STAT_WRITE] / (double)NANOS_PER_SEC,
+			(unsigned long long)stats.skipped,
+			(unsigned long long)stats.skipped_bytes);
+	return;
+}
+
+/* Prints the final totals and a line for every kind that was used.
+ * Runs at exit, so it also reports runs that end in an error. */
+void statsReport(void) {
+	int i;
+
+	if (!stats.enabled) {
+		return;
+	}
+	fflush(stdout);
+	statsLine("total");
+	for (i = 0; i < STAT_KINDS; i++) {
+		if (stats.count[i] == 0) {
+			continue;
+		}
+		fprintf(stderr, "%s: stats call=%s count=%llu seconds=%.6f "
+				"bytes=%llu\n", stats.prog, stat_names[i],
+				(unsigned long long)stats.count[i],
+				stats.nanos[i] / (double)NANOS_PER_SEC,
+				(unsigned long long)stats.kind_bytes[i]);
+	}
+	return;
+}
+
+int statsLstat(const char *path, struct stat *buf) {
+	uint64_t start = statsStart();
+	int res = lstat(path, buf);
+
+	statsAdd(STAT_LSTAT, start, 0);
+	return res;
+}
+
+int statsFstatat(int dirfd, const char *path, struct stat *buf, 
+		int flags) {
+	uint64_t start = statsStart();
+	int res = fstatat(dirfd, path, buf, flags);
+
+	statsAdd(STAT_LSTAT, start, 0);
+	return res;
+}
+
+int statsOpen(const char *path, int flags, mode_t mode) {
+	uint64_t start = statsStart();
+	int res = open(path, flags, mode);
+
+	statsAdd(STAT_OPEN, start, 0);
+	return res;
+}
+
+ssize_t statsRead(int fd, void *buf, size_t count) {
+	uint64_t start = statsStart();
+	ssize_t res = read(fd, buf, count);
+
+	statsAdd(STAT_READ, start, res > 0 ? res : 0);
+	return res;
+}
+
+ssize_t statsWrite(int fd, const void *buf, size_t count) {
+	uint64_t start = statsStart();
+	ssize_t res = write(fd, buf, count);
+
+	statsAdd(STAT_WRITE, start, res > 0 ? res : 0);
+	return res;
+}
+
+off_t statsLseek(int fd, off_t offset, int whence) {
+	uint64_t start = statsStart();
+	off_t res = lseek(fd, offset, whence);
+
+	statsAdd(STAT_LSEEK, start, 0);
+	return res;
+}
+
+ssize_t statsReadlink(const char *path, char *buf, size_t size) {
+	uint64_t start = statsStart();
+	ssize_t res = readlink(path, buf, size);
+
+	statsAdd(STAT_READLINK, start, 0);
+	return res;
+}
+
+ssize_t statsReadlinkat(int dirfd, const char *path, char *buf, 
+		size_t size) {
+	uint64_t start = statsStart();
+	ssize_t res = readlinkat(dirfd, path, buf, size);
+
+	statsAdd(STAT_READLINK, start, 0);
+	return res;
+}
+
+struct passwd *statsGetpwuid(uid_t uid) {
+	uint64_t start = statsStart();
+	struct passwd *res = getpwuid(uid);
+
+	statsAdd(STAT_NSS, start, 0);
+	return res;
+}
+
+struct group *statsGetgrgid(gid_t gid) {
+	uint64_t start = statsStart();
+	struct group *res = getgrgid(gid);
+
+	statsAdd(STAT_NSS, start, 0);
+	return res;
+}
+
+int statsOpenat(int dirfd, const char *path, int flags, mode_t mode) {
+	uint64_t start = statsStart();
+	int res = openat(dirfd, path, flags, mode);
+
+	statsAdd(STAT_OPEN, start, 0);
+	return res;
+}
+
+int statsMkdirat(int dirfd, const char *path, mode_t mode) {
+	uint64_t start = statsStart();
+	int res = mkdirat(dirfd, path, mode);
+
+	statsAdd(STAT_MKDIR, start, 0);
+	return res;
+}
+
+int statsSymlinkat(const char *target, int dirfd, const char *path) {
+	uint64_t start = statsStart();
+	int res = symlinkat(target, dirfd, path);
+
+	statsAdd(STAT_SYMLINK, start, 0);
+	return res;
+}
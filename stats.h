@@ -0,0 +1,79 @@
+#ifndef STATSH
+#define STATSH
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* The calls and phases that --stats counts and times */
+#define STAT_LSTAT 0
+#define STAT_OPEN 1
+#define STAT_READ 2
+#define STAT_WRITE 3
+#define STAT_LSEEK 4
+#define STAT_READDIR 5
+#define STAT_READLINK 6
+#define STAT_NSS 7
+#define STAT_MKDIR 8
+#define STAT_SYMLINK 9
+#define STAT_META 10
+#define STAT_CHKSUM 11
+#define STAT_PRINT 12
+#define STAT_KINDS 13
+
+/* Counters for --stats. There's a single instance, stats, which every
+ * module bumps through the wrappers below. When stats aren't enabled
+ * the wrappers cost one branch on top of the call they wrap. Stripes
+ * are written and extracted on several threads at once, so like
+ * progress's the counters only ever get relaxed atomic adds. */
+typedef struct stats {
+	int enabled;
+	/* Seconds between periodic reports, 0 to only report at exit */
+	double interval;
+	char *prog;
+	uint64_t start;
+	atomic_ullong last_report;
+	atomic_ullong entries;
+	/* Member data bytes read or written */
+	atomic_ullong bytes;
+	/* Mallocs made by the arenas */
+	atomic_ullong allocs;
+	/* Files left as they were instead of being extracted, and the
+	 * bytes of contents that weren't written because of it */
+	atomic_ullong skipped;
+	atomic_ullong skipped_bytes;
+	atomic_ullong count[STAT_KINDS];
+	atomic_ullong nanos[STAT_KINDS];
+	atomic_ullong kind_bytes[STAT_KINDS];
+} Stats;
+
+extern Stats stats;
+
+void statsInit(char *, double);
+uint64_t statsNow(void);
+uint64_t statsStart(void);
+void statsAdd(int, uint64_t, uint64_t);
+void statsEntry(uint64_t);
+void statsSkipped(uint64_t);
+void statsLine(char *);
+void statsReport(void);
+
+int statsLstat(const char *, struct stat *);
+int statsFstatat(int, const char *, struct stat *, int);
+int statsOpen(const char *, int, mode_t);
+int statsOpenat(int, const char *, int, mode_t);
+ssize_t statsRead(int, void *, size_t);
+ssize_t statsWrite(int, const void *, size_t);
+off_t statsLseek(int, off_t, int);
+ssize_t statsReadlink(const char *, char *, size_t);
+ssize_t statsReadlinkat(int, const char *, char *, size_t);
+struct passwd *statsGetpwuid(uid_t);
+struct group *statsGetgrgid(gid_t);
+int statsMkdirat(int, const char *, mode_t);
+int statsSymlinkat(const char *, int, const char *);
+
+#endif
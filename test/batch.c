@@ -0,0 +1,163 @@
+/* Checks the header decoding in batch.c against fields whose values
+ * are known. batch.c is included whole so its static field decoders
+ * can be called directly, since a fallback to parseOctal would hide a
+ * decoder that never succeeds. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../batch.c"
+
+int failures = 0;
+
+void check(const char *what, long long got, long long want) {
+	if (got != want) {
+		fprintf(stderr, "%s: got %lld, want %lld\n", what, got, want);
+		failures += 1;
+	}
+	return;
+}
+
+/* Makes a ustar header with the given fields and a right checksum */
+void makeHeader(Header *header, const char *mode, const char *size,
+		const char *mtime, char type) {
+	memset(header, 0, sizeof(Header));
+	strcpy(header->name, "file");
+	memcpy(header->mode, mode, MODE_SIZE);
+	memcpy(header->size, size, SIZE_SIZE);
+	memcpy(header->mtime, mtime, MTIME_SIZE);
+	*header->typeflag = type;
+	memcpy(header->magic, MAGIC_NUM, MAGIC_SIZE);
+	memcpy(header->version, VERSION_NUM, VERSION_SIZE);
+	sprintf(header->chksum, "%06o", getChksum(header));
+	return;
+}
+
+#ifdef __SSE2__
+void checkFields(void) {
+	/* The size and mtime fields are 12 bytes, with room to load past
+	 * them as they have in a header */
+	char field[32];
+	mode_t a;
+	mode_t b;
+	Header first;
+	Header second;
+	int64_t values[4];
+
+	memset(field, 0, sizeof(field));
+	memcpy(field, "00000001234", SIZE_SIZE);
+	check("octal12 00000001234", octal12(field), 01234);
+	memcpy(field, "77777777777 ", SIZE_SIZE);
+	check("octal12 77777777777", octal12(field), 077777777777LL);
+	memcpy(field, "00000000000", SIZE_SIZE);
+	check("octal12 00000000000", octal12(field), 0);
+	memcpy(field, "12345670123", SIZE_SIZE);
+	check("octal12 12345670123", octal12(field), 012345670123LL);
+	memcpy(field, "70000000000", SIZE_SIZE);
+	check("octal12 70000000000", octal12(field), 070000000000LL);
+	/* Left to parseOctal */
+	memcpy(field, "       1234", SIZE_SIZE);
+	check("octal12 leading spaces", octal12(field), -1);
+	memcpy(field, "00000001238", SIZE_SIZE);
+	check("octal12 digit 8", octal12(field), -1);
+	memcpy(field, "000000012345", SIZE_SIZE);
+	check("octal12 no ending", octal12(field), -1);
+	memset(field, 0, SIZE_SIZE);
+	field[0] = (char)0x80;
+	field[SIZE_SIZE - 1] = 1;
+	check("octal12 base-256", octal12(field), -1);
+
+	memset(field, 0, sizeof(field));
+	memcpy(field, "0000755", MODE_SIZE);
+	memcpy(field + 16, "0100644 ", MODE_SIZE);
+	check("octalModes", octalModes(field, field + 16, &a, &b), 0);
+	check("octalModes 0000755", a, 0755);
+	check("octalModes 0100644", b, 0100644);
+	memcpy(field + 16, "   644 ", MODE_SIZE);
+	check("octalModes leading spaces", octalModes(field, field + 16,
+				&a, &b), -1);
+
+	makeHeader(&first, "0000644", "00000001750", "14567701234",
+			REG_FLAG);
+	makeHeader(&second, "0000755", "77777777777 ", "00000000001",
+			REG_FLAG);
+	check("octalNumbers", octalNumbers(&first, &second, values), 0);
+	check("octalNumbers size a", values[0], 01750);
+	check("octalNumbers size b", values[1], 077777777777LL);
+	check("octalNumbers mtime a", values[2], 014567701234LL);
+	check("octalNumbers mtime b", values[3], 1);
+	makeHeader(&second, "0000755", "00000000001", "   01234567 ",
+			REG_FLAG);
+	check("octalNumbers leading spaces", octalNumbers(&first, &second,
+				values), -1);
+	makeHeader(&second, "0000755", "00000000001", "00000000008",
+			REG_FLAG);
+	check("octalNumbers digit 8", octalNumbers(&first, &second,
+				values), -1);
+	return;
+}
+#endif
+
+/* Decodes a run of headers and blocks that aren't headers, paired up
+ * across the ones that aren't, with one left over */
+void checkBatch(void) {
+	Header blocks[7];
+	MtHeaderBatch batch;
+
+	makeHeader(&blocks[0], "0000644", "00000001750", "14567701234",
+			REG_FLAG);
+	memset(&blocks[1], 'x', BLOCK_SIZE);
+	makeHeader(&blocks[2], "0000755", "00000000000", "00000000001",
+			DIR_FLAG);
+	makeHeader(&blocks[3], "   600 ", "       1000 ", "   01234567 ",
+			REG_FLAG);
+	makeHeader(&blocks[4], "0000644", "00000000001", "00000000001",
+			REG_FLAG);
+	/* A bad checksum */
+	blocks[4].chksum[0] ^= 1;
+	makeHeader(&blocks[5], "0000640", "00000004000", "13000000000",
+			REG_FLAG);
+	makeHeader(&blocks[6], "0000600", "00000000012", "00000000034",
+			REG_FLAG);
+
+	mtBatchInit(&batch);
+	check("mtDecodeHeaders", mtDecodeHeaders(&batch, blocks, 7), MT_OK);
+	check("count", batch.count, 7);
+	check("valid 0", batch.valid[0], 1);
+	check("valid 1", batch.valid[1], 0);
+	check("valid 2", batch.valid[2], 1);
+	check("valid 3", batch.valid[3], 1);
+	check("valid 4", batch.valid[4], 0);
+	check("type 0", batch.type[0], REG_FLAG);
+	check("mode 0", batch.mode[0], 0644);
+	check("size 0", batch.size[0], 01750);
+	check("mtime 0", batch.mtime[0], 014567701234LL);
+	check("type 2", batch.type[2], DIR_FLAG);
+	check("mode 2", batch.mode[2], 0755);
+	check("size 2", batch.size[2], 0);
+	check("mtime 2", batch.mtime[2], 1);
+	check("mode 3", batch.mode[3], 0600);
+	check("size 3", batch.size[3], 01000);
+	check("mtime 3", batch.mtime[3], 01234567);
+	check("mode 5", batch.mode[5], 0640);
+	check("size 5", batch.size[5], 04000);
+	check("mtime 5", batch.mtime[5], 013000000000LL);
+	check("mode 6", batch.mode[6], 0600);
+	check("size 6", batch.size[6], 012);
+	check("mtime 6", batch.mtime[6], 034);
+	mtBatchFree(&batch);
+	return;
+}
+
+int main(void) {
+#ifdef __SSE2__
+	checkFields();
+#endif
+	checkBatch();
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("batch: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,129 @@
+/* Checks that mtReaderExtract hands members' contents to a sink whole
+ * and in order, reading the archive from its descriptor and from a
+ * mapping of it. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../libmytar.h"
+
+int failures = 0;
+
+void check(const char *what, long long got, long long want) {
+	if (got != want) {
+		fprintf(stderr, "%s: got %lld, want %lld\n", what, got, want);
+		failures += 1;
+	}
+	return;
+}
+
+/* A sink that takes nothing */
+int refuse(void *arg, const void *data, size_t len) {
+	return -1;
+}
+
+/* Fills the contents of a member of size bytes the same way every time,
+ * so what's extracted can be checked against it */
+void fill(char *data, size_t size, int seed) {
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		data[i] = (char)(i * 7 + seed);
+	}
+	return;
+}
+
+/* Writes members of the given sizes to fd */
+void writeArchive(int fd, const size_t *sizes, int count, char *data) {
+	MtWriter writer;
+	MtEntry entry;
+	int i;
+
+	mtWriterInit(&writer, fd, 0);
+	for (i = 0; i < count; i++) {
+		memset(&entry, 0, sizeof(MtEntry));
+		sprintf(entry.name, "member%d", i);
+		entry.type = REG_FLAG;
+		entry.mode = 0644;
+		entry.size = sizes[i];
+		fill(data, sizes[i], i);
+		check("mtWriterBegin", mtWriterBegin(&writer, &entry), MT_OK);
+		check("mtWriterWrite", mtWriterWrite(&writer, data, sizes[i]),
+				MT_OK);
+		check("mtWriterEnd", mtWriterEnd(&writer), MT_OK);
+	}
+	check("mtWriterClose", mtWriterClose(&writer), MT_OK);
+	return;
+}
+
+/* Extracts every member into a memory sink and compares it, the last
+ * one going to a sink that refuses it */
+void readArchive(const char *what, int fd, const void *map, off_t size,
+		const size_t *sizes, int count, char *data) {
+	MtReader reader;
+	MtEntry entry;
+	MtSink sink;
+	MtSink refusing = {refuse, NULL};
+	MtBuffer buffer;
+	int i = 0;
+
+	lseek(fd, 0, SEEK_SET);
+	mtReaderInit(&reader, fd, 0);
+	if (map) {
+		mtReaderMap(&reader, map, size);
+	}
+	mtSinkMemory(&sink, &buffer);
+	while (mtReaderNext(&reader, &entry) == MT_OK) {
+		if (i == count - 1) {
+			check(what, mtReaderExtract(&reader, &refusing),
+					MT_ERR_SINK);
+			i += 1;
+			continue;
+		}
+		buffer.len = 0;
+		check(what, mtReaderExtract(&reader, &sink), MT_OK);
+		check(what, buffer.len, sizes[i]);
+		fill(data, sizes[i], i);
+		check(what, memcmp(buffer.data, data, sizes[i]) == 0, 1);
+		i += 1;
+	}
+	check(what, i, count);
+	mtBufferFree(&buffer);
+	return;
+}
+
+int main(void) {
+	/* Empty, under a block, several chunks and a bit, and one more
+	 * for the refusing sink */
+	size_t sizes[] = {0, 3, 3 * EXTRACT_CHUNK + 100, 10};
+	int count = sizeof(sizes) / sizeof(sizes[0]);
+	char *data = malloc(sizes[2]);
+	FILE *file = tmpfile();
+	off_t size;
+	void *map;
+
+	if (!data || !file) {
+		perror("test/reader");
+		return EXIT_FAILURE;
+	}
+	writeArchive(fileno(file), sizes, count, data);
+	readArchive("descriptor", fileno(file), NULL, 0, sizes, count, data);
+	size = lseek(fileno(file), 0, SEEK_END);
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+	readArchive("mapping", fileno(file), map, size, sizes, count, data);
+	munmap(map, size);
+	fclose(file);
+	free(data);
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("reader: all checks passed\n");
+	return 0;
+}
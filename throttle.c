@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "throttle.h"
+#include "options.h"
+#include "stats.h"
+#include "mytar.h"
+
+Throttle throttle;
+
+/* Asks whoever pays next to read the control file again */
+void reloadControl(int sig) {
+	(void)sig;
+	atomic_store_explicit(&throttle.reload, 1, memory_order_relaxed);
+	return;
+}
+
+/* Reads the limits in the --throttle-file, one per line as a name and
+ * a value, like "write-limit 20M". Blank lines and lines starting with
+ * '#' are skipped, a limit that's left out keeps the value it had, and
+ * 0 lifts one. Nothing changes unless the whole file can be read.
+ * Returns 0, or -1 after saying what's wrong with it. */
+int loadControl(void) {
+	FILE *file = fopen(throttle.control, "r");
+	char line[THROTTLE_LINE_MAX];
+	char name[THROTTLE_LINE_MAX];
+	char value[THROTTLE_LINE_MAX];
+	uint64_t limits[4];
+	uint64_t val;
+	int line_num = 0;
+	int i;
+
+	if (!file) {
+		perror(throttle.control);
+		return -1;
+	}
+	limits[0] = throttle.read.rate;
+	limits[1] = throttle.read.ops;
+	limits[2] = throttle.write.rate;
+	limits[3] = throttle.write.ops;
+	while (fgets(line, sizeof(line), file)) {
+		line_num += 1;
+		if (sscanf(line, "%s", name) != 1 || name[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%s %s", name, value) != 2 ||
+				parseSize(value, &val) == -1) {
+			i = -1;
+		}
+		else if (strcmp(name, "read-limit") == 0) {
+			i = 0;
+		}
+		else if (strcmp(name, "read-iops") == 0) {
+			i = 1;
+		}
+		else if (strcmp(name, "write-limit") == 0) {
+			i = 2;
+		}
+		else if (strcmp(name, "write-iops") == 0) {
+			i = 3;
+		}
+		else {
+			i = -1;
+		}
+		if (i == -1) {
+			fprintf(stderr, "%s: %s:%d: expected a limit and its "
+					"value\n", throttle.prog,
+					throttle.control, line_num);
+			fclose(file);
+			return -1;
+		}
+		limits[i] = val;
+	}
+	fclose(file);
+	throttle.read.rate = limits[0];
+	throttle.read.ops = limits[1];
+	throttle.write.rate = limits[2];
+	throttle.write.ops = limits[3];
+	return 0;
+}
+
+/* Turns on the limits in opts, if there are any, and with
+ * --throttle-file reads the limits in it over them and reads it again
+ * whenever mytar gets SIGHUP */
+void throttleInit(char *prog, Options *opts) {
+	struct sigaction action;
+
+	memset(&throttle, 0, sizeof(Throttle));
+	throttle.prog = prog;
+	throttle.read.rate = opts->read_limit;
+	throttle.read.ops = opts->read_iops;
+	throttle.write.rate = opts->write_limit;
+	throttle.write.ops = opts->write_iops;
+	throttle.control = opts->throttle_file;
+	throttle.enabled = throttle.read.rate || throttle.read.ops ||
+		throttle.write.rate || throttle.write.ops || throttle.control;
+	if (!throttle.enabled) {
+		return;
+	}
+	if (throttle.control) {
+		if (loadControl() == -1) {
+			exit(EXIT_FAILURE);
+		}
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = reloadControl;
+		sigaction(SIGHUP, &action, NULL);
+	}
+	pthread_mutex_init(&throttle.lock, NULL);
+	throttle.last = statsNow();
+	return;
+}
+
+/* Adds what's come in to a bucket since the last fill, keeping at most
+ * a second's worth so a pause doesn't turn into a burst, though never
+ * less than one payment's worth so a payment can always go through */
+void fillBucket(Bucket *bucket, double seconds) {
+	double most;
+
+	if (bucket->rate) {
+		most = bucket->rate > THROTTLE_CHUNK ?
+			bucket->rate : THROTTLE_CHUNK;
+		bucket->bytes += bucket->rate * seconds;
+		if (bucket->bytes > most) {
+			bucket->bytes = most;
+		}
+	}
+	if (bucket->ops) {
+		most = bucket->ops > THROTTLE_OPS ? bucket->ops : THROTTLE_OPS;
+		bucket->calls += bucket->ops * seconds;
+		if (bucket->calls > most) {
+			bucket->calls = most;
+		}
+	}
+	return;
+}
+
+/* Seconds until a bucket is out of debt */
+double bucketWait(Bucket *bucket) {
+	double wait = 0;
+	double calls;
+
+	if (bucket->rate && bucket->bytes < 0) {
+		wait = -bucket->bytes / bucket->rate;
+	}
+	if (bucket->ops && bucket->calls < 0) {
+		calls = -bucket->calls / bucket->ops;
+		wait = calls > wait ? calls : wait;
+	}
+	return wait;
+}
+
+/* Takes what debt owes out of bucket and waits until the bucket's no
+ * longer in debt. Every caller waits off the whole debt, so stripes
+ * paying at once share the limit between them. The wait is done a
+ * THROTTLE_TICK at a time, so new limits from the control file apply
+ * within one. */
+void throttlePay(Bucket *bucket, Debt *debt) {
+	uint64_t now;
+	double wait;
+	struct timespec ts;
+
+	pthread_mutex_lock(&throttle.lock);
+	if (bucket->rate) {
+		bucket->bytes -= debt->bytes;
+	}
+	if (bucket->ops) {
+		bucket->calls -= debt->ops;
+	}
+	debt->bytes = 0;
+	debt->ops = 0;
+	for (;;) {
+		if (atomic_exchange_explicit(&throttle.reload, 0,
+					memory_order_relaxed) &&
+				loadControl() == -1) {
+			fprintf(stderr, "%s: keeping the limits as they "
+					"were\n", throttle.prog);
+		}
+		now = statsNow();
+		fillBucket(&throttle.read,
+				(double)(now - throttle.last) / NANOS_PER_SEC);
+		fillBucket(&throttle.write,
+				(double)(now - throttle.last) / NANOS_PER_SEC);
+		throttle.last = now;
+		wait = bucketWait(bucket);
+		pthread_mutex_unlock(&throttle.lock);
+		if (wait <= 0) {
+			return;
+		}
+		if (wait > THROTTLE_TICK) {
+			wait = THROTTLE_TICK;
+		}
+		ts.tv_sec = (time_t)wait;
+		ts.tv_nsec = (long)((wait - ts.tv_sec) * NANOS_PER_SEC);
+		nanosleep(&ts, NULL);
+		pthread_mutex_lock(&throttle.lock);
+	}
+}
+
+/* Counts a read of bytes from a source file, paying for what's been
+ * read once there's enough of it */
+void throttleRead(Debt *debt, uint64_t bytes) {
+	if (!throttle.enabled) {
+		return;
+	}
+	debt->bytes += bytes;
+	debt->ops += 1;
+	if (debt->bytes >= THROTTLE_CHUNK || debt->ops >= THROTTLE_OPS) {
+		throttlePay(&throttle.read, debt);
+	}
+	return;
+}
+
+/* Counts a write of bytes to the archive, like throttleRead */
+void throttleWrite(Debt *debt, uint64_t bytes) {
+	if (!throttle.enabled) {
+		return;
+	}
+	debt->bytes += bytes;
+	debt->ops += 1;
+	if (debt->bytes >= THROTTLE_CHUNK || debt->ops >= THROTTLE_OPS) {
+		throttlePay(&throttle.write, debt);
+	}
+	return;
+}
@@ -0,0 +1,59 @@
+#ifndef THROTTLEH
+#define THROTTLEH
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "options.h"
+
+/* A token bucket for one direction of I/O, with a cap on bytes and
+ * one on operations per second, either of which may be 0 for none */
+typedef struct bucket {
+	uint64_t rate;
+	uint64_t ops;
+	/* What's left to spend, which goes below 0 while callers wait off
+	 * what they took */
+	double bytes;
+	double calls;
+} Bucket;
+
+/* I/O done since it was last paid for. Each stripe keeps its own, so
+ * the shared buckets are only locked every THROTTLE_CHUNK bytes or
+ * THROTTLE_OPS operations rather than on every block. */
+typedef struct debt {
+	uint64_t bytes;
+	uint64_t ops;
+} Debt;
+
+/* The limits for --read-limit, --write-limit and friends. Like cache
+ * there's a single instance, shared by every stripe, so the limits are
+ * on mytar as a whole. Without any of the options every call costs one
+ * branch. */
+typedef struct throttle {
+	int enabled;
+	char *prog;
+	/* Source files read, and the archive written */
+	Bucket read;
+	Bucket write;
+	/* When the buckets were last filled */
+	uint64_t last;
+	/* The file given with --throttle-file, read again on SIGHUP, or
+	 * NULL */
+	char *control;
+	atomic_int reload;
+	pthread_mutex_t lock;
+} Throttle;
+
+extern Throttle throttle;
+
+void reloadControl(int);
+int loadControl(void);
+void throttleInit(char *, Options *);
+void fillBucket(Bucket *, double);
+double bucketWait(Bucket *);
+void throttlePay(Bucket *, Debt *);
+void throttleRead(Debt *, uint64_t);
+void throttleWrite(Debt *, uint64_t);
+
+#endif
@@ -7,6 +7,8 @@
 
 #include "header.h"
 #include "mytar.h"
+#include "utilities.h"
+#include "libmytar.h"
 
 uint32_t extract_special_int(char *where, int len) {
 	int32_t val = -1;
@@ -39,124 +41,114 @@ int insert_special_int(char *where, size_t size, int32_t val) {
 	return err;
 }
 
+/* Reads a uid or gid field, which is either octal or, if it was too
+ * big for 7 octal digits, stored as a special int. */
+long int getHeaderId(char *where, int len) {
+	if (where[0] & 0x80) {
+		return (long int)extract_special_int(where, len);
+	}
+	return strtol(where, NULL, OCTAL_BASE);
+}
+
+/* Parses a numeric header field of len characters: octal digits,
+ * possibly with leading spaces and ended by a space or null byte, or a
+ * special int if the high bit is set. Quicker than strtol since the
+ * field's length is known and there's no sign or base to look for. */
+unsigned long parseOctal(const char *where, size_t len) {
+	unsigned long val = 0;
+	size_t i = 0;
+
+	if (where[0] & 0x80) {
+		return (unsigned long)extract_special_int((char *)where, len);
+	}
+	while (i < len && where[i] == ' ') {
+		i++;
+	}
+	while (i < len && where[i] >= '0' && where[i] <= '7') {
+		val = (val << 3) | (where[i] - '0');
+		i++;
+	}
+	return val;
+}
+
+/* Builds a member's full name from its prefix and name fields, which
+ * aren't necessarily null-terminated, into name, which must hold
+ * PATH_LIMIT + 1 characters. Returns the name's length, or -1 if it
+ * would be longer than PATH_LIMIT. */
+int getName(Header *header, char *name) {
+	size_t name_len = strnlen(header->name, NAME_SIZE);
+	size_t prefix_len = strnlen(header->prefix, PREFIX_SIZE);
+
+	/* No prefix, so entire name is just in name field */
+	if (prefix_len == 0) {
+		memcpy(name, header->name, name_len);
+		name[name_len] = '\0';
+		return name_len;
+	}
+	if (prefix_len + 1 + name_len > PATH_LIMIT) {
+		return -1;
+	}
+	memcpy(name, header->prefix, prefix_len);
+	name[prefix_len] = '/';
+	memcpy(name + prefix_len + 1, header->name, name_len);
+	name[prefix_len + 1 + name_len] = '\0';
+	return prefix_len + 1 + name_len;
+}
+
 /* Calculates and sets the check sum of a header */
 void setChksum(Header *header) {
+	sprintf(header->chksum, "%07o", getChksum(header));
+	return;
+}
+
+/* Checks if a block is nothing but zero bytes, like the two blocks
+ * that mark the end of an archive */
+int isZeroBlock(Header *header) {
 	int i;
-	unsigned int chksum = 0;
-	/* Loop through the entire header, skipping over the chksum field
-	 * to calculate the chksum */
+	const unsigned char *block = (const unsigned char *)header;
+
 	for (i = 0; i < BLOCK_SIZE; i++) {
-		/* These are the bounds of the chksum field */
-		if (i >= CHKSUM_OFFSET && i <= CHKSUM_OFFSET + CHKSUM_SIZE -1) {
-			continue;
+		if (block[i] != '\0') {
+			return 0;
 		}
-		/* Type cast header to an unsigned char pointer otherwise 
-		 * incompatible types and can't add */
-		chksum += ((unsigned char *)header)[i];
 	}
-	/* Add in 8 spaces which represent the initial checksum */ 
-	chksum += CHKSUM_SIZE * ' ';
-	sprintf(header->chksum, "%07o", chksum);
-	return;
+	return 1;
 }
 
-/* Same logic as setChksum, only we return the checksum instead */
+/* Calculates what the checksum of a header should be. Rather than
+ * skipping over the chksum field inside the loop, every byte is added
+ * up and the field is swapped for 8 spaces afterwards. Without a branch
+ * in it, the compiler can vectorize the loop, which matters when
+ * scanning for headers in every block of an archive. */
 unsigned int getChksum(Header *header) {
 	int i;
 	unsigned int chksum = 0;
-	/* Loop through the entire header, skipping over the chksum field
-	 * to calculate the chksum */
+	const unsigned char *block = (const unsigned char *)header;
+
 	for (i = 0; i < BLOCK_SIZE; i++) {
-		/* These are the bounds of the chksum field */
-		if (i >= CHKSUM_OFFSET && i <= CHKSUM_OFFSET + CHKSUM_SIZE -1) {
-			continue;
-		}
-		/* Type cast header to an unsigned char pointer otherwise 
-		 * incompatible types and can't add */
-		chksum += ((unsigned char *)header)[i];
+		chksum += block[i];
+	}
+	for (i = CHKSUM_OFFSET; i < CHKSUM_OFFSET + CHKSUM_SIZE; i++) {
+		chksum -= block[i];
 	}
 	/* Add in 8 spaces which represent the initial checksum */ 
 	chksum += CHKSUM_SIZE * ' ';
 	return chksum;
 }
 
-/* Checks if a header's magic and version fields are "ustar" null-
- * terminated and "00" respectively. */
-void strictCheck(Header *header) {
-	uint32_t num = 0;
-	/* Checks if the header->magic field is "ustar" null-terminated */
-	if (strncmp(header->magic, "ustar", MAGIC_SIZE) != 0) {
-		fprintf(stderr, "Header magic field not valid\n");
-		free(header);
-		exit(EXIT_FAILURE);
-	}
-	/* Checks if the header->version field is "00" */
-	if (strncmp(header->version, "00", VERSION_SIZE) != 0) {
-		fprintf(stderr, "Header version field not valid\n");
-		free(header);
-		exit(EXIT_FAILURE);
-	}
-	/* Checks if the header->uid field is too long */
-	num = extract_special_int(header->uid, UID_SIZE);
-	if (num > MAX_UID_SIZE) {
-		fprintf(stderr, "Header uid field invalid\n");
-		free(header);
-		exit(EXIT_FAILURE);
-	}
-	/* Checks if the header->gid field is too long */
-	num = extract_special_int(header->gid, GID_SIZE);
-	if (num > MAX_GID_SIZE) {
-		fprintf(stderr, "Header gid field invalid\n");
-		free(header);
-		exit(EXIT_FAILURE);
-	}
-	return;
-}
+/* Describes what mtStrictCheck finds wrong with a header, or returns
+ * NULL if nothing is */
+const char *strictError(Header *header) {
+	int status = mtStrictCheck(header);
 
-int isValid(char *name, char *path, int t_flag) {
-	int res;
-	char *name_tok;
-	char *path_tok;
-	char *path_copy;
-	char *name_copy;
-	char *ncptr;
-	char *pcptr;
-	res = 0;
-
-	if (t_flag) {
-		if (strlen(path) > strlen(name)) {
-			return res;
-		}
-	}
-
-	name_copy = calloc(PATH_LIMIT, sizeof(char));
-	if (!name_copy) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
-	path_copy = calloc(PATH_LIMIT, sizeof(char));
-	if (!path_copy) {
-		perror("calloc");
-		exit(EXIT_FAILURE);
-	}
-
-	strcpy(name_copy, name);		    
-	strcpy(path_copy, path);
-	
-	ncptr = name_copy;
-	pcptr = path_copy;
+	return status == MT_OK ? NULL : mtStrerror(status);
+}
 
-	while (1) {
-		if ((name_tok = strtok_r(ncptr, "/", &ncptr)) == NULL) {
-			break;
-		}
-		if ((path_tok = strtok_r(pcptr, "/", &pcptr)) == NULL) {
-			break;
-		}
-		res = (strcmp(name_tok, path_tok) == 0);
+/* Checks if a block could be a header without knowing where the
+ * previous header said it would be */
+int isCandidate(Header *header) {
+	if (memcmp(header->magic, MAGIC_NUM, MAGIC_SIZE - 1) != 0) {
+		return 0;
 	}
-	free(name_copy);
-	free(path_copy);
-	return res;
+	return getChksum(header) == parseOctal(header->chksum, CHKSUM_SIZE);
 }
-
@@ -1,11 +1,19 @@
 #ifndef UTILITIESH
 #define UTILITIESH
 
+#include <stdint.h>
+
+#include "header.h"
+
 uint32_t extract_special_int(char *, int);
 int insert_special_int(char *, size_t, int32_t);
+long int getHeaderId(char *, int);
+unsigned long parseOctal(const char *, size_t);
+int getName(Header *, char *);
 void setChksum(Header *);
 unsigned int getChksum(Header *); 
-void strictCheck(Header *);
-int isValid(char *, char *, int);
+int isZeroBlock(Header *);
+const char *strictError(Header *);
+int isCandidate(Header *);
 
 #endif
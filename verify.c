@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "verify.h"
+#include "libmytar.h"
+#include "header.h"
+#include "hash.h"
+#include "walk.h"
+#include "mytar.h"
+
+/* Thread that hashes members until there are none left. Before
+ * hashing a member it asks for all of its pages to be read ahead, so
+ * the disk stays busy while the hash catches up. */
+void *verifyThread(void *arg) {
+	Walk *walk = arg;
+	VerifyJob *job;
+	long page = sysconf(_SC_PAGESIZE);
+	off_t start;
+
+	while ((job = walkNextJob(walk)) != NULL) {
+		if (job->data + (off_t)job->size > walk->map_size) {
+			job->result = VERIFY_SHORT;
+			continue;
+		}
+		if (!job->has_checksum) {
+			job->result = VERIFY_NONE;
+			continue;
+		}
+		/* madvise wants a page aligned start */
+		start = job->data & ~(off_t)(page - 1);
+		madvise((void *)(walk->map + start), 
+				job->data + job->size - start, MADV_WILLNEED);
+		job->result = hashBuffer(walk->map + job->data, job->size) ==
+			job->expected ? VERIFY_OK : VERIFY_BAD;
+	}
+	return NULL;
+}
+
+/* Adds a job for each regular file the walk comes to, with the
+ * checksum the PAX header before it gave, if there was one */
+int verifyEntry(Walk *walk, MtEntry *entry, void *arg) {
+	VerifyJob *job;
+
+	if (entry->type != REG_FLAG) {
+		return 0;
+	}
+	job = walkAddJob(walk);
+	job->name = walkAddName(walk, entry->name[0] ? entry->name :
+			"(path too long)");
+	job->data = entry->offset + BLOCK_SIZE;
+	job->size = entry->size;
+	job->expected = entry->checksum;
+	job->has_checksum = entry->has_checksum;
+	job->result = VERIFY_NONE;
+	return 0;
+}
+
+/* Checks the contents of every regular file in an archive against the
+ * checksum create --checksum stored for it. The members are collected
+ * by walking the archive's headers, then a pool of threads hashes them
+ * straight out of the mapping. Prints every member that failed, and
+ * with verbose set every member. Returns the number of members that
+ * failed, counting damaged headers. */
+size_t verifyArchive(char *prog, char *archive, Options *opts) {
+	size_t failed;
+	size_t i;
+	const char *name;
+	Walk walk;
+	VerifyJob *job;
+
+	walkOpen(&walk, prog, archive, sizeof(VerifyJob));
+	failed = walkArchive(&walk, opts, verifyEntry, NULL);
+	walkRun(&walk, opts, verifyThread);
+
+	for (i = 0; i < walk.num_jobs; i++) {
+		job = walkJob(&walk, i);
+		name = walkName(&walk, job->name);
+		if (job->result == VERIFY_BAD) {
+			fprintf(stderr, "%s: checksum mismatch\n", name);
+			failed += 1;
+		}
+		else if (job->result == VERIFY_SHORT) {
+			fprintf(stderr, "%s: archive ends before the end of "
+					"its contents\n", name);
+			failed += 1;
+		}
+		else if (opts->verbose) {
+			printf("%s: %s\n", name, job->result == VERIFY_OK ?
+					"OK" : "no checksum");
+		}
+	}
+	if (failed) {
+		fprintf(stderr, "%s: %zu member(s) failed verification\n",
+				prog, failed);
+	}
+	walkClose(&walk);
+	return failed;
+}
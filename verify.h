@@ -0,0 +1,35 @@
+#ifndef VERIFYH
+#define VERIFYH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "options.h"
+#include "libmytar.h"
+#include "walk.h"
+
+/* What verifying a member found */
+#define VERIFY_OK 0
+#define VERIFY_BAD 1
+#define VERIFY_NONE 2
+#define VERIFY_SHORT 3
+
+/* A member whose contents need hashing */
+typedef struct verifyjob {
+	/* Where its name is kept in the walk, which is only looked at
+	 * when reporting */
+	size_t name;
+	off_t data;
+	uint64_t size;
+	uint64_t expected;
+	/* A PAX header gave it a checksum */
+	char has_checksum;
+	char result;
+} VerifyJob;
+
+int verifyEntry(Walk *, MtEntry *, void *);
+void *verifyThread(void *);
+size_t verifyArchive(char *, char *, Options *);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "volume.h"
+#include "cache.h"
+#include "stats.h"
+#include "mytar.h"
+
+void volumeInit(VolumeSet *set, char *base) {
+	memset(set, 0, sizeof(VolumeSet));
+	set->base = base;
+	set->record_fd = -1;
+	return;
+}
+
+/* Returns the malloced name of the volume numbered volume, counting
+ * from 1, of the archive named base */
+char *volumeName(const char *base, int volume) {
+	size_t len = strlen(base) + VOLUME_DIGITS + 2;
+	char *name = malloc(len);
+
+	if (!name) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	if (volume == 1) {
+		strcpy(name, base);
+	}
+	else {
+		snprintf(name, len, "%s.%d", base, volume);
+	}
+	return name;
+}
+
+/* Adds up the sizes of the archive in the file name and, with multi
+ * set, the volumes after it */
+uint64_t volumeTotal(const char *name, int multi) {
+	struct stat info;
+	uint64_t total = 0;
+	char *volume;
+	int i;
+
+	if (stat(name, &info) == -1) {
+		return 0;
+	}
+	total = info.st_size;
+	for (i = 2; multi; i++) {
+		volume = volumeName(name, i);
+		multi = stat(volume, &info) == 0;
+		if (multi) {
+			total += info.st_size;
+		}
+		free(volume);
+	}
+	return total;
+}
+
+/* How far into the archive in the file name, counting every volume
+ * before it, offset in its volume numbered volume is */
+uint64_t volumeOffset(const char *name, int volume, off_t offset) {
+	struct stat info;
+	uint64_t total = offset;
+	char *before;
+	int i;
+
+	for (i = 1; i < volume; i++) {
+		before = volumeName(name, i);
+		if (stat(before, &info) == 0) {
+			total += info.st_size;
+		}
+		free(before);
+	}
+	return total;
+}
+
+/* The MtVolumeFn for reading a split archive. Closes the volume that
+ * was read and opens the next, leaving errno as ENOENT if there isn't
+ * one. */
+int readVolume(void *arg, int volume, int fd) {
+	VolumeSet *set = arg;
+	char *name = volumeName(set->base, volume);
+	int next;
+
+	cacheDone(&set->cache, fd);
+	memset(&set->cache, 0, sizeof(CacheRange));
+	close(fd);
+	next = statsOpen(name, O_RDONLY, 0);
+	free(name);
+	return next;
+}
+
+/* The MtVolumeFn for writing a split archive. Finishes off the volume
+ * that filled up, closing it unless a checksum record in it is still
+ * to be filled in, and creates the next. */
+int writeVolume(void *arg, int volume, int fd) {
+	VolumeSet *set = arg;
+	char *name = volumeName(set->base, volume);
+	int next;
+
+	cacheFinish(&set->cache, fd, 1);
+	memset(&set->cache, 0, sizeof(CacheRange));
+	if (fd != set->record_fd) {
+		close(fd);
+	}
+	next = statsOpen(name, O_WRONLY | O_CREAT | O_TRUNC, 
+			S_IRUSR | S_IWUSR);
+	if (next == -1) {
+		perror(name);
+	}
+	free(name);
+	return next;
+}
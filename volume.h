@@ -0,0 +1,32 @@
+#ifndef VOLUMEH
+#define VOLUMEH
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cache.h"
+
+/* The files an archive is spread over when it's split into volumes with
+ * --volume-size or written as --stripes. The first is the tarfile
+ * argument itself and the rest have ".2", ".3", and so on after its
+ * name, so an archive that fits in one volume is just a plain archive.
+ * Volumes are read and written one after another, each through the
+ * same set. */
+typedef struct volumeset {
+	/* The tarfile argument */
+	char *base;
+	/* Page cache bookkeeping for the volume being read or written */
+	CacheRange cache;
+	/* A volume that's been written but still has a checksum record to
+	 * be filled in, so it stays open until it is, or -1 */
+	int record_fd;
+} VolumeSet;
+
+void volumeInit(VolumeSet *, char *);
+char *volumeName(const char *, int);
+uint64_t volumeTotal(const char *, int);
+uint64_t volumeOffset(const char *, int, off_t);
+int readVolume(void *, int, int);
+int writeVolume(void *, int, int);
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "walk.h"
+#include "libmytar.h"
+#include "stats.h"
+#include "scan.h"
+#include "mytar.h"
+
+/* Opens and maps archive for walking, with jobs of job_size bytes.
+ * Exits if it can't be. */
+void walkOpen(Walk *walk, char *prog, char *archive, size_t job_size) {
+	struct stat info;
+
+	memset(walk, 0, sizeof(Walk));
+	walk->prog = prog;
+	walk->job_size = job_size;
+	walk->fd = statsOpen(archive, O_RDONLY, 0);
+	if (walk->fd == -1 || fstat(walk->fd, &info) == -1) {
+		perror(archive);
+		exit(EXIT_FAILURE);
+	}
+	walk->map_size = info.st_size;
+	if (info.st_size > 0) {
+		walk->map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+				walk->fd, 0);
+		if (walk->map == MAP_FAILED) {
+			perror("mmap");
+			exit(EXIT_FAILURE);
+		}
+		madvise((void *)walk->map, info.st_size, MADV_SEQUENTIAL);
+	}
+	return;
+}
+
+/* Reads every header of the archive, calling fn with each member until
+ * it asks to stop. A damaged header is reported and, with --recover,
+ * stepped past to the next one. Returns how many headers were damaged,
+ * counting an archive that ends partway through one. */
+size_t walkArchive(Walk *walk, Options *opts, WalkFn fn, void *arg) {
+	MtReader reader;
+	MtEntry entry;
+	int status;
+	off_t from;
+	off_t to;
+	size_t damaged = 0;
+
+	mtReaderInit(&reader, walk->fd, opts->strict ? MT_STRICT : 0);
+	if (walk->map) {
+		mtReaderMap(&reader, walk->map, walk->map_size);
+	}
+	while ((status = mtReaderNext(&reader, &entry)) != MT_END) {
+		if (status == MT_OK || status == MT_ERR_TOOLONG) {
+			statsEntry(entry.size);
+			if (fn(walk, &entry, arg)) {
+				break;
+			}
+			continue;
+		}
+		fprintf(stderr, "%s\n", mtStrerror(status));
+		damaged += 1;
+		if (!opts->recover || status == MT_ERR_IO ||
+				status == MT_ERR_TRUNCATED) {
+			break;
+		}
+		status = mtReaderRecover(&reader, &from, &to);
+		reportRecover(walk->prog, status, from, to);
+	}
+	return damaged;
+}
+
+/* Makes room for another job and returns it, zeroed */
+void *walkAddJob(Walk *walk) {
+	void *job;
+
+	if (walk->num_jobs == walk->cap_jobs) {
+		walk->cap_jobs = walk->cap_jobs ? walk->cap_jobs * 2 :
+			SCAN_START_CANDS;
+		walk->jobs = realloc(walk->jobs,
+				walk->job_size * walk->cap_jobs);
+		if (!walk->jobs) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	job = walk->jobs + walk->num_jobs * walk->job_size;
+	walk->num_jobs += 1;
+	memset(job, 0, walk->job_size);
+	return job;
+}
+
+/* Keeps a copy of name for a job, returning where it is for walkName */
+size_t walkAddName(Walk *walk, const char *name) {
+	size_t len = strlen(name) + 1;
+	size_t at = walk->names_len;
+
+	while (walk->names_len + len > walk->names_cap) {
+		walk->names_cap = walk->names_cap ? walk->names_cap * 2 :
+			SCAN_START_POOL;
+		walk->names = realloc(walk->names, walk->names_cap);
+		if (!walk->names) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(walk->names + at, name, len);
+	walk->names_len += len;
+	return at;
+}
+
+const char *walkName(Walk *walk, size_t at) {
+	return walk->names + at;
+}
+
+void *walkJob(Walk *walk, size_t i) {
+	return walk->jobs + i * walk->job_size;
+}
+
+/* Hands a thread the next job, or NULL once they've all been taken */
+void *walkNextJob(Walk *walk) {
+	size_t i = atomic_fetch_add(&walk->next, 1);
+
+	return i < walk->num_jobs ? walkJob(walk, i) : NULL;
+}
+
+/* Works through the jobs with --jobs threads, or one per CPU, each
+ * running thread with the walk */
+void walkRun(Walk *walk, Options *opts, void *(*thread)(void *)) {
+	int num_threads;
+	int r;
+	pthread_t *threads;
+
+	num_threads = opts->jobs ? opts->jobs :
+		sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+	if (num_threads > MAX_JOBS) {
+		num_threads = MAX_JOBS;
+	}
+	threads = calloc(num_threads, sizeof(pthread_t));
+	if (!threads) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	atomic_init(&walk->next, 0);
+	for (r = 0; r < num_threads; r++) {
+		if (pthread_create(&threads[r], NULL, thread, walk) != 0) {
+			fprintf(stderr, "%s: can't start thread\n",
+					walk->prog);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (r = 0; r < num_threads; r++) {
+		pthread_join(threads[r], NULL);
+	}
+	free(threads);
+	return;
+}
+
+void walkClose(Walk *walk) {
+	if (walk->map) {
+		munmap((void *)walk->map, walk->map_size);
+	}
+	free(walk->jobs);
+	free(walk->names);
+	close(walk->fd);
+	return;
+}
@@ -0,0 +1,53 @@
+#ifndef WALKH
+#define WALKH
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "options.h"
+#include "libmytar.h"
+
+/* An archive walked for --verify and the d option. It's mapped, and
+ * its headers are read out of the mapping with libmytar's reader,
+ * which steps over the contents, so the walk only touches the headers.
+ * Each member that needs looking at gets a job, and a pool of threads
+ * then works through the jobs straight out of the mapping, taking the
+ * next one in archive order so together they read the archive front to
+ * back and the disk sees one mostly sequential stream. */
+typedef struct walk {
+	char *prog;
+	int fd;
+	const unsigned char *map;
+	off_t map_size;
+	/* The jobs, each job_size bytes, whatever the caller needs */
+	char *jobs;
+	size_t job_size;
+	size_t num_jobs;
+	size_t cap_jobs;
+	/* The next job a thread will take */
+	atomic_size_t next;
+	/* Names the jobs refer to by offset, since the pool moves as it
+	 * grows */
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+} Walk;
+
+/* Called with each member of the archive in turn. The entry's name is
+ * empty if it was longer than PATH_LIMIT; its contents are at
+ * entry->offset + BLOCK_SIZE in the mapping. Returns 1 to end the walk
+ * early, or 0 to go on. */
+typedef int (*WalkFn)(Walk *, MtEntry *, void *);
+
+void walkOpen(Walk *, char *, char *, size_t);
+size_t walkArchive(Walk *, Options *, WalkFn, void *);
+void *walkAddJob(Walk *);
+size_t walkAddName(Walk *, const char *);
+const char *walkName(Walk *, size_t);
+void *walkJob(Walk *, size_t);
+void *walkNextJob(Walk *);
+void walkRun(Walk *, Options *, void *(*)(void *));
+void walkClose(Walk *);
+
+#endif
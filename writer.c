@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <grp.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "libmytar.h"
+#include "header.h"
+#include "utilities.h"
+#include "stats.h"
+#include "mytar.h"
+
+void mtWriterInit(MtWriter *writer, int fd, int flags) {
+	memset(writer, 0, sizeof(MtWriter));
+	writer->fd = fd;
+	writer->flags = flags;
+	return;
+}
+
+/* getpwuid and getgrgid hand back the same static buffers to every
+ * caller, so lookups from writers on different threads take turns.
+ * The last user and group looked up are kept, since nearly every file
+ * in a tree has the same ones, so the turns are short. */
+static pthread_mutex_t nss_lock = PTHREAD_MUTEX_INITIALIZER;
+static int have_uid;
+static uid_t last_uid;
+static char last_uname[UNAME_SIZE + 1];
+static int have_gid;
+static gid_t last_gid;
+static char last_gname[GNAME_SIZE + 1];
+
+/* Splits the archive into volumes of size bytes, rounded down to whole
+ * blocks. Once one fills up, next_volume is called for the next, so
+ * only the last volume has the end of archive marker. A member whose
+ * contents run past the end of a volume carries on in the next one
+ * after a PAX header saying how far into its contents it picks up and
+ * a copy of its header with the size of what's left. Has to be called
+ * before anything is written. */
+int mtWriterSplit(MtWriter *writer, uint64_t size, MtVolumeFn next_volume,
+		void *arg) {
+	size -= size % BLOCK_SIZE;
+	if (size < MT_MIN_VOLUME) {
+		return MT_ERR_VOLSIZE;
+	}
+	if (writer->offset != 0 || writer->volume_size != 0) {
+		return MT_ERR_STATE;
+	}
+	writer->volume_size = size;
+	writer->next_volume = next_volume;
+	writer->volume_arg = arg;
+	writer->volume = 1;
+	return MT_OK;
+}
+
+/* Picks up an archive that was being written to fd when it was
+ * interrupted, at offset in it or, if the archive is split, in its
+ * volume numbered volume, which fd has to be. offset has to be between
+ * members, like where mtWriterEnd left off, and anything after it is
+ * cut off. Has to be called before anything is written, and after
+ * mtWriterSplit. Returns MT_OK, or MT_ERR_IO if fd couldn't be cut
+ * back. */
+int mtWriterResume(MtWriter *writer, int volume, off_t offset) {
+	if (writer->offset != 0 || writer->in_entry || offset < 0 ||
+			offset % BLOCK_SIZE != 0 || volume < 1 ||
+			(volume > 1 && writer->volume_size == 0)) {
+		return MT_ERR_STATE;
+	}
+	if (ftruncate(writer->fd, offset) == -1 ||
+			statsLseek(writer->fd, offset, SEEK_SET) == -1) {
+		return MT_ERR_IO;
+	}
+	writer->offset = offset;
+	if (writer->volume_size > 0) {
+		writer->volume = volume;
+	}
+	return MT_OK;
+}
+
+/* Writes all of len bytes, going back for the rest after short
+ * writes */
+static int writeFull(MtWriter *writer, const void *buf, size_t len) {
+	size_t done = 0;
+	ssize_t res;
+
+	while (done < len) {
+		res = statsWrite(writer->fd, (const char *)buf + done,
+				len - done);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return MT_ERR_IO;
+		}
+		done += res;
+	}
+	writer->offset += len;
+	return MT_OK;
+}
+
+/* Fills in an entry for the file at path from its lstat info, looking
+ * up the owner's names and, for a symlink, what it points to */
+int mtEntryFromStat(MtEntry *entry, const char *path, struct stat *info) {
+	return mtEntryFromStatat(entry, path, AT_FDCWD, path, info);
+}
+
+/* Like mtEntryFromStat, for a file archived as path that's name
+ * relative to the directory open as dirfd, which is where a symlink's
+ * target is read from */
+int mtEntryFromStatat(MtEntry *entry, const char *path, int dirfd, 
+		const char *name, struct stat *info) {
+	struct passwd *pswrd;
+	struct group *grp;
+	ssize_t len;
+
+	memset(entry, 0, sizeof(MtEntry));
+	if (strlen(path) > PATH_LIMIT) {
+		return MT_ERR_TOOLONG;
+	}
+	strcpy(entry->name, path);
+	entry->mode = info->st_mode & PERMS_MASK;
+	entry->uid = info->st_uid;
+	entry->gid = info->st_gid;
+	entry->mtime = info->st_mtime;
+	if (S_ISREG(info->st_mode)) {
+		entry->type = REG_FLAG;
+		entry->size = info->st_size;
+	}
+	else if (S_ISDIR(info->st_mode)) {
+		entry->type = DIR_FLAG;
+	}
+	else if (S_ISLNK(info->st_mode)) {
+		entry->type = SYM_FLAG;
+		len = statsReadlinkat(dirfd, name, entry->linkname, 
+				LINKNAME_SIZE);
+		if (len == -1) {
+			return MT_ERR_IO;
+		}
+		entry->linkname[len] = '\0';
+	}
+
+	/* Owners without names are archived with just their ids */
+	pthread_mutex_lock(&nss_lock);
+	if (!have_uid || last_uid != info->st_uid) {
+		memset(last_uname, 0, sizeof(last_uname));
+		pswrd = statsGetpwuid(info->st_uid);
+		if (pswrd) {
+			strncpy(last_uname, pswrd->pw_name, UNAME_SIZE);
+		}
+		last_uid = info->st_uid;
+		have_uid = 1;
+	}
+	if (!have_gid || last_gid != info->st_gid) {
+		memset(last_gname, 0, sizeof(last_gname));
+		grp = statsGetgrgid(info->st_gid);
+		if (grp) {
+			strncpy(last_gname, grp->gr_name, GNAME_SIZE);
+		}
+		last_gid = info->st_gid;
+		have_gid = 1;
+	}
+	memcpy(entry->uname, last_uname, UNAME_SIZE);
+	memcpy(entry->gname, last_gname, GNAME_SIZE);
+	pthread_mutex_unlock(&nss_lock);
+	return MT_OK;
+}
+
+/* Puts a name too long for the name field into the prefix and name
+ * fields, split at a '/' */
+static int setPrefix(const char *name, Header *header) {
+	size_t len = strlen(name);
+	/* The name field takes at most the last 100 characters, so the
+	 * split can't come any earlier than this */
+	size_t i = len - NAME_SIZE - 1;
+
+	while (i < len && name[i] != '/') {
+		i++;
+	}
+	if (i == len || i > PREFIX_SIZE) {
+		return MT_ERR_TOOLONG;
+	}
+	/* The '/' itself isn't stored */
+	memcpy(header->prefix, name, i);
+	memcpy(header->name, name + i + 1, len - i - 1);
+	return MT_OK;
+}
+
+/* Writes a numeric field as octal, or as a special int if it doesn't
+ * fit, which strict writers refuse with error instead */
+static int setNumber(MtWriter *writer, char *field, size_t size,
+		uint64_t val, uint64_t max, int error) {
+	if (val < max) {
+		sprintf(field, "%0*llo", (int)size - 1, (unsigned long long)val);
+		return MT_OK;
+	}
+	if (writer->flags & MT_STRICT ||
+			insert_special_int(field, size, val) != 0) {
+		return error;
+	}
+	return MT_OK;
+}
+
+/* Formats a PAX record, "length key=value\n", where the length counts
+ * its own digits. Returns the record's length. */
+static int paxRecord(char *buf, const char *key, uint64_t value) {
+	int body = snprintf(NULL, 0, " %s=%llu\n", key, 
+			(unsigned long long)value);
+	int len = body + 1;
+
+	while (snprintf(NULL, 0, "%d", len) + body != len) {
+		len++;
+	}
+	return sprintf(buf, "%d %s=%llu\n", len, key, 
+			(unsigned long long)value);
+}
+
+/* Fills in entry->header from the rest of the entry without writing
+ * it, for callers that need to know a member can be stored before
+ * writing anything that goes in front of it */
+int mtBuildHeader(MtWriter *writer, MtEntry *entry) {
+	Header *header = &entry->header;
+	uint64_t size = entry->type == REG_FLAG || entry->type == PAX_FLAG ?
+		entry->size : 0;
+	uint64_t start;
+	int status;
+
+	memset(header, 0, sizeof(Header));
+
+	/* Names up to 100 characters fit in the name field, which then
+	 * doesn't need to be null-terminated */
+	if (strlen(entry->name) <= NAME_SIZE) {
+		memcpy(header->name, entry->name, strlen(entry->name));
+	}
+	else if ((status = setPrefix(entry->name, header)) != MT_OK) {
+		return status;
+	}
+
+	sprintf(header->mode, "%07o", entry->mode & PERMS_MASK);
+	if ((status = setNumber(writer, header->uid, UID_SIZE, entry->uid,
+					MAX_UID_SIZE, MT_ERR_BIGUID)) != MT_OK ||
+			(status = setNumber(writer, header->gid, GID_SIZE,
+					entry->gid, MAX_GID_SIZE,
+					MT_ERR_BIGGID)) != MT_OK ||
+			(status = setNumber(writer, header->size, SIZE_SIZE,
+					size, MAX_SIZE_SIZE,
+					MT_ERR_BIGSIZE)) != MT_OK ||
+			(status = setNumber(writer, header->mtime, MTIME_SIZE,
+					entry->mtime, MAX_MTIME_SIZE,
+					MT_ERR_BIGMTIME)) != MT_OK) {
+		return status;
+	}
+	*(header->typeflag) = entry->type;
+	/* Fields that are completely full aren't null-terminated */
+	memcpy(header->linkname, entry->linkname,
+			strnlen(entry->linkname, LINKNAME_SIZE));
+	strcpy(header->magic, MAGIC_NUM);
+	memcpy(header->version, VERSION_NUM, VERSION_SIZE);
+	memcpy(header->uname, entry->uname, strnlen(entry->uname, UNAME_SIZE));
+	memcpy(header->gname, entry->gname, strnlen(entry->gname, GNAME_SIZE));
+	/* Major and minor device numbers stay zero */
+
+	start = statsStart();
+	setChksum(header);
+	statsAdd(STAT_CHKSUM, start, 0);
+	return MT_OK;
+}
+
+/* Starts a volume the current member's contents carry on into with a
+ * PAX header saying how many of them came before, then the member's
+ * header again with the size of what's left */
+static int writeContinuation(MtWriter *writer) {
+	MtEntry pax;
+	Header header = writer->member;
+	char data[BLOCK_SIZE];
+	size_t len = strnlen(header.name, NAME_SIZE);
+	int status;
+
+	memset(&pax, 0, sizeof(MtEntry));
+	memset(data, 0, BLOCK_SIZE);
+	strcpy(pax.name, PAX_DIR);
+	if (len > NAME_SIZE - strlen(PAX_DIR)) {
+		len = NAME_SIZE - strlen(PAX_DIR);
+	}
+	memcpy(pax.name + strlen(PAX_DIR), header.name, len);
+	pax.mode = PAX_MODE;
+	pax.type = PAX_FLAG;
+	pax.size = paxRecord(data, MT_VOLUME_KEY, writer->written);
+	if ((status = mtBuildHeader(writer, &pax)) != MT_OK) {
+		return status;
+	}
+	memset(header.size, 0, SIZE_SIZE);
+	if ((status = setNumber(writer, header.size, SIZE_SIZE,
+					writer->size - writer->written, 
+					MAX_SIZE_SIZE, MT_ERR_BIGSIZE)) != 
+			MT_OK) {
+		return status;
+	}
+	setChksum(&header);
+	if ((status = writeFull(writer, &pax.header, BLOCK_SIZE)) != MT_OK ||
+			(status = writeFull(writer, data, BLOCK_SIZE)) != 
+			MT_OK) {
+		return status;
+	}
+	return writeFull(writer, &header, BLOCK_SIZE);
+}
+
+/* Moves on to the next volume once the current one is full, continuing
+ * the current member in it if some of its contents are still to come.
+ * PAX headers' contents are never continued; a reader just reads on
+ * into the next volume. */
+static int checkVolume(MtWriter *writer) {
+	int fd;
+
+	if (writer->volume_size == 0 || 
+			(uint64_t)writer->offset < writer->volume_size) {
+		return MT_OK;
+	}
+	fd = writer->next_volume(writer->volume_arg, writer->volume + 1,
+			writer->fd);
+	if (fd == -1) {
+		return MT_ERR_IO;
+	}
+	writer->fd = fd;
+	writer->volume += 1;
+	writer->offset = 0;
+	if (writer->in_entry && *writer->member.typeflag != PAX_FLAG &&
+			writer->written < writer->size) {
+		return writeContinuation(writer);
+	}
+	return MT_OK;
+}
+
+/* Writes len bytes, moving on to the next volume whenever one fills
+ * up. With contents set they're counted towards the current member's
+ * contents. */
+static int writeSplit(MtWriter *writer, const void *buf, size_t len,
+		int contents) {
+	const char *src = buf;
+	size_t n;
+	int status;
+
+	while (len > 0) {
+		if ((status = checkVolume(writer)) != MT_OK) {
+			return status;
+		}
+		n = len;
+		if (writer->volume_size > 0 && 
+				n > writer->volume_size - writer->offset) {
+			n = writer->volume_size - writer->offset;
+		}
+		if ((status = writeFull(writer, src, n)) != MT_OK) {
+			return status;
+		}
+		if (contents) {
+			writer->written += n;
+		}
+		src += n;
+		len -= n;
+	}
+	return MT_OK;
+}
+
+/* Writes the header of a new member. The writer then expects
+ * entry->size bytes of contents before mtWriterEnd. If the entry
+ * can't be stored, nothing is written and the writer is ready for the
+ * next one. */
+int mtWriterBegin(MtWriter *writer, MtEntry *entry) {
+	int status;
+
+	if (writer->in_entry) {
+		return MT_ERR_STATE;
+	}
+	if ((status = mtBuildHeader(writer, entry)) != MT_OK) {
+		return status;
+	}
+	/* A full volume is moved on from first so the offset is where the
+	 * header really goes */
+	if ((status = checkVolume(writer)) != MT_OK) {
+		return status;
+	}
+	entry->offset = writer->offset;
+	if ((status = writeSplit(writer, &entry->header, BLOCK_SIZE, 0)) != 
+			MT_OK) {
+		return status;
+	}
+	writer->in_entry = 1;
+	writer->left = entry->type == REG_FLAG || entry->type == PAX_FLAG ?
+		entry->size : 0;
+	writer->tail_len = 0;
+	writer->member = entry->header;
+	writer->size = writer->left;
+	writer->written = 0;
+	return MT_OK;
+}
+
+/* Writes len more bytes of the current member's contents. Returns
+ * MT_ERR_SIZE without writing anything if that's more than its size
+ * has room for. */
+int mtWriterWrite(MtWriter *writer, const void *data, size_t len) {
+	const char *src = data;
+	size_t n;
+	size_t whole;
+	int status;
+
+	if (!writer->in_entry) {
+		return MT_ERR_STATE;
+	}
+	if (len > writer->left) {
+		return MT_ERR_SIZE;
+	}
+	writer->left -= len;
+	/* Finish off a partial block first */
+	if (writer->tail_len > 0) {
+		n = BLOCK_SIZE - writer->tail_len;
+		n = len < n ? len : n;
+		memcpy(writer->tail + writer->tail_len, src, n);
+		writer->tail_len += n;
+		src += n;
+		len -= n;
+		if (writer->tail_len < BLOCK_SIZE) {
+			return MT_OK;
+		}
+		writer->tail_len = 0;
+		if ((status = writeSplit(writer, writer->tail, BLOCK_SIZE, 
+						1)) != MT_OK) {
+			return status;
+		}
+	}
+	whole = len - len % BLOCK_SIZE;
+	if (whole > 0 && (status = writeSplit(writer, src, whole, 1)) != 
+			MT_OK) {
+		return status;
+	}
+	memcpy(writer->tail, src + whole, len - whole);
+	writer->tail_len = len - whole;
+	return MT_OK;
+}
+
+/* Ends the current member, padding its contents out to a whole block.
+ * If fewer bytes were written than its size, say because a file shrank
+ * while it was read, the rest is written as zeros so the archive stays
+ * readable, and MT_ERR_SIZE is returned. */
+int mtWriterEnd(MtWriter *writer) {
+	int status;
+	int result = MT_OK;
+
+	if (!writer->in_entry) {
+		return MT_ERR_STATE;
+	}
+	if (writer->left > 0) {
+		result = MT_ERR_SIZE;
+	}
+	while (writer->left > 0 || writer->tail_len > 0) {
+		writer->left -= writer->left < BLOCK_SIZE - writer->tail_len ?
+			writer->left : BLOCK_SIZE - writer->tail_len;
+		memset(writer->tail + writer->tail_len, 0,
+				BLOCK_SIZE - writer->tail_len);
+		writer->tail_len = 0;
+		if ((status = writeSplit(writer, writer->tail, BLOCK_SIZE, 
+						1)) != MT_OK) {
+			return status;
+		}
+	}
+	writer->in_entry = 0;
+	return result;
+}
+
+/* Writes the End of Archive marker, which is two blocks of zero
+ * bytes. The descriptor, the last volume's if the archive is split, is
+ * left for the caller to close. */
+int mtWriterClose(MtWriter *writer) {
+	char zeros[2 * BLOCK_SIZE];
+
+	if (writer->in_entry) {
+		return MT_ERR_STATE;
+	}
+	memset(zeros, 0, sizeof(zeros));
+	return writeSplit(writer, zeros, sizeof(zeros), 0);
+}